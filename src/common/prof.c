@@ -0,0 +1,70 @@
+/*
+ * Copyright(C) 2021 Robinson (Bob) Mittman. All Rights Reserved.
+ * Licensed under the MIT license.
+ * See LICENSE file in the project root for details.
+ *
+ */
+
+/* Latency and ISR profiling helpers of both link layers, on Timer1. */
+
+#include <avr/io.h>
+#include <util/atomic.h>
+#include "rc433.h"
+#include "isrprof.h"
+
+#if (RFLINK_TSTAMP)
+void prof_lat_add(struct rc433_lat * l, uint16_t d)
+{
+	uint16_t v = d;
+	uint8_t bin = 0;
+
+	while (v) {
+		v >>= 1;
+		bin++;
+	}
+
+	if ((l->cnt == 0) || (d < l->min))
+		l->min = d;
+	if (d > l->max)
+		l->max = d;
+	l->sum += d;
+	l->cnt++;
+	l->hist[bin]++;
+}
+
+/* 16 bit reads go through the shared TEMP register, keep ISRs out */
+uint16_t rc433_tstamp(void)
+{
+	uint16_t t;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		t = TCNT1;
+	}
+
+	return t;
+}
+#endif
+
+#if (RFLINK_ISR_PROF)
+struct rc433_isr_prof isr_prof;
+
+/* */
+void rc433_isr_prof_get(struct rc433_isr_prof * prof, uint8_t clr)
+{
+	struct rc433_isr * p;
+	uint8_t i;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		*prof = isr_prof;
+		for (i = 0; clr && (i < RC433_ISR_NUM); i++) {
+			p = &isr_prof.isr[i];
+			p->cnt = 0;
+			p->sum = 0;
+			p->max = 0;
+			p->lat = 0;
+		}
+	}
+}
+#endif
@@ -0,0 +1,188 @@
+/*
+ * Copyright(C) 2021 Robinson (Bob) Mittman. All Rights Reserved.
+ * Licensed under the MIT license.
+ * See LICENSE file in the project root for details.
+ *
+ */
+
+#include "tmr.h"
+#include <stddef.h>
+#include <util/atomic.h>
+
+#define TMR_WHEEL_MSK (TMR_WHEEL_LEN - 1)
+
+volatile uint16_t tmr_now;
+
+struct {
+	struct tmr * slot[TMR_WHEEL_LEN];
+	/* last tick walked by tmr_run() */
+	uint16_t done;
+	uint8_t cnt;
+} wheel;
+
+static inline uint16_t tmr_now_get(void)
+{
+	uint16_t now;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		now = tmr_now;
+	}
+
+	return now;
+}
+
+/* Head of the slot, a timer linked again while its slot is walked is
+   seen with a later due tick and skipped. Sorted, after the timers due
+   no later: the running timers are due within 0xffff ticks of the last
+   tick walked. */
+static void tmr_link(struct tmr * t, uint16_t due)
+{
+	struct tmr ** head = &wheel.slot[(uint8_t)due & TMR_WHEEL_MSK];
+#if (TMR_SORTED)
+	uint16_t d = due - wheel.done;
+
+	while ((*head != NULL) && ((uint16_t)((*head)->due - wheel.done) <= d))
+		head = &(*head)->next;
+#endif
+
+	t->due = due;
+	t->link = head;
+	if ((t->next = *head) != NULL)
+		t->next->link = &t->next;
+	*head = t;
+}
+
+static void tmr_unlink(struct tmr * t)
+{
+	if ((*t->link = t->next) != NULL)
+		t->next->link = t->link;
+	t->link = NULL;
+}
+
+void tmr_init(void)
+{
+	uint8_t i;
+
+	for (i = 0; i < TMR_WHEEL_LEN; i++)
+		wheel.slot[i] = NULL;
+	wheel.cnt = 0;
+	wheel.done = tmr_now_get();
+}
+
+void tmr_setup(struct tmr * t, tmr_cb_t cb, uint8_t ev)
+{
+	t->next = NULL;
+	t->link = NULL;
+	t->itv = 0;
+	t->cb = cb;
+	t->ev = ev;
+}
+
+void tmr_start(struct tmr * t, uint16_t dly, uint16_t itv)
+{
+	uint16_t now = tmr_now_get();
+
+	if (t->link != NULL)
+		tmr_unlink(t);
+	else if (wheel.cnt++ == 0)
+		/* nothing was running, no slot to catch up with */
+		wheel.done = now;
+
+	if (dly == 0)
+		dly = 1;
+
+	t->itv = itv;
+	tmr_link(t, now + dly);
+}
+
+void tmr_stop(struct tmr * t)
+{
+	if (t->link == NULL)
+		return;
+
+	tmr_unlink(t);
+	wheel.cnt--;
+}
+
+uint8_t tmr_pending(void)
+{
+	return wheel.cnt;
+}
+
+uint8_t tmr_run(void)
+{
+	struct tmr * t;
+	uint16_t now;
+#if !(TMR_SORTED)
+	struct tmr ** pp;
+	uint16_t tick;
+#endif
+	uint8_t ev = 0;
+
+	if (wheel.cnt == 0)
+		return 0;
+
+	now = tmr_now_get();
+
+#if (TMR_SORTED)
+	/* the head is the nearest deadline */
+	while (((t = wheel.slot[0]) != NULL) &&
+		   ((uint16_t)(t->due - wheel.done) <= (uint16_t)(now - wheel.done))) {
+		/* the periodic ones are linked again from their due tick */
+		wheel.done = t->due;
+		tmr_unlink(t);
+		if (t->itv)
+			tmr_link(t, t->due + t->itv);
+		else
+			wheel.cnt--;
+
+		ev |= t->ev;
+		if (t->cb != NULL)
+			t->cb(t);
+	}
+	wheel.done = now;
+#else
+	while (wheel.done != now) {
+		tick = ++wheel.done;
+		pp = &wheel.slot[(uint8_t)tick & TMR_WHEEL_MSK];
+
+		while ((t = *pp) != NULL) {
+			if (t->due != tick) {
+				pp = &t->next;
+				continue;
+			}
+
+			/* *pp moves on to the next timer */
+			tmr_unlink(t);
+			if (t->itv)
+				tmr_link(t, tick + t->itv);
+			else
+				wheel.cnt--;
+
+			ev |= t->ev;
+			if (t->cb != NULL)
+				t->cb(t);
+		}
+	}
+#endif
+
+	return ev;
+}
+
+#if (TMR_SORTED)
+uint16_t tmr_next(void)
+{
+	struct tmr * t = wheel.slot[0];
+	uint16_t due;
+	uint16_t now;
+
+	if (t == NULL)
+		return 0xffff;
+
+	now = tmr_now_get() - wheel.done;
+	due = t->due - wheel.done;
+
+	return (due > now) ? due - now : 0;
+}
+#endif
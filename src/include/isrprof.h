@@ -0,0 +1,91 @@
+/*
+ * Copyright(C) 2021 Robinson (Bob) Mittman. All Rights Reserved.
+ * Licensed under the MIT license.
+ * See LICENSE file in the project root for details.
+ *
+ */
+
+/* ISR profiling hooks of the firmwares (RFLINK_ISR_PROF in rc433.h).
+ *
+ * PROF_ISR(vect, idx, lat) stands for ISR(vect). With profiling on, the
+ * body that follows becomes an inline function called between two reads
+ * of Timer1, running at clk/1, and the cycles are added to entry 'idx'
+ * of the profile, an RC433_ISR_ index. 'lat' is evaluated first, on
+ * entry: PROF_LAT() of the timer count for the timer vectors, 0 for
+ * the others. Without profiling it is ISR(vect) and costs nothing. The
+ * table itself lives in src/common/prof.c, next to rc433_isr_prof_get(). */
+
+#ifndef __ISRPROF_H__
+#define __ISRPROF_H__
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "rc433.h"
+
+#if (RFLINK_ISR_PROF)
+
+extern struct rc433_isr_prof isr_prof;
+
+/* Cycles since a CTC match, rounded down to the prescaler step, from the
+   count of a timer running at clk/div. The flag is set as the counter
+   reaches 'top', the counter clears one step later. */
+static inline uint16_t prof_lat(uint8_t cnt, uint8_t top, uint16_t div)
+{
+	if (cnt == top)
+		return 0;
+	if (cnt >= (0xffff / div))
+		return 0xffff;
+	return (cnt + 1) * div;
+}
+
+#define PROF_LAT(_TCNT_, _TOP_, _DIV_) prof_lat(_TCNT_, _TOP_, _DIV_)
+
+/* The same for a counter running free through the match at 'ocr' */
+static inline uint16_t prof_lat_free(uint8_t cnt, uint8_t ocr, uint16_t div)
+{
+	uint8_t n = cnt - ocr;
+
+	if (n >= (0xffff / div))
+		return 0xffff;
+	return n * div;
+}
+
+#define PROF_LAT_FREE(_TCNT_, _OCR_, _DIV_) prof_lat_free(_TCNT_, _OCR_, _DIV_)
+
+static inline void prof_isr_end(struct rc433_isr * p, uint16_t t0,
+								uint16_t lat)
+{
+	uint16_t t = TCNT1;
+	uint16_t d = t - t0;
+
+	p->cnt++;
+	p->sum += d;
+	if (d > p->max)
+		p->max = d;
+	if (lat > p->lat)
+		p->lat = lat;
+}
+
+#define PROF_ISR(_VECT_, _IDX_, _LAT_) \
+	static inline void _VECT_##_body(void) __attribute__((always_inline)); \
+	ISR(_VECT_) \
+	{ \
+		uint16_t lat = (_LAT_); \
+		uint16_t t0 = TCNT1; \
+		_VECT_##_body(); \
+		prof_isr_end(&isr_prof.isr[_IDX_], t0, lat); \
+	} \
+	static inline void _VECT_##_body(void)
+
+#else
+
+#define PROF_ISR(_VECT_, _IDX_, _LAT_) ISR(_VECT_)
+
+#endif
+
+#if (RFLINK_TSTAMP)
+/* Add a latency of 'd' Timer1 ticks to 'l' (src/common/prof.c) */
+void prof_lat_add(struct rc433_lat * l, uint16_t d);
+#endif
+
+#endif /* __ISRPROF_H__ */
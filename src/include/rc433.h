@@ -10,11 +10,277 @@
 
 #include <stdint.h>
 
+/* Reed-Solomon protected frames: rc433_fec_send() on the transmitter,
+   decoded inside rc433_pkt_recv() on the receiver. Off by default, the
+   queue slots grow by the parity symbols. */
+#ifndef RFLINK_FEC
+#define RFLINK_FEC 0
+#endif
+
+/* Largest payload of the variable length frames, rc433_frm_send() and
+   rc433_frm_recv(), 4 to 64. 0, the default, leaves them out: every
+   queue slot on both sides is sized for the largest frame. */
+#ifndef RFLINK_FRM_MAX
+#define RFLINK_FRM_MAX 0
+#endif
+
+/* Duplicate suppression on the receiver: consecutive copies of the same
+   4 byte packet, sequence number included, are delivered once by
+   rc433_pkt_recv() and rc433_frm_recv() */
+#ifndef RFLINK_RX_DEDUP
+#define RFLINK_RX_DEDUP 1
+#endif
+
+/* Sequence number of a 4 byte packet, in the 3 spare bits of dat[0].
+   The transmitter bumps it for every new command and keeps it for the
+   repeats of that command, so a repeated command with the same payload
+   is still delivered again. */
+#define RC433_SEQ_MSK 0xe0
+#define RC433_SEQ_GET(_DAT0_) ((uint8_t)(_DAT0_) >> 5)
+#define RC433_SEQ_NEXT(_DAT0_) ((uint8_t)((_DAT0_) + 0x20) & RC433_SEQ_MSK)
+
+/* Acknowledged packets, rc433_arq_send(). The receiver answers packets
+   sent this way with an ACK frame on its TXD. Off by default, both
+   firmwares have to be built with it (make ARQ=1). */
+#ifndef RFLINK_ARQ
+#define RFLINK_ARQ 0
+#endif
+
+/* Latest-value-wins transmission, rc433_mbox_post(). The setpoint posted
+   last is sent by the next frame to start, the ones it replaces are
+   dropped. On unless built with RFLINK_ARQ, which the transmitter main
+   loop uses instead. */
+#ifndef RFLINK_MBOX
+#define RFLINK_MBOX (!(RFLINK_ARQ))
+#endif
+
+/* Latency instrumentation, rc433_tx_lat_get() and rc433_rx_lat_get().
+   Frames are stamped from the free running Timer1 at every stage they go
+   through. */
+#ifndef RFLINK_TSTAMP
+#define RFLINK_TSTAMP 0
+#endif
+
+/* ISR profiling, rc433_isr_prof_get(). Timer1 runs at clk/1 and counts
+   the cycles spent in every interrupt service routine, so it does not go
+   with RFLINK_TSTAMP. */
+#ifndef RFLINK_ISR_PROF
+#define RFLINK_ISR_PROF 0
+#endif
+
 void rc433_init(void);
 
 int8_t rc433_pkt_send(uint8_t dat[]);
 
+#if (RFLINK_FEC)
+/* Same 27 bit payload as rc433_pkt_send(), followed by 4 RS(12,8) parity
+   symbols over GF(16). The receiver repairs up to 2 bad symbols, or up
+   to 4 when they are invalid line codes (erasures). */
+int8_t rc433_fec_send(uint8_t dat[]);
+#endif
+
+#if (RFLINK_ARQ)
+#define RC433_ARQ_FAIL -1
+#define RC433_ARQ_BUSY 0
+#define RC433_ARQ_ACK 1
+
+/* Send a 4 byte packet that the receiver acknowledges. It is sent again
+   after a timeout and a growing backoff until the ACK comes back, at most
+   RFLINK_ARQ_TRIES times, ahead of the queued frames, which wait for the
+   exchange to end. A packet still waiting for its ACK is replaced.
+   Returns 1 if accepted, 0 while the previous one is on the air. */
+int8_t rc433_arq_send(uint8_t dat[]);
+
+/* Outcome of the last rc433_arq_send(): RC433_ARQ_ACK, also when nothing
+   was sent, RC433_ARQ_BUSY or RC433_ARQ_FAIL */
+int8_t rc433_arq_status(void);
+
+/* times the last rc433_arq_send() packet went out */
+uint8_t rc433_arq_tries(void);
+#endif
+
+#if (RFLINK_MBOX)
+/* Post a 4 byte packet, the current setpoint, to be sent 'copies' times
+   ahead of the queued frames and behind an ARQ packet. Every frame takes
+   the packet posted last as it starts: a new post replaces the copies
+   left of the previous one, including the frame that would have been
+   sent next, so the receiver is at most one frame behind. The frame on
+   the air is finished. 0 copies withdraws the setpoint. */
+void rc433_mbox_post(uint8_t dat[], uint8_t copies);
+#endif
+
+/* number of frames queued for transmission, including the one
+   being transmitted */
+uint8_t rc433_tx_pending(void);
+
+/* Nothing queued, on the air or waiting for an ACK: the clocks may be
+   stopped. Call with interrupts disabled. */
+uint8_t rc433_tx_idle(void);
+
+#define RC433_PRE_MIN 2
+#define RC433_PRE_MAX 4
+
+/* Preamble of the frames sent from now on: 'len' sync symbols, the frame
+   type marker included, RC433_PRE_MIN to RC433_PRE_MAX (default). That is
+   for a frame keying the carrier up; a frame that follows another one,
+   with the carrier held on in between, gets two less, RC433_PRE_MIN at
+   least. Returns 1, or -1 on a bad length. */
+int8_t rc433_preamble_set(uint8_t len);
+
+/* Next 4 byte packet. Variable length frames are skipped. */
 int8_t rc433_pkt_recv(uint8_t dat[]);
 
+#if (RFLINK_FRM_MAX)
+/* Queue a frame of 'len' bytes, 1 to RFLINK_FRM_MAX, sent with a length
+   prefix and a CRC-16 instead of the CRC5. Returns 1 if queued, 0 if the
+   queue is full, -1 on a bad length. */
+int8_t rc433_frm_send(const uint8_t dat[], uint8_t len);
+
+/* Next frame of any kind into 'dat', which must hold RFLINK_FRM_MAX
+   bytes. Returns the payload length, 4 for packets, 0 if there is none. */
+int8_t rc433_frm_recv(uint8_t dat[]);
+#endif
+
+#define RC433_TYP_PKT 0
+#define RC433_TYP_FEC 1
+#define RC433_TYP_VAR 2
+
+/* Kind of the last frame returned by rc433_pkt_recv() or rc433_frm_recv(),
+   RC433_TYP_PKT, RC433_TYP_FEC or RC433_TYP_VAR */
+uint8_t rc433_frm_type(void);
+
+/* Between frames, with nothing received since the last call, no frame
+   left in the receive ring and no ACK going out: the clocks may be
+   stopped. Call with interrupts disabled. */
+uint8_t rc433_rx_idle(void);
+
+/* Wake up on the start bit of the next character, a pin change interrupt
+   on RXD. The character itself is lost, the preamble makes up for it. */
+void rc433_rx_wake(void);
+
+/* io_ms() when the receive interrupt completed the last frame returned by
+   rc433_pkt_recv() or rc433_frm_recv(). Built with RFLINK_RX_TIME. */
+uint16_t rc433_rx_time(void);
+
+#if (RFLINK_RX_DEDUP)
+/* Copies received so far of the last packet returned by rc433_pkt_recv()
+   or rc433_frm_recv(), the delivered one included. Copies arriving later
+   are counted when the receive functions are next called. */
+uint8_t rc433_pkt_copies(void);
+#endif
+
+#if (RFLINK_TSTAMP)
+#define RC433_LAT_BINS 17
+
+/* Time spent in one stage, in Timer1 ticks. A stage longer than the
+   timer period, 65536 ticks, is taken modulo the period. */
+struct rc433_lat {
+	uint16_t cnt;
+	uint16_t min;
+	uint16_t max;
+	uint32_t sum;
+	/* hist[0] counts 0 ticks, hist[n] 2^(n-1) to 2^n - 1 ticks */
+	uint16_t hist[RC433_LAT_BINS];
+};
+
+/* Timer1 now. The application stamps its own events with it. */
+uint16_t rc433_tstamp(void);
+
+struct rc433_tx_lat {
+	uint16_t tick_ns;
+	/* rc433_tx_mark() to the send function */
+	struct rc433_lat app;
+	/* send function to the first symbol, or the previous try to the
+	   first symbol of an ARQ retransmission */
+	struct rc433_lat queue;
+	/* first to last symbol written to UDR0 */
+	struct rc433_lat air;
+};
+
+/* The next frame sent answers an event stamped 't' with rc433_tstamp() */
+void rc433_tx_mark(uint16_t t);
+
+void rc433_tx_lat_get(struct rc433_tx_lat * lat);
+
+struct rc433_rx_lat {
+	uint16_t tick_ns;
+	/* first symbol after the preamble to the last one of a good frame */
+	struct rc433_lat air;
+	/* last symbol to rc433_pkt_recv() or rc433_frm_recv() */
+	struct rc433_lat deliver;
+};
+
+void rc433_rx_lat_get(struct rc433_rx_lat * lat);
+#endif
+
+#if (RFLINK_ISR_PROF)
+/* vectors profiled */
+#define RC433_ISR_RX 0
+#define RC433_ISR_UDRE 1
+#define RC433_ISR_TXC 2
+#define RC433_ISR_TMR0 3
+#define RC433_ISR_TMR2 4
+#define RC433_ISR_PCINT 5
+#define RC433_ISR_NUM 6
+
+/* One vector, in CPU cycles from the first to the last statement of the
+   ISR. The vector jump and the register saves and restores the compiler
+   puts around it are not counted, see the listing for those. */
+struct rc433_isr {
+	uint32_t cnt;
+	uint32_t sum;
+	uint16_t max;
+	/* Worst time from the interrupt flag to the ISR, read back from the
+	   counter of the timer vectors and rounded down to its prescaler
+	   step: 8 cycles for TIMER0_COMPA_vect, 256 or 1024 for
+	   TIMER2_COMPA_vect.
+	   The USART and pin change flags carry no time and leave it 0, they
+	   wait at most for the longest ISR or atomic block. */
+	uint16_t lat;
+};
+
+struct rc433_isr_prof {
+	/* indexed by RC433_ISR_RX to RC433_ISR_PCINT */
+	struct rc433_isr isr[RC433_ISR_NUM];
+};
+
+/* Copy the profile out and start over if 'clr' is set. Reading it at
+   regular intervals with 'clr' gives the load, sum over the interval,
+   and keeps cnt and sum from wrapping. */
+void rc433_isr_prof_get(struct rc433_isr_prof * prof, uint8_t clr);
+#endif
+
+#define RC433_ACQ_LEN 8
+
+/* receiver statistics */
+struct rc433_rx_stat {
+	/* frames dropped because the receive ring was full */
+	uint16_t ovr;
+	/* frames dropped on CRC mismatch */
+	uint16_t err;
+	/* frames aborted on an invalid line symbol */
+	uint16_t sym;
+	/* symbols repaired by the soft decoder (RFLINK_RX_SOFT_DECODE) */
+	uint16_t fix;
+	/* symbols corrected in FEC frames */
+	uint16_t fec;
+	/* FEC frames that could not be corrected */
+	uint16_t unc;
+	/* OSCCAL adjustments made by the clock calibration (RFLINK_RX_CAL) */
+	uint16_t cal;
+	/* receiver clock error relative to the transmitter, from the last
+	   preamble measurement, in ppm */
+	int32_t clk_ppm;
+	/* duplicate packets suppressed (RFLINK_RX_DEDUP) */
+	uint16_t dup;
+	/* preamble acquisition: acq[n - 1] counts the frames accepted after
+	   n sync symbols (marker included) were received, the last entry n or
+	   more. Against the length sent it shows how many the receiver
+	   missed while locking on. */
+	uint16_t acq[RC433_ACQ_LEN];
+};
+
+void rc433_rx_stat_get(struct rc433_rx_stat * stat);
+
 #endif /* __RC433_H__ */
 
@@ -0,0 +1,110 @@
+/*
+ * Copyright(C) 2021 Robinson (Bob) Mittman. All Rights Reserved.
+ * Licensed under the MIT license.
+ * See LICENSE file in the project root for details.
+ *
+ */
+
+/* Software timers on the io tick (src/common/tmr.c).
+ *
+ * Any number of one-shot or periodic timers, 16 bit in ticks, kept in a
+ * hashed timing wheel: a timer due at tick 't' is linked into slot
+ * t % TMR_WHEEL_LEN. The tick ISR only bumps the tick count with
+ * tmr_tick(), whatever the number of timers. tmr_run(), called from the
+ * main loop through io_events_get(), walks the slots of the ticks that
+ * went by and fires the timers due, so a tick costs the main loop one
+ * slot, the timers hashed to it with a later due tick included.
+ *
+ * With TMR_SORTED the wheel has a single slot kept sorted by due tick,
+ * for a tick source that does not interrupt at every tick (IO_TICKLESS
+ * in the io.h of the firmwares): its ISR moves the tick count by the
+ * ticks that went by with tmr_advance(), and the main loop programs its
+ * next interrupt for the nearest deadline, tmr_next(). Starting a timer
+ * then walks the running ones, tmr_run() only sees the timers due.
+ *
+ * A timer fires by calling its callback, from tmr_run(), and by returning
+ * its event bits from tmr_run(). All the functions but tmr_tick() and
+ * tmr_advance() belong to the main loop. */
+
+#ifndef __TMR_H__
+#define __TMR_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef TMR_SORTED
+#define TMR_SORTED 0
+#endif
+
+#if (TMR_SORTED)
+#undef TMR_WHEEL_LEN
+#define TMR_WHEEL_LEN 1
+#endif
+
+#ifndef TMR_WHEEL_LEN
+#define TMR_WHEEL_LEN 16
+#endif
+
+#if (TMR_WHEEL_LEN & (TMR_WHEEL_LEN - 1)) || (TMR_WHEEL_LEN > 256)
+#error "TMR_WHEEL_LEN must be a power of two not greater than 256"
+#endif
+
+struct tmr;
+
+typedef void (* tmr_cb_t)(struct tmr * t);
+
+struct tmr {
+	struct tmr * next;
+	/* the pointer to this timer in its slot, NULL when stopped */
+	struct tmr ** link;
+	/* tick it is due at */
+	uint16_t due;
+	/* period, 0 for a one-shot timer */
+	uint16_t itv;
+	tmr_cb_t cb;
+	uint8_t ev;
+};
+
+/* ticks, the tick ISR calls tmr_tick() */
+extern volatile uint16_t tmr_now;
+
+static inline void tmr_tick(void)
+{
+	tmr_now++;
+}
+
+static inline void tmr_advance(uint16_t n)
+{
+	tmr_now += n;
+}
+
+void tmr_init(void);
+
+/* Set up a stopped timer that calls 'cb', if not NULL, and sets the
+   event bits 'ev' when it fires. */
+void tmr_setup(struct tmr * t, tmr_cb_t cb, uint8_t ev);
+
+/* Fire 'dly' ticks from now, at least 1, then every 'itv' ticks, or only
+   once if 'itv' is 0. Restarts a running timer. */
+void tmr_start(struct tmr * t, uint16_t dly, uint16_t itv);
+
+void tmr_stop(struct tmr * t);
+
+static inline uint8_t tmr_running(const struct tmr * t)
+{
+	return t->link != NULL;
+}
+
+/* number of timers running */
+uint8_t tmr_pending(void);
+
+/* Fire the timers due since the last call, returns their event bits */
+uint8_t tmr_run(void);
+
+#if (TMR_SORTED)
+/* Ticks from now to the nearest deadline, 0 if one is due already and
+   0xffff with no timer running. */
+uint16_t tmr_next(void);
+#endif
+
+#endif /* __TMR_H__ */
@@ -0,0 +1,22 @@
+/*
+ * Copyright(C) 2021 Robinson (Bob) Mittman. All Rights Reserved.
+ * Licensed under the MIT license. 
+ * See LICENSE file in the project root for details.
+ *
+ */
+
+/* Host replacement for <avr/interrupt.h>. An ISR is a plain exported
+   function named after its vector; the simulator looks it up by name
+   and calls it when the interrupt is pending. */
+
+#ifndef __SIM_AVR_INTERRUPT_H__
+#define __SIM_AVR_INTERRUPT_H__
+
+#include <avr/io.h>
+
+#define ISR(vector, ...) void vector(void); void vector(void)
+
+#define sei() do { sim_io.sreg |= 0x80; } while (0)
+#define cli() do { sim_io.sreg &= ~0x80; } while (0)
+
+#endif /* __SIM_AVR_INTERRUPT_H__ */
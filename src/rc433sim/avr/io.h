@@ -0,0 +1,218 @@
+/*
+ * Copyright(C) 2021 Robinson (Bob) Mittman. All Rights Reserved.
+ * Licensed under the MIT license. 
+ * See LICENSE file in the project root for details.
+ *
+ */
+
+/* Host replacement for the avr-libc <avr/io.h> of the ATmega328P: maps the
+   registers used by the firmware onto the simulated register file. */
+
+#ifndef __SIM_AVR_IO_H__
+#define __SIM_AVR_IO_H__
+
+#include <stdint.h>
+#include "simio.h"
+
+extern struct sim_io sim_io;
+
+#define _BV(bit) (1 << (bit))
+
+#define SREG   (sim_io.sreg)
+
+/* USART0 */
+#define UDR0   (sim_io.udr0)
+#define UCSR0A (sim_io.ucsr0a)
+#define UCSR0B (sim_io.ucsr0b)
+#define UCSR0C (sim_io.ucsr0c)
+#define UBRR0  (sim_io.ubrr0)
+
+#define RXC0    7
+#define TXC0    6
+#define UDRE0   5
+#define FE0     4
+#define DOR0    3
+#define UPE0    2
+#define U2X0    1
+#define MPCM0   0
+
+#define RXCIE0  7
+#define TXCIE0  6
+#define UDRIE0  5
+#define RXEN0   4
+#define TXEN0   3
+#define UCSZ02  2
+#define RXB80   1
+#define TXB80   0
+
+#define UMSEL01 7
+#define UMSEL00 6
+#define UPM01   5
+#define UPM00   4
+#define USBS0   3
+#define UCSZ01  2
+#define UCSZ00  1
+#define UCPOL0  0
+
+/* ports */
+#define PORTB  (sim_io.portb)
+#define DDRB   (sim_io.ddrb)
+#define PINB   (sim_io.pinb)
+#define PORTC  (sim_io.portc)
+#define DDRC   (sim_io.ddrc)
+#define PINC   (sim_io.pinc)
+#define PORTD  (sim_io.portd)
+#define DDRD   (sim_io.ddrd)
+#define PIND   (sim_io.pind)
+
+/* Timer/Counter 0 */
+#define TCCR0A (sim_io.tccr0a)
+#define TCCR0B (sim_io.tccr0b)
+#define TCNT0  (sim_io.tcnt0)
+#define OCR0A  (sim_io.ocr0a)
+#define OCR0B  (sim_io.ocr0b)
+#define TIMSK0 (sim_io.timsk0)
+#define TIFR0  (sim_io.tifr0)
+
+#define COM0A1  7
+#define COM0A0  6
+#define COM0B1  5
+#define COM0B0  4
+#define WGM01   1
+#define WGM00   0
+#define FOC0A   7
+#define FOC0B   6
+#define WGM02   3
+#define CS02    2
+#define CS01    1
+#define CS00    0
+#define OCIE0B  2
+#define OCIE0A  1
+#define TOIE0   0
+#define OCF0B   2
+#define OCF0A   1
+#define TOV0    0
+
+/* Timer/Counter 1 */
+#define TCCR1A (sim_io.tccr1a)
+#define TCCR1B (sim_io.tccr1b)
+#define TCCR1C (sim_io.tccr1c)
+#define TCNT1  (sim_io.tcnt1)
+#define OCR1A  (sim_io.ocr1a)
+#define OCR1B  (sim_io.ocr1b)
+#define ICR1   (sim_io.icr1)
+#define TIMSK1 (sim_io.timsk1)
+#define TIFR1  (sim_io.tifr1)
+
+#define WGM11   1
+#define WGM10   0
+#define ICNC1   7
+#define ICES1   6
+#define WGM13   4
+#define WGM12   3
+#define CS12    2
+#define CS11    1
+#define CS10    0
+#define ICIE1   5
+#define OCIE1B  2
+#define OCIE1A  1
+#define TOIE1   0
+#define ICF1    5
+#define OCF1B   2
+#define OCF1A   1
+#define TOV1    0
+
+/* Timer/Counter 2 */
+#define TCCR2A (sim_io.tccr2a)
+#define TCCR2B (sim_io.tccr2b)
+#define TCNT2  (sim_io.tcnt2)
+#define OCR2A  (sim_io.ocr2a)
+#define OCR2B  (sim_io.ocr2b)
+#define TIMSK2 (sim_io.timsk2)
+#define TIFR2  (sim_io.tifr2)
+
+#define COM2A1  7
+#define COM2A0  6
+#define COM2B1  5
+#define COM2B0  4
+#define WGM21   1
+#define WGM20   0
+#define FOC2A   7
+#define FOC2B   6
+#define WGM22   3
+#define CS22    2
+#define CS21    1
+#define CS20    0
+#define OCIE2B  2
+#define OCIE2A  1
+#define TOIE2   0
+#define OCF2B   2
+#define OCF2A   1
+#define TOV2    0
+
+/* pin change and external interrupts */
+#define PCICR  (sim_io.pcicr)
+#define PCIFR  (sim_io.pcifr)
+#define PCMSK0 (sim_io.pcmsk0)
+#define PCMSK1 (sim_io.pcmsk1)
+#define PCMSK2 (sim_io.pcmsk2)
+#define EICRA  (sim_io.eicra)
+#define EIMSK  (sim_io.eimsk)
+#define EIFR   (sim_io.eifr)
+
+#define PCIE2   2
+#define PCIE1   1
+#define PCIE0   0
+#define PCIF2   2
+#define PCIF1   1
+#define PCIF0   0
+#define PCINT0   0
+#define PCINT1   1
+#define PCINT2   2
+#define PCINT3   3
+#define PCINT4   4
+#define PCINT5   5
+#define PCINT6   6
+#define PCINT7   7
+#define PCINT8   0
+#define PCINT9   1
+#define PCINT10  2
+#define PCINT11  3
+#define PCINT12  4
+#define PCINT13  5
+#define PCINT14  6
+#define PCINT16  0
+#define PCINT17  1
+#define PCINT18  2
+#define PCINT19  3
+#define PCINT20  4
+#define PCINT21  5
+#define PCINT22  6
+#define PCINT23  7
+#define INT1    1
+#define INT0    0
+#define ISC11   3
+#define ISC10   2
+#define ISC01   1
+#define ISC00   0
+
+/* system */
+#define SMCR   (sim_io.smcr)
+#define MCUCR  (sim_io.mcucr)
+#define PRR    (sim_io.prr)
+#define OSCCAL (sim_io.osccal)
+
+#define SM2     3
+#define SM1     2
+#define SM0     1
+#define SE      0
+
+#define PRTWI    7
+#define PRTIM2   6
+#define PRTIM0   5
+#define PRTIM1   3
+#define PRSPI    2
+#define PRUSART0 1
+#define PRADC    0
+
+#endif /* __SIM_AVR_IO_H__ */
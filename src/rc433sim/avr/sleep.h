@@ -0,0 +1,36 @@
+/*
+ * Copyright(C) 2021 Robinson (Bob) Mittman. All Rights Reserved.
+ * Licensed under the MIT license. 
+ * See LICENSE file in the project root for details.
+ *
+ */
+
+/* Host replacement for <avr/sleep.h>. sleep_cpu() hands the firmware
+   main context over to the simulator, which sleeps or powers the node
+   down in the mode set and returns after the interrupt that wakes it up,
+   see sim.h. */
+
+#ifndef __SIM_AVR_SLEEP_H__
+#define __SIM_AVR_SLEEP_H__
+
+#include <avr/io.h>
+
+#define SLEEP_MODE_IDLE         (0)
+#define SLEEP_MODE_ADC          _BV(SM0)
+#define SLEEP_MODE_PWR_DOWN     _BV(SM1)
+#define SLEEP_MODE_PWR_SAVE     (_BV(SM0) | _BV(SM1))
+#define SLEEP_MODE_STANDBY      (_BV(SM1) | _BV(SM2))
+#define SLEEP_MODE_EXT_STANDBY  (_BV(SM0) | _BV(SM1) | _BV(SM2))
+
+#define set_sleep_mode(mode) do { \
+	sim_io.smcr = (sim_io.smcr & ~(_BV(SM0) | _BV(SM1) | _BV(SM2))) | \
+		(mode); } while (0)
+
+#define sleep_enable() do { sim_io.smcr |= _BV(SE); } while (0)
+#define sleep_disable() do { sim_io.smcr &= ~_BV(SE); } while (0)
+#define sleep_cpu() do { \
+	if (sim_io.smcr & _BV(SE)) sim_io.sleep(sim_io.sleep_arg); } while (0)
+#define sleep_mode() do { sleep_enable(); sleep_cpu(); \
+	sleep_disable(); } while (0)
+
+#endif /* __SIM_AVR_SLEEP_H__ */
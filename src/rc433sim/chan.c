@@ -0,0 +1,178 @@
+/*
+ * Copyright(C) 2021 Robinson (Bob) Mittman. All Rights Reserved.
+ * Licensed under the MIT license.
+ * See LICENSE file in the project root for details.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chan.h"
+
+uint64_t chan_rand(struct chan * ch)
+{
+	uint64_t x = ch->rnd;
+
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	ch->rnd = x;
+
+	return x * 0x2545f4914f6cdd1dull;
+}
+
+double chan_uniform(struct chan * ch)
+{
+	return (chan_rand(ch) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+void chan_init(struct chan * ch, const struct chan_cfg * cfg, uint64_t seed)
+{
+	memset(ch, 0, sizeof(struct chan));
+	ch->cfg = *cfg;
+	ch->rnd = seed ? seed : 0x9e3779b97f4a7c15ull;
+}
+
+void chan_free(struct chan * ch)
+{
+	free(ch->smp);
+	ch->smp = NULL;
+	ch->len = 0;
+	ch->max = 0;
+}
+
+static void chan_grow(struct chan * ch, size_t len)
+{
+	if (len <= ch->max)
+		return;
+
+	ch->max = (len > 2 * ch->max) ? len : 2 * ch->max;
+	if ((ch->smp = realloc(ch->smp, ch->max)) == NULL) {
+		fprintf(stderr, "chan: out of memory\n");
+		exit(1);
+	}
+}
+
+/* one bit period on the line, after errors */
+static void chan_bit(struct chan * ch, uint8_t lvl)
+{
+	bool flip;
+
+	if (ch->burst_left) {
+		ch->burst_left--;
+		flip = (chan_rand(ch) >> 63) != 0;
+	} else {
+		flip = (ch->cfg.ber > 0) && (chan_uniform(ch) < ch->cfg.ber);
+		if ((ch->cfg.burst > 0) && (chan_uniform(ch) < ch->cfg.burst))
+			ch->burst_left = ch->cfg.burst_len;
+	}
+
+	if (flip) {
+		lvl ^= 1;
+		ch->flips++;
+	}
+	ch->bits++;
+
+	chan_grow(ch, ch->len + CHAN_OVS);
+	memset(&ch->smp[ch->len], lvl, CHAN_OVS);
+	ch->len += CHAN_OVS;
+}
+
+void chan_tx(struct chan * ch, uint8_t c, uint64_t t_start, uint64_t bit_ps)
+{
+	size_t pos;
+	int i;
+
+	if (ch->bit_ps == 0) {
+		ch->bit_ps = bit_ps;
+		ch->t0 = t_start;
+	}
+
+	/* idle line up to the start bit, in whole bit periods so the noise
+	   has the same density as on the characters */
+	pos = ((t_start - ch->t0) * CHAN_OVS + ch->bit_ps / 2) / ch->bit_ps;
+	while (ch->len + CHAN_OVS <= pos)
+		chan_bit(ch, 1);
+	if (ch->len < pos) {
+		chan_grow(ch, pos);
+		memset(&ch->smp[ch->len], 1, pos - ch->len);
+		ch->len = pos;
+	}
+
+	chan_bit(ch, 0);
+	for (i = 0; i < 8; i++)
+		chan_bit(ch, (c >> i) & 1);
+	chan_bit(ch, 1);
+
+	ch->chars++;
+}
+
+static void chan_deliver(struct chan * ch, chan_rx_t fn, void * arg,
+						 uint8_t c, bool fe)
+{
+	if ((ch->cfg.ins > 0) && (chan_uniform(ch) < ch->cfg.ins)) {
+		ch->inserted++;
+		fn(arg, chan_rand(ch) >> 56, false);
+	}
+
+	if ((ch->cfg.drop > 0) && (chan_uniform(ch) < ch->cfg.drop)) {
+		ch->dropped++;
+		return;
+	}
+
+	if (fe)
+		ch->fe++;
+
+	fn(arg, c, fe);
+}
+
+void chan_rx(struct chan * ch, chan_rx_t fn, void * arg)
+{
+	/* receiver bit period in line samples */
+	double rb = CHAN_OVS / (1.0 + ch->cfg.baud);
+	size_t i = 0;
+
+	while (i < ch->len) {
+		double t;
+		uint8_t c;
+		int b;
+
+		/* hunt for the start bit */
+		if (ch->smp[i]) {
+			i++;
+			continue;
+		}
+
+		/* start bit, mid bit check */
+		t = i + rb / 2;
+		if ((size_t)t >= ch->len)
+			break;
+		if (ch->smp[(size_t)t]) {
+			i++;
+			continue;
+		}
+
+		c = 0;
+		for (b = 0; b < 8; b++) {
+			t += rb;
+			if ((size_t)t >= ch->len)
+				goto done;
+			c |= ch->smp[(size_t)t] << b;
+		}
+
+		t += rb;
+		if ((size_t)t >= ch->len)
+			break;
+
+		chan_deliver(ch, fn, arg, c, ch->smp[(size_t)t] == 0);
+
+		/* look for the next start bit right after the stop bit sample */
+		i = (size_t)t + 1;
+	}
+
+done:
+	ch->len = 0;
+	ch->bit_ps = 0;
+}
@@ -0,0 +1,77 @@
+/*
+ * Copyright(C) 2021 Robinson (Bob) Mittman. All Rights Reserved.
+ * Licensed under the MIT license.
+ * See LICENSE file in the project root for details.
+ *
+ */
+
+/* Bit level model of the 433 MHz link between two USARTs.
+ *
+ * Characters from the transmitter are rendered into line samples
+ * (CHAN_OVS per transmitter bit, idle high between characters), bit
+ * errors are applied to the line, and a model of the receiving USART
+ * recovers characters from it at its own baud rate: start bit on the
+ * first low sample, data and stop bits sampled at mid bit. */
+
+#ifndef __CHAN_H__
+#define __CHAN_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define CHAN_OVS 16
+
+struct chan_cfg {
+	/* independent bit flip probability */
+	double ber;
+	/* probability of a burst starting at any bit */
+	double burst;
+	/* burst length in bits, each bit of a burst flips with p = 0.5 */
+	unsigned int burst_len;
+	/* probability of losing a received character */
+	double drop;
+	/* probability of a spurious character before a received one */
+	double ins;
+	/* receiver baud rate error, relative: 0.01 is 1% fast */
+	double baud;
+};
+
+struct chan {
+	struct chan_cfg cfg;
+	uint64_t rnd;
+	uint64_t bit_ps;
+	uint64_t t0;
+	unsigned int burst_left;
+	uint8_t * smp;
+	size_t len;
+	size_t max;
+	/* statistics */
+	uint64_t bits;
+	uint64_t flips;
+	uint32_t chars;
+	uint32_t fe;
+	uint32_t dropped;
+	uint32_t inserted;
+};
+
+typedef void (* chan_rx_t)(void * arg, uint8_t c, bool fe);
+
+void chan_init(struct chan * ch, const struct chan_cfg * cfg, uint64_t seed);
+
+void chan_free(struct chan * ch);
+
+/* Append a character sent at 't_start' with bit time 'bit_ps'. */
+void chan_tx(struct chan * ch, uint8_t c, uint64_t t_start, uint64_t bit_ps);
+
+/* Run the receiving USART over the line, 'fn' is called for every
+   character it recovers. The line is consumed. */
+void chan_rx(struct chan * ch, chan_rx_t fn, void * arg);
+
+/* xorshift64* */
+uint64_t chan_rand(struct chan * ch);
+
+/* uniform in [0, 1) */
+double chan_uniform(struct chan * ch);
+
+#endif /* __CHAN_H__ */
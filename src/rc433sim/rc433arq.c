@@ -0,0 +1,297 @@
+/*
+ * Copyright(C) 2021 Robinson (Bob) Mittman. All Rights Reserved.
+ * Licensed under the MIT license.
+ * See LICENSE file in the project root for details.
+ *
+ */
+
+/* Acknowledged mode (rc433_arq_send()) timing test.
+ *
+ * The transmitter (xmtr_link.so) sends a new command every -i ms with
+ * rc433_arq_send(). The receiver (snif_link.so) answers on its TXD,
+ * which is wired back to the transmitter RXD. Characters are lost with
+ * probability -f on the way out and -b on the way back, to make the
+ * transmitter time out and retry. Reported:
+ *
+ *   turnaround  end of the packet on the air to the end of its ACK
+ *   latency     rc433_arq_send() to the ACK
+ *   tries       transmissions per command
+ *   airtime     characters sent by the transmitter per command, against
+ *               120 for the blind 10 times repetition
+ *
+ * Without losses every command must be acknowledged at the first try. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "sim.h"
+#include "simnode.h"
+#include "chan.h"
+#include "rc433.h"
+
+#define TRIES_MAX 16
+
+/* ACK frame marker, as in rc433rx_uart.c */
+#define RF_ACK_SYM 0x07
+
+struct stat {
+	uint32_t cnt;
+	double min;
+	double max;
+	double sum;
+};
+
+struct arq {
+	struct sim_link tx;
+	struct sim_link rx;
+	struct chan rnd;
+	double fwd_loss;
+	double back_loss;
+	uint64_t itv;
+	uint32_t cmd_max;
+	/* command in progress */
+	uint32_t cmd;
+	bool busy;
+	uint8_t dat[4];
+	uint64_t t_send;
+	/* end of the last character sent by the transmitter */
+	uint64_t t_fwd;
+	/* characters of the ACK frame seen after the marker */
+	int ack_pos;
+	/* counters */
+	uint32_t sent;
+	uint32_t acked;
+	uint32_t failed;
+	uint32_t replaced;
+	uint32_t rcvd;
+	uint32_t bad;
+	uint32_t fwd_chars;
+	uint32_t tries[TRIES_MAX + 1];
+	struct stat turn;
+	struct stat lat;
+};
+
+static void stat_add(struct stat * st, double v)
+{
+	if ((st->cnt == 0) || (v < st->min))
+		st->min = v;
+	if ((st->cnt == 0) || (v > st->max))
+		st->max = v;
+	st->sum += v;
+	st->cnt++;
+}
+
+static void stat_print(const char * name, struct stat * st)
+{
+	printf("%-10s %8.2f %8.2f %8.2f ms (min avg max)\n", name,
+		   st->cnt ? st->min : 0.0, st->cnt ? st->sum / st->cnt : 0.0,
+		   st->cnt ? st->max : 0.0);
+}
+
+static void cmd_make(uint8_t dat[], uint32_t n)
+{
+	dat[0] = (n << 5) & RC433_SEQ_MSK;
+	dat[1] = n;
+	dat[2] = n >> 8;
+	dat[3] = n >> 16;
+}
+
+/* ---------------------------------------------------------------------
+ * Lines
+ * ---------------------------------------------------------------------
+ */
+
+static void fwd_line(void * arg, struct sim_node * node, uint8_t c,
+					 uint64_t t_start, uint64_t t_end)
+{
+	struct arq * a = arg;
+
+	(void)node;
+	(void)t_start;
+	a->fwd_chars++;
+	a->t_fwd = t_end;
+	if ((a->fwd_loss > 0) && (chan_uniform(&a->rnd) < a->fwd_loss))
+		return;
+	sim_usart_rx(a->rx.node, c, false);
+}
+
+static void back_line(void * arg, struct sim_node * node, uint8_t c,
+					  uint64_t t_start, uint64_t t_end)
+{
+	struct arq * a = arg;
+
+	(void)node;
+	(void)t_start;
+
+	/* the ACK turnaround is measured on the sending side, lost or not */
+	if (c == RF_ACK_SYM) {
+		a->ack_pos = 1;
+	} else if ((a->ack_pos > 0) && (++a->ack_pos == 3)) {
+		stat_add(&a->turn, (double)(t_end - a->t_fwd) / SIM_MS(1));
+		a->ack_pos = 0;
+	}
+
+	if ((a->back_loss > 0) && (chan_uniform(&a->rnd) < a->back_loss))
+		return;
+	sim_usart_rx(a->tx.node, c, false);
+}
+
+/* ---------------------------------------------------------------------
+ * Nodes
+ * ---------------------------------------------------------------------
+ */
+
+static void cmd_end(struct arq * a, int8_t res)
+{
+	uint8_t n = SIM_CALL(a->tx.node, a->tx.arq_tries());
+
+	a->tries[(n > TRIES_MAX) ? TRIES_MAX : n]++;
+	if (res == RC433_ARQ_ACK) {
+		a->acked++;
+		stat_add(&a->lat, (double)(sim_now() - a->t_send) / SIM_MS(1));
+	} else {
+		a->failed++;
+	}
+	a->busy = false;
+}
+
+static void tx_main(void * arg, struct sim_node * node)
+{
+	struct arq * a = arg;
+	int8_t res;
+
+	if (!a->busy)
+		return;
+
+	if ((res = SIM_CALL(node, a->tx.arq_status())) != RC433_ARQ_BUSY)
+		cmd_end(a, res);
+}
+
+static void tx_tick(void * arg, uintptr_t dat)
+{
+	struct arq * a = arg;
+
+	(void)dat;
+	cmd_make(a->dat, a->cmd);
+	if (SIM_CALL(a->tx.node, a->tx.arq_send(a->dat))) {
+		if (a->busy)
+			a->replaced++;
+		a->busy = true;
+		a->t_send = sim_now();
+		a->sent++;
+		a->cmd++;
+	}
+
+	if (a->cmd < a->cmd_max)
+		sim_at(sim_now() + a->itv, tx_tick, a, 0);
+}
+
+static void rx_main(void * arg, struct sim_node * node)
+{
+	struct arq * a = arg;
+	uint8_t dat[4];
+	uint8_t ref[4];
+
+	while (SIM_CALL(node, a->rx.pkt_recv(dat))) {
+		uint32_t n = dat[1] | ((uint32_t)dat[2] << 8) |
+			((uint32_t)dat[3] << 16);
+
+		cmd_make(ref, n);
+		if ((n >= a->cmd) || (memcmp(dat, ref, 4) != 0))
+			a->bad++;
+		else
+			a->rcvd++;
+	}
+}
+
+static void usage(const char * prog)
+{
+	fprintf(stderr, "usage: %s [options]\n", prog);
+	fprintf(stderr, "  -n cmds    commands to send (1000)\n");
+	fprintf(stderr, "  -i ms      interval between commands (200)\n");
+	fprintf(stderr, "  -f prob    character loss, transmitter to receiver "
+			"(0)\n");
+	fprintf(stderr, "  -b prob    character loss, receiver to transmitter "
+			"(0)\n");
+	fprintf(stderr, "  -s seed    random seed (1)\n");
+	exit(2);
+}
+
+int main(int argc, char * argv[])
+{
+	struct chan_cfg cfg;
+	struct arq a;
+	uint64_t seed = 1;
+	unsigned int i;
+	int c;
+
+	memset(&a, 0, sizeof(a));
+	a.cmd_max = 1000;
+	a.itv = SIM_MS(200);
+
+	while ((c = getopt(argc, argv, "n:i:f:b:s:h")) != -1) {
+		switch (c) {
+		case 'n':
+			a.cmd_max = strtoul(optarg, NULL, 0);
+			break;
+		case 'i':
+			a.itv = SIM_US(strtod(optarg, NULL) * 1000);
+			if (a.itv == 0)
+				usage(argv[0]);
+			break;
+		case 'f':
+			a.fwd_loss = strtod(optarg, NULL);
+			break;
+		case 'b':
+			a.back_loss = strtod(optarg, NULL);
+			break;
+		case 's':
+			seed = strtoull(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	memset(&cfg, 0, sizeof(cfg));
+	chan_init(&a.rnd, &cfg, seed);
+
+	sim_link_load(&a.tx, argv[0], "xmtr_link.so", "xmtr");
+	sim_link_load(&a.rx, argv[0], "snif_link.so", "snif");
+	if (a.tx.arq_send == NULL) {
+		fprintf(stderr, "transmitter built without RFLINK_ARQ\n");
+		return 1;
+	}
+
+	sim_line_set(a.tx.node, fwd_line, &a);
+	sim_line_set(a.rx.node, back_line, &a);
+	sim_node_main_set(a.tx.node, tx_main, &a);
+	sim_node_main_set(a.rx.node, rx_main, &a);
+
+	sim_link_init(&a.tx);
+	sim_link_init(&a.rx);
+
+	tx_tick(&a, 0);
+	sim_run(UINT64_MAX);
+
+	printf("commands:  %u sent, %u acknowledged, %u failed, %u replaced\n",
+		   a.sent, a.acked, a.failed, a.replaced);
+	printf("receiver:  %u delivered, %u bad\n", a.rcvd, a.bad);
+	stat_print("turnaround", &a.turn);
+	stat_print("latency", &a.lat);
+	printf("tries:    ");
+	for (i = 1; i <= TRIES_MAX; i++) {
+		if (a.tries[i])
+			printf(" %u:%u", i, a.tries[i]);
+	}
+	printf("\n");
+	printf("airtime:   %.1f characters per command (blind x10: 120)\n",
+		   a.sent ? (double)a.fwd_chars / a.sent : 0.0);
+
+	if ((a.fwd_loss == 0) && (a.back_loss == 0))
+		return ((a.acked == a.sent) && (a.tries[1] == a.sent)) ? 0 : 1;
+
+	return (a.bad == 0) ? 0 : 1;
+}
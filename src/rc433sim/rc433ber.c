@@ -0,0 +1,515 @@
+/*
+ * Copyright(C) 2021 Robinson (Bob) Mittman. All Rights Reserved.
+ * Licensed under the MIT license.
+ * See LICENSE file in the project root for details.
+ *
+ */
+
+/* Packet error benchmark of the 4b/8b line code and receive state
+ * machine over an impaired channel.
+ *
+ * For every point of the parameter sweep the transmitter firmware
+ * (xmtr_link.so) encodes a stream of random frames, the line is passed
+ * through the channel model in chan.c and the recovered characters are
+ * fed to the receiver firmware (snif_link.so). Reported per point:
+ *
+ *   PER   frames not delivered intact
+ *   FAR   frames delivered with content that was never sent, i.e.
+ *         corrupted frames that passed the CRC5
+ *   sync  lost frames the receiver did not report as CRC, symbol or
+ *         overrun errors: the preamble or SOF was not recognised
+ *   acq   preamble symbols the receiver saw per frame delivered, against
+ *         the length sent (-P)
+ *   FE    USART framing errors per frame
+ *   fix   symbols repaired by the receiver soft decoder per frame
+ *   fec   symbols corrected in FEC frames per frame (-F)
+ *
+ * Every point runs in its own process, so the firmware globals start
+ * clean, and up to one process per CPU runs at a time. With a single
+ * point, -w saves the characters recovered by the receiving USART, a
+ * raw capture for rc433cap. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/wait.h>
+
+#include "sim.h"
+#include "simnode.h"
+#include "chan.h"
+#include "rc433.h"
+
+#define LIST_MAX 32
+#define WINDOW 16
+
+struct list {
+	unsigned int cnt;
+	double val[LIST_MAX];
+};
+
+struct result {
+	uint32_t idx;
+	uint32_t sent;
+	uint32_t good;
+	uint32_t far;
+	uint32_t crc;
+	uint32_t sym;
+	uint32_t ovr;
+	uint32_t fix;
+	uint32_t fec;
+	/* preamble symbols seen, frames counted */
+	uint32_t acq;
+	uint32_t acq_n;
+	uint32_t chars;
+	uint32_t fe;
+	uint64_t bits;
+	uint64_t flips;
+};
+
+struct run {
+	struct sim_link tx;
+	struct sim_link rx;
+	struct chan ch;
+	uint64_t itv;
+	int8_t (* send)(uint8_t dat[]);
+	uint32_t frm_max;
+	uint32_t sent;
+	uint32_t next;
+	uint32_t good;
+	uint32_t far;
+	uint32_t * pay;
+	uint8_t * seen;
+	FILE * cap;
+};
+
+static void frm_get(struct run * r, uint8_t dat[], uint32_t n)
+{
+	uint32_t p = r->pay[n];
+
+	dat[0] = (p >> 24) & 0xe0;
+	dat[1] = p;
+	dat[2] = p >> 8;
+	dat[3] = p >> 16;
+}
+
+static void tx_send(struct run * r, struct sim_node * node)
+{
+	uint8_t dat[4];
+
+	while ((r->sent < r->frm_max) &&
+		   (SIM_CALL(node, r->tx.tx_pending()) < 2)) {
+		frm_get(r, dat, r->sent);
+		if (!SIM_CALL(node, r->send(dat)))
+			break;
+		r->sent++;
+		if (r->itv)
+			break;
+	}
+}
+
+static void tx_main(void * arg, struct sim_node * node)
+{
+	struct run * r = arg;
+
+	if (r->itv == 0)
+		tx_send(r, node);
+}
+
+static void tx_tick(void * arg, uintptr_t dat)
+{
+	struct run * r = arg;
+
+	(void)dat;
+	tx_send(r, r->tx.node);
+	if (r->sent < r->frm_max)
+		sim_at(sim_now() + r->itv, tx_tick, r, 0);
+}
+
+static void tx_line(void * arg, struct sim_node * node, uint8_t c,
+					uint64_t t_start, uint64_t t_end)
+{
+	struct run * r = arg;
+
+	(void)t_end;
+	chan_tx(&r->ch, c, t_start, sim_usart_bit_time(node));
+}
+
+static void rx_drain(struct run * r)
+{
+	struct sim_node * node = r->rx.node;
+	uint8_t dat[4];
+	uint8_t ref[4];
+
+	while (SIM_CALL(node, r->rx.pkt_recv(dat))) {
+		uint32_t n;
+		bool ok = false;
+
+		/* look for it from a few frames back on, the payloads are random
+		   so a match further on is the receiver picking up again after
+		   a run of lost frames */
+		for (n = (r->next > WINDOW) ? r->next - WINDOW : 0; n < r->sent; n++) {
+			frm_get(r, ref, n);
+			if (memcmp(dat, ref, 4) == 0) {
+				ok = true;
+				break;
+			}
+		}
+
+		if (!ok) {
+			r->far++;
+			continue;
+		}
+
+		if (!r->seen[n]) {
+			r->seen[n] = 1;
+			r->good++;
+		}
+		if (n >= r->next)
+			r->next = n + 1;
+	}
+}
+
+static void rx_char(void * arg, uint8_t c, bool fe)
+{
+	struct run * r = arg;
+
+	sim_usart_rx(r->rx.node, c, fe);
+	rx_drain(r);
+	if (r->cap != NULL)
+		fputc(c, r->cap);
+}
+
+static void point_run(const char * argv0, const char * rx_so, bool fec,
+					  const struct chan_cfg * cfg, unsigned int pre,
+					  uint32_t frames, uint64_t itv, uint64_t seed,
+					  const char * cap, struct result * res)
+{
+	struct rc433_rx_stat st;
+	struct run r;
+	uint32_t i;
+
+	memset(&r, 0, sizeof(r));
+	r.frm_max = frames;
+	r.itv = itv;
+	chan_init(&r.ch, cfg, seed);
+
+	r.pay = malloc(frames * sizeof(uint32_t));
+	r.seen = calloc(frames, 1);
+	for (i = 0; i < frames; i++)
+		r.pay[i] = chan_rand(&r.ch) >> 32;
+
+	sim_link_load(&r.tx, argv0, "xmtr_link.so", "xmtr");
+	sim_link_load(&r.rx, argv0, rx_so, "snif");
+
+	r.send = r.tx.pkt_send;
+	if (fec) {
+		if (r.tx.fec_send == NULL) {
+			fprintf(stderr, "transmitter built without RFLINK_FEC\n");
+			exit(1);
+		}
+		r.send = r.tx.fec_send;
+	}
+
+	sim_line_set(r.tx.node, tx_line, &r);
+	sim_node_main_set(r.tx.node, tx_main, &r);
+
+	sim_link_init(&r.tx);
+	sim_link_init(&r.rx);
+	SIM_CALL(r.tx.node, r.tx.preamble_set(pre));
+
+	if (r.itv)
+		tx_tick(&r, 0);
+	else
+		tx_main(&r, r.tx.node);
+	sim_run(UINT64_MAX);
+
+	if ((cap != NULL) && ((r.cap = fopen(cap, "wb")) == NULL)) {
+		perror(cap);
+		exit(1);
+	}
+
+	chan_rx(&r.ch, rx_char, &r);
+
+	if (r.cap != NULL)
+		fclose(r.cap);
+
+	SIM_CALL_VOID(r.rx.node, r.rx.rx_stat_get(&st));
+
+	res->sent = r.sent;
+	res->good = r.good;
+	res->far = r.far;
+	/* uncorrectable FEC frames count as CRC errors */
+	res->crc = st.err + st.unc;
+	res->sym = st.sym;
+	res->ovr = st.ovr;
+	res->fix = st.fix;
+	res->fec = st.fec;
+	for (i = 0; i < RC433_ACQ_LEN; i++) {
+		res->acq += (i + 1) * st.acq[i];
+		res->acq_n += st.acq[i];
+	}
+	res->chars = r.ch.chars;
+	res->fe = r.ch.fe;
+	res->bits = r.ch.bits;
+	res->flips = r.ch.flips;
+
+	chan_free(&r.ch);
+	free(r.pay);
+	free(r.seen);
+}
+
+static void list_parse(struct list * l, const char * s)
+{
+	char * end;
+
+	l->cnt = 0;
+	while (*s) {
+		if (l->cnt == LIST_MAX) {
+			fprintf(stderr, "too many values: %s\n", s);
+			exit(2);
+		}
+		l->val[l->cnt++] = strtod(s, &end);
+		if (end == s) {
+			fprintf(stderr, "invalid value: %s\n", s);
+			exit(2);
+		}
+		s = (*end == ',') ? end + 1 : end;
+	}
+}
+
+static void usage(const char * prog)
+{
+	fprintf(stderr, "usage: %s [options]\n", prog);
+	fprintf(stderr, "Every option takes a comma separated list, all the "
+			"combinations are run.\n");
+	fprintf(stderr, "  -b ber     bit flip probability (0,1e-4,3e-4,1e-3,"
+			"3e-3,1e-2)\n");
+	fprintf(stderr, "  -B rate    burst start probability per bit (0)\n");
+	fprintf(stderr, "  -L bits    burst length (16)\n");
+	fprintf(stderr, "  -D prob    received character drop probability (0)\n");
+	fprintf(stderr, "  -I prob    spurious character probability (0)\n");
+	fprintf(stderr, "  -m pct     receiver baud rate error in percent (0)\n");
+	fprintf(stderr, "  -P len     preamble length, %d..%d (%d)\n",
+			RC433_PRE_MIN, RC433_PRE_MAX, RC433_PRE_MAX);
+	fprintf(stderr, "  -n frames  frames per point (2000)\n");
+	fprintf(stderr, "  -i ms      send one frame every 'ms' instead of "
+			"back-to-back\n");
+	fprintf(stderr, "  -j jobs    parallel processes (number of CPUs)\n");
+	fprintf(stderr, "  -s seed    random seed (1)\n");
+	fprintf(stderr, "  -w file    save the received characters, single "
+			"point only\n");
+	fprintf(stderr, "  -F         send FEC frames (rc433_fec_send())\n");
+	fprintf(stderr, "  -R file    receiver build (snif_link.so), e.g. "
+			"snif_soft.so\n");
+	exit(2);
+}
+
+int main(int argc, char * argv[])
+{
+	struct list ber;
+	struct list burst;
+	struct list blen;
+	struct list drop;
+	struct list ins;
+	struct list baud;
+	struct list pre;
+	struct chan_cfg * pt;
+	unsigned int * pt_pre;
+	struct result * res;
+	uint32_t frames = 2000;
+	uint64_t itv = 0;
+	uint64_t seed = 1;
+	const char * rx_so = "snif_link.so";
+	const char * cap = NULL;
+	bool fec = false;
+	unsigned int npt;
+	unsigned int next;
+	unsigned int done;
+	unsigned int running;
+	long jobs;
+	int fd[2];
+	int status;
+	unsigned int i;
+	int c;
+
+	list_parse(&ber, "0,1e-4,3e-4,1e-3,3e-3,1e-2");
+	list_parse(&burst, "0");
+	list_parse(&blen, "16");
+	list_parse(&drop, "0");
+	list_parse(&ins, "0");
+	list_parse(&baud, "0");
+	list_parse(&pre, "4");
+	jobs = sysconf(_SC_NPROCESSORS_ONLN);
+
+	while ((c = getopt(argc, argv, "b:B:L:D:I:m:P:n:i:j:s:R:w:Fh")) != -1) {
+		switch (c) {
+		case 'b':
+			list_parse(&ber, optarg);
+			break;
+		case 'B':
+			list_parse(&burst, optarg);
+			break;
+		case 'L':
+			list_parse(&blen, optarg);
+			break;
+		case 'D':
+			list_parse(&drop, optarg);
+			break;
+		case 'I':
+			list_parse(&ins, optarg);
+			break;
+		case 'm':
+			list_parse(&baud, optarg);
+			break;
+		case 'P':
+			list_parse(&pre, optarg);
+			for (i = 0; i < pre.cnt; i++) {
+				if ((pre.val[i] < RC433_PRE_MIN) ||
+					(pre.val[i] > RC433_PRE_MAX))
+					usage(argv[0]);
+			}
+			break;
+		case 'n':
+			frames = strtoul(optarg, NULL, 0);
+			break;
+		case 'i':
+			itv = SIM_US(strtod(optarg, NULL) * 1000);
+			break;
+		case 'j':
+			jobs = strtol(optarg, NULL, 0);
+			break;
+		case 's':
+			seed = strtoull(optarg, NULL, 0);
+			break;
+		case 'F':
+			fec = true;
+			break;
+		case 'R':
+			rx_so = optarg;
+			break;
+		case 'w':
+			cap = optarg;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (jobs < 1)
+		jobs = 1;
+
+	npt = ber.cnt * burst.cnt * blen.cnt * drop.cnt * ins.cnt * baud.cnt *
+		pre.cnt;
+	if ((cap != NULL) && (npt != 1)) {
+		fprintf(stderr, "-w needs a single point\n");
+		return 1;
+	}
+
+	pt = calloc(npt, sizeof(struct chan_cfg));
+	pt_pre = calloc(npt, sizeof(unsigned int));
+	res = calloc(npt, sizeof(struct result));
+
+	for (i = 0; i < npt; i++) {
+		unsigned int k = i;
+
+		pt[i].baud = baud.val[k % baud.cnt] / 100;
+		k /= baud.cnt;
+		pt[i].ins = ins.val[k % ins.cnt];
+		k /= ins.cnt;
+		pt[i].drop = drop.val[k % drop.cnt];
+		k /= drop.cnt;
+		pt[i].burst_len = blen.val[k % blen.cnt];
+		k /= blen.cnt;
+		pt[i].burst = burst.val[k % burst.cnt];
+		k /= burst.cnt;
+		pt[i].ber = ber.val[k % ber.cnt];
+		k /= ber.cnt;
+		pt_pre[i] = pre.val[k % pre.cnt];
+	}
+
+	if (pipe(fd) < 0) {
+		perror("pipe");
+		return 1;
+	}
+
+	next = 0;
+	done = 0;
+	running = 0;
+	while (done < npt) {
+		struct result r;
+
+		if ((next < npt) && (running < jobs)) {
+			pid_t pid = fork();
+
+			if (pid < 0) {
+				perror("fork");
+				return 1;
+			}
+
+			if (pid == 0) {
+				close(fd[0]);
+				memset(&r, 0, sizeof(r));
+				r.idx = next;
+				point_run(argv[0], rx_so, fec, &pt[next], pt_pre[next],
+						  frames, itv, seed * 0x100000001b3ull + next, cap,
+						  &r);
+				/* smaller than PIPE_BUF: written atomically */
+				if (write(fd[1], &r, sizeof(r)) != sizeof(r))
+					_exit(1);
+				_exit(0);
+			}
+
+			next++;
+			running++;
+			continue;
+		}
+
+		/* a worker that exited cleanly has written its result */
+		if (wait(&status) < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("wait");
+			return 1;
+		}
+
+		if (!WIFEXITED(status) || (WEXITSTATUS(status) != 0) ||
+			(read(fd[0], &r, sizeof(r)) != sizeof(r))) {
+			fprintf(stderr, "worker failed\n");
+			return 1;
+		}
+
+		res[r.idx] = r;
+		running--;
+		done++;
+	}
+
+	printf("%-3s %-8s %-8s %4s %-8s %-8s %6s %6s %9s %9s %9s %5s %7s %7s "
+		   "%7s\n",
+		   "pre", "ber", "burst", "len", "drop", "ins", "baud%", "frames",
+		   "PER", "FAR", "sync", "acq", "FE/frm", "fix/frm",
+		   "fec/frm");
+
+	for (i = 0; i < npt; i++) {
+		struct result * r = &res[i];
+		uint32_t lost = r->sent - r->good;
+		uint32_t known = r->crc + r->sym + r->ovr;
+		uint32_t sync = (lost > known) ? lost - known : 0;
+		double n = r->sent ? r->sent : 1;
+
+		printf("%-3u %-8.2g %-8.2g %4u %-8.2g %-8.2g %6.2f %6u %9.3e %9.3e "
+			   "%9.3e %5.2f %7.3f %7.3f %7.3f\n",
+			   pt_pre[i], pt[i].ber, pt[i].burst, pt[i].burst_len,
+			   pt[i].drop, pt[i].ins, pt[i].baud * 100, r->sent, lost / n,
+			   r->far / n, sync / n,
+			   r->acq_n ? (double)r->acq / r->acq_n : 0.0, r->fe / n,
+			   r->fix / n, r->fec / n);
+	}
+
+	free(pt);
+	free(pt_pre);
+	free(res);
+
+	return 0;
+}
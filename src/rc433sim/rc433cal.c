@@ -0,0 +1,415 @@
+/*
+ * Copyright(C) 2021 Robinson (Bob) Mittman. All Rights Reserved.
+ * Licensed under the MIT license.
+ * See LICENSE file in the project root for details.
+ *
+ */
+
+/* Receiver clock calibration test.
+ *
+ * Replays the edges of a line capture on the RXD pin of the receiver
+ * firmware (snif_link.so), whose clock starts off by -m percent and
+ * drifts by -d ppm per second. The same edges go through a model of the
+ * receiving USART clocked from the receiver, so the framing errors and
+ * lost frames follow the calibration as it converges.
+ *
+ * The capture is either recorded (-r), one "time,level" line per edge
+ * with the time in seconds, as exported by most logic analyzers, or made
+ * by running the transmitter firmware (xmtr_link.so), optionally saved
+ * with -w. -a shifts the rising edges of the replay by some us, the
+ * duty cycle distortion of an OOK receiver slicer: the low pulses are
+ * that much longer and the high ones that much shorter, the bit rate is
+ * the same. Every -p ms a line shows the true receiver clock error, the
+ * error measured by the firmware, OSCCAL and the counters. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "sim.h"
+#include "simnode.h"
+#include "rc433.h"
+
+struct edge {
+	uint64_t t;
+	uint8_t lvl;
+};
+
+struct cal {
+	struct sim_link tx;
+	struct sim_link rx;
+	/* line capture */
+	struct edge * edge;
+	uint32_t cnt;
+	uint32_t max;
+	uint8_t lvl;
+	/* replay, rising edges late by 'skew' */
+	uint64_t t_base;
+	int64_t skew;
+	uint64_t t_end;
+	int32_t ppm;
+	int32_t tx_ppm;
+	double drift;
+	uint64_t period;
+	/* receiving USART model */
+	bool busy;
+	uint64_t t_start;
+	uint64_t bit;
+	uint32_t pos;
+	/* counters */
+	uint32_t frm_max;
+	uint32_t sent;
+	uint32_t rcvd;
+	uint32_t chars;
+	uint32_t fe;
+};
+
+static void edge_add(struct cal * c, uint64_t t, uint8_t lvl)
+{
+	if (lvl == c->lvl)
+		return;
+	c->lvl = lvl;
+
+	if (c->cnt == c->max) {
+		c->max = c->max ? 2 * c->max : 1024;
+		c->edge = realloc(c->edge, c->max * sizeof(struct edge));
+		if (c->edge == NULL) {
+			fprintf(stderr, "out of memory\n");
+			exit(1);
+		}
+	}
+
+	c->edge[c->cnt].t = t;
+	c->edge[c->cnt].lvl = lvl;
+	c->cnt++;
+}
+
+/* time of edge 'i' in the replay */
+static uint64_t edge_time(struct cal * c, uint32_t i)
+{
+	int64_t t = (int64_t)c->edge[i].t;
+
+	if (c->edge[i].lvl)
+		t += c->skew;
+
+	return (t < 0) ? 0 : (uint64_t)t;
+}
+
+/* line level at time 't' of the replay, 'pos' is the index of an edge
+   at or before 't' */
+static uint8_t edge_level(struct cal * c, uint32_t pos, uint64_t t)
+{
+	uint8_t lvl = c->edge[pos].lvl;
+	uint32_t i;
+
+	for (i = pos + 1; (i < c->cnt) && (edge_time(c, i) <= t); i++)
+		lvl = c->edge[i].lvl;
+
+	return lvl;
+}
+
+/* ---------------------------------------------------------------------
+ * Capture from the transmitter firmware
+ * ---------------------------------------------------------------------
+ */
+
+static void tx_line(void * arg, struct sim_node * node, uint8_t ch,
+					uint64_t t_start, uint64_t t_end)
+{
+	struct cal * c = arg;
+	uint64_t bit = sim_usart_bit_time(node);
+	int i;
+
+	(void)t_end;
+	edge_add(c, t_start, 0);
+	for (i = 0; i < 8; i++)
+		edge_add(c, t_start + (i + 1) * bit, (ch >> i) & 1);
+	edge_add(c, t_start + 9 * bit, 1);
+}
+
+static void tx_main(void * arg, struct sim_node * node)
+{
+	struct cal * c = arg;
+	uint8_t dat[4];
+
+	while ((c->sent < c->frm_max) &&
+		   (SIM_CALL(node, c->tx.tx_pending()) < 2)) {
+		dat[0] = (c->sent << 5) & 0xe0;
+		dat[1] = c->sent;
+		dat[2] = c->sent >> 8;
+		dat[3] = c->sent >> 16;
+		if (!SIM_CALL(node, c->tx.pkt_send(dat)))
+			break;
+		c->sent++;
+	}
+}
+
+static void capture_make(struct cal * c, const char * argv0, int32_t ppm)
+{
+	sim_link_load(&c->tx, argv0, "xmtr_link.so", "xmtr");
+	sim_node_clk_ppm_set(c->tx.node, ppm);
+	sim_line_set(c->tx.node, tx_line, c);
+	sim_node_main_set(c->tx.node, tx_main, c);
+	sim_link_init(&c->tx);
+	tx_main(c, c->tx.node);
+	sim_run(UINT64_MAX);
+}
+
+static void capture_read(struct cal * c, const char * path)
+{
+	char buf[128];
+	FILE * f;
+
+	if ((f = fopen(path, "r")) == NULL) {
+		perror(path);
+		exit(1);
+	}
+
+	/* header and comment lines do not parse and are skipped */
+	while (fgets(buf, sizeof(buf), f) != NULL) {
+		double t;
+		int lvl;
+
+		if (sscanf(buf, "%lf%*[ ,\t]%d", &t, &lvl) != 2)
+			continue;
+		if ((t < 0) || ((c->cnt > 0) &&
+			((uint64_t)(t * SIM_PS_PER_S) < c->edge[c->cnt - 1].t))) {
+			fprintf(stderr, "%s: time going backwards: %s", path, buf);
+			exit(1);
+		}
+		edge_add(c, (uint64_t)(t * SIM_PS_PER_S + 0.5), lvl != 0);
+	}
+
+	fclose(f);
+}
+
+static void capture_write(struct cal * c, const char * path)
+{
+	FILE * f;
+	uint32_t i;
+
+	if ((f = fopen(path, "w")) == NULL) {
+		perror(path);
+		exit(1);
+	}
+
+	fprintf(f, "Time [s],RXD\n");
+	for (i = 0; i < c->cnt; i++)
+		fprintf(f, "%.9f,%d\n", (double)c->edge[i].t / SIM_PS_PER_S,
+				c->edge[i].lvl);
+
+	fclose(f);
+}
+
+/* ---------------------------------------------------------------------
+ * Replay into the receiver
+ * ---------------------------------------------------------------------
+ */
+
+static void rx_main(void * arg, struct sim_node * node)
+{
+	struct cal * c = arg;
+	uint8_t dat[4];
+
+	while (SIM_CALL(node, c->rx.pkt_recv(dat)))
+		c->rcvd++;
+}
+
+/* stop bit sample of the USART model */
+static void uart_stop(void * arg, uintptr_t dat)
+{
+	struct cal * c = arg;
+	uint64_t t = c->t_start + c->bit / 2;
+	uint8_t ch = 0;
+	bool fe;
+	int i;
+
+	(void)dat;
+	for (i = 0; i < 8; i++) {
+		t += c->bit;
+		ch |= edge_level(c, c->pos, t - c->t_base) << i;
+	}
+	t += c->bit;
+	fe = edge_level(c, c->pos, t - c->t_base) == 0;
+
+	c->busy = false;
+	c->chars++;
+	if (fe)
+		c->fe++;
+	sim_usart_rx(c->rx.node, ch, fe);
+}
+
+static void edge_event(void * arg, uintptr_t dat)
+{
+	struct cal * c = arg;
+	struct edge * e = &c->edge[dat];
+
+	sim_pin_set(c->rx.node, 'D', 0, e->lvl);
+
+	if ((e->lvl == 0) && !c->busy) {
+		/* start bit, the receiver samples with its own bit time */
+		c->busy = true;
+		c->t_start = sim_now();
+		c->pos = dat;
+		c->bit = sim_usart_bit_time(c->rx.node);
+		sim_at(c->t_start + c->bit / 2 + 9 * c->bit, uart_stop, c, 0);
+	}
+
+	if (dat + 1 < c->cnt)
+		sim_at(c->t_base + edge_time(c, dat + 1), edge_event, c, dat + 1);
+}
+
+static void report(struct cal * c)
+{
+	struct rc433_rx_stat st;
+
+	SIM_CALL_VOID(c->rx.node, c->rx.rx_stat_get(&st));
+
+	printf("%8.1f %+9.0f %+9ld  0x%02x %5u %7u %7u %7u\n",
+		   (double)(sim_now() - c->t_base) / SIM_MS(1),
+		   /* receiver clock error relative to the transmitter */
+		   (double)(sim_node_clk_ppm(c->rx.node) - c->tx_ppm),
+		   (long)st.clk_ppm,
+		   sim_node_io(c->rx.node)->osccal, st.cal,
+		   c->chars, c->fe, c->rcvd);
+}
+
+static void tick(void * arg, uintptr_t dat)
+{
+	struct cal * c = arg;
+	double s = (double)(sim_now() - c->t_base) / SIM_PS_PER_S;
+
+	(void)dat;
+	/* temperature drift of the RC oscillator */
+	if (c->drift != 0)
+		sim_node_clk_ppm_set(c->rx.node, c->ppm + (int32_t)(c->drift * s));
+
+	report(c);
+
+	if (sim_now() + c->period <= c->t_end)
+		sim_at(sim_now() + c->period, tick, c, 0);
+}
+
+static void usage(const char * prog)
+{
+	fprintf(stderr, "usage: %s [options]\n", prog);
+	fprintf(stderr, "  -r file    replay recorded edges, \"time,level\" "
+			"lines, time in s\n");
+	fprintf(stderr, "  -w file    save the edges of the transmitter run\n");
+	fprintf(stderr, "  -n frames  frames sent by the transmitter (400)\n");
+	fprintf(stderr, "  -t pct     transmitter clock error in percent (0)\n");
+	fprintf(stderr, "  -m pct     receiver clock error in percent (4)\n");
+	fprintf(stderr, "  -d ppm     receiver clock drift, ppm per second (0)\n");
+	fprintf(stderr, "  -a us      rising edges late by 'us', early if "
+			"negative (0)\n");
+	fprintf(stderr, "  -p ms      report period (500)\n");
+	exit(2);
+}
+
+int main(int argc, char * argv[])
+{
+	struct cal c;
+	struct rc433_rx_stat st;
+	const char * rd = NULL;
+	const char * wr = NULL;
+	double tx_pct = 0;
+	bool tx_known = false;
+	double rx_pct = 4;
+	int32_t end_ppm;
+	int opt;
+
+	memset(&c, 0, sizeof(c));
+	c.lvl = 1;
+	c.frm_max = 400;
+	c.period = SIM_MS(500);
+
+	while ((opt = getopt(argc, argv, "r:w:n:t:m:d:a:p:h")) != -1) {
+		switch (opt) {
+		case 'r':
+			rd = optarg;
+			break;
+		case 'w':
+			wr = optarg;
+			break;
+		case 'n':
+			c.frm_max = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			tx_pct = strtod(optarg, NULL);
+			tx_known = true;
+			break;
+		case 'm':
+			rx_pct = strtod(optarg, NULL);
+			break;
+		case 'd':
+			c.drift = strtod(optarg, NULL);
+			break;
+		case 'a':
+			c.skew = (int64_t)(strtod(optarg, NULL) * SIM_US(1));
+			break;
+		case 'p':
+			c.period = SIM_US(strtod(optarg, NULL) * 1000);
+			if (c.period == 0)
+				usage(argv[0]);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	/* a recorded capture is taken as the nominal rate, use -t if the
+	   transmitter clock error is known */
+	c.tx_ppm = (int32_t)(tx_pct * 10000);
+	if (rd)
+		capture_read(&c, rd);
+	else
+		capture_make(&c, argv[0], c.tx_ppm);
+
+	if (wr)
+		capture_write(&c, wr);
+
+	if (c.cnt == 0) {
+		fprintf(stderr, "no edges\n");
+		return 1;
+	}
+
+	c.ppm = (int32_t)(rx_pct * 10000);
+	sim_link_load(&c.rx, argv[0], "snif_link.so", "snif");
+	if (c.rx.rx_stat_get == NULL) {
+		fprintf(stderr, "receiver built without rc433_rx_stat_get()\n");
+		return 1;
+	}
+	sim_node_clk_ppm_set(c.rx.node, c.ppm);
+	sim_node_main_set(c.rx.node, rx_main, &c);
+	/* idle line */
+	sim_pin_set(c.rx.node, 'D', 0, 1);
+	sim_link_init(&c.rx);
+
+	/* capture times are relative to the start of the replay */
+	c.t_base = sim_now() + SIM_MS(1);
+	c.t_end = c.t_base + edge_time(&c, c.cnt - 1) + SIM_MS(10);
+	sim_at(c.t_base + edge_time(&c, 0), edge_event, &c, 0);
+	sim_at(c.t_base, tick, &c, 0);
+
+	printf("    t/ms   clk/ppm  meas/ppm  osc   cal   chars      FE  frames\n");
+	sim_run(c.t_end);
+	report(&c);
+
+	SIM_CALL_VOID(c.rx.node, c.rx.rx_stat_get(&st));
+	end_ppm = sim_node_clk_ppm(c.rx.node) - c.tx_ppm;
+	if (!rd)
+		printf("frames:   %u sent, %u received\n", c.sent, c.rcvd);
+	printf("clock:    %+.2f%% at start, %+.2f%% at end (%+.2f%% measured), "
+		   "%u OSCCAL steps\n", (c.ppm - c.tx_ppm) / 1e4, end_ppm / 1e4,
+		   st.clk_ppm / 1e4, st.cal);
+
+	/* unless given with -t, the clock error of a recorded transmitter is
+	   not known, go by the firmware measurement */
+	if (rd && !tx_known)
+		end_ppm = st.clk_ppm;
+
+	/* converged within two OSCCAL steps of the transmitter */
+	return ((end_ppm < 2 * SIM_OSCCAL_PPM) &&
+			(end_ppm > -2 * SIM_OSCCAL_PPM)) ? 0 : 1;
+}
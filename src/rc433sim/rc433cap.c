@@ -0,0 +1,1089 @@
+/*
+ * Copyright(C) 2021 Robinson (Bob) Mittman. All Rights Reserved.
+ * Licensed under the MIT license.
+ * See LICENSE file in the project root for details.
+ *
+ */
+
+/* Offline analyzer of raw link captures.
+ *
+ * The capture is the byte stream a USB-UART at 4800 baud records on the
+ * receiver data pin, or the one rc433ber saves with -w. It is mapped in
+ * memory and run through the receive state machine of rc433rx_uart.c
+ * (sync, SOF and frame markers, 4b/8b symbols, CRC5, RS(12,8) and
+ * CRC-16 checks, duplicate suppression) to count the frames and errors,
+ * and with -l to list them, one line each:
+ *
+ *   offset  type  payload
+ *
+ * offset is the capture offset of the first symbol after the preamble,
+ * type one of pkt, arq (packet asking for an ACK), fec, var, dup
+ * (suppressed copy), crc, sym (invalid symbol) and unc (uncorrectable
+ * FEC frame).
+ *
+ * The capture is split in one chunk per thread (-j). Each chunk decoder
+ * starts WARM_LEN bytes ahead of its chunk, longer than any frame, so it
+ * is locked on the line when the chunk starts, and owns the frames and
+ * errors that end inside the chunk. The only state older than that, the
+ * last packet delivered for duplicate suppression, is carried across
+ * the chunks when they are merged. -x feeds the capture to the receiver
+ * firmware as well (snif_mon.so, built without ACKs, or -R) and checks
+ * that both count the same.
+ *
+ * The line bytes go through decode_lut[] with the vector decoder of
+ * symdec.c, a window at a time, and the noise between the frames, where
+ * the state machine is idle, is skipped with a vector search for the
+ * next sync symbol. -B times both against the byte by byte table walk
+ * and checks that the results are identical. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "sim.h"
+#include "simnode.h"
+#include "rc433.h"
+#include "symdec.h"
+
+#define PKT_LEN 4
+#define FEC_LEN 2
+/* largest RFLINK_FRM_MAX the receiver accepts */
+#define FRM_LIM 64
+
+/* longer than any frame and its preamble */
+#define WARM_LEN 1024
+/* smallest chunk worth a thread */
+#define CHUNK_MIN (64 * 1024)
+/* bytes decoded at a time in a frame */
+#define WIN_LEN 64
+
+/* decode_lut[] symbols of rc433rx_uart.c */
+#define RF_VAR_MARK 0x10
+#define RF_FEC_MARK 0x14
+#define RF_ARQ_MARK 0x15
+#define RF_SYM_FIX 0x20
+
+#define RF_IDLE 0
+#define RF_SYNC 1
+#define RF_SOF  2
+#define RF_EOF (RF_SOF + 2 * PKT_LEN)
+#define RF_FEC_SOF (RF_EOF + 1)
+#define RF_FEC_EOF (RF_FEC_SOF + 2 * (PKT_LEN + FEC_LEN))
+#define RF_VAR_SOF (RF_FEC_EOF + 1)
+
+#define TYP_PKT 0
+#define TYP_ARQ 1
+#define TYP_FEC 2
+#define TYP_VAR 3
+#define TYP_DUP 4
+#define TYP_CRC 5
+#define TYP_SYM 6
+#define TYP_UNC 7
+
+static const char * const typ_name[] = {
+	"pkt", "arq", "fec", "var", "dup", "crc", "sym", "unc"
+};
+
+/* the tables of rc433tx_uart.c and rc433rx_uart.c */
+static const uint8_t crc5lut[256] = {
+	0x00, 0x0e, 0x1c, 0x12, 0x11, 0x1f, 0x0d, 0x03,
+	0x0b, 0x05, 0x17, 0x19, 0x1a, 0x14, 0x06, 0x08,
+	0x16, 0x18, 0x0a, 0x04, 0x07, 0x09, 0x1b, 0x15,
+	0x1d, 0x13, 0x01, 0x0f, 0x0c, 0x02, 0x10, 0x1e,
+	0x05, 0x0b, 0x19, 0x17, 0x14, 0x1a, 0x08, 0x06,
+	0x0e, 0x00, 0x12, 0x1c, 0x1f, 0x11, 0x03, 0x0d,
+	0x13, 0x1d, 0x0f, 0x01, 0x02, 0x0c, 0x1e, 0x10,
+	0x18, 0x16, 0x04, 0x0a, 0x09, 0x07, 0x15, 0x1b,
+	0x0a, 0x04, 0x16, 0x18, 0x1b, 0x15, 0x07, 0x09,
+	0x01, 0x0f, 0x1d, 0x13, 0x10, 0x1e, 0x0c, 0x02,
+	0x1c, 0x12, 0x00, 0x0e, 0x0d, 0x03, 0x11, 0x1f,
+	0x17, 0x19, 0x0b, 0x05, 0x06, 0x08, 0x1a, 0x14,
+	0x0f, 0x01, 0x13, 0x1d, 0x1e, 0x10, 0x02, 0x0c,
+	0x04, 0x0a, 0x18, 0x16, 0x15, 0x1b, 0x09, 0x07,
+	0x19, 0x17, 0x05, 0x0b, 0x08, 0x06, 0x14, 0x1a,
+	0x12, 0x1c, 0x0e, 0x00, 0x03, 0x0d, 0x1f, 0x11,
+	0x14, 0x1a, 0x08, 0x06, 0x05, 0x0b, 0x19, 0x17,
+	0x1f, 0x11, 0x03, 0x0d, 0x0e, 0x00, 0x12, 0x1c,
+	0x02, 0x0c, 0x1e, 0x10, 0x13, 0x1d, 0x0f, 0x01,
+	0x09, 0x07, 0x15, 0x1b, 0x18, 0x16, 0x04, 0x0a,
+	0x11, 0x1f, 0x0d, 0x03, 0x00, 0x0e, 0x1c, 0x12,
+	0x1a, 0x14, 0x06, 0x08, 0x0b, 0x05, 0x17, 0x19,
+	0x07, 0x09, 0x1b, 0x15, 0x16, 0x18, 0x0a, 0x04,
+	0x0c, 0x02, 0x10, 0x1e, 0x1d, 0x13, 0x01, 0x0f,
+	0x1e, 0x10, 0x02, 0x0c, 0x0f, 0x01, 0x13, 0x1d,
+	0x15, 0x1b, 0x09, 0x07, 0x04, 0x0a, 0x18, 0x16,
+	0x08, 0x06, 0x14, 0x1a, 0x19, 0x17, 0x05, 0x0b,
+	0x03, 0x0d, 0x1f, 0x11, 0x12, 0x1c, 0x0e, 0x00,
+	0x1b, 0x15, 0x07, 0x09, 0x0a, 0x04, 0x16, 0x18,
+	0x10, 0x1e, 0x0c, 0x02, 0x01, 0x0f, 0x1d, 0x13,
+	0x0d, 0x03, 0x11, 0x1f, 0x1c, 0x12, 0x00, 0x0e,
+	0x06, 0x08, 0x1a, 0x14, 0x17, 0x19, 0x0b, 0x05
+};
+
+static const uint8_t encode_lut[16] = {
+	0x66, 0x56, 0xa6, 0x6a, 0x96, 0x36, 0x5a, 0xaa, 0x9a, 0xb2, 0x4d,
+	0x65, 0x4b, 0x55, 0xa5, 0x2d };
+
+/* line code and decode_lut[] value of the sync symbols and markers */
+static const uint8_t mark_lut[][2] = {
+	{ 0xc0, RF_VAR_MARK }, { 0xe0, 0x11 }, { 0xf0, 0x12 }, { 0xf8, 0x13 },
+	{ 0xfc, RF_FEC_MARK }, { 0x1f, RF_ARQ_MARK }
+};
+
+#define MARK_CNT (sizeof(mark_lut) / sizeof(mark_lut[0]))
+
+static const uint16_t crc16lut[16] = {
+	0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7,
+	0x8108, 0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef
+};
+
+static const uint8_t gf16_exp[30] = {
+	0x01, 0x02, 0x04, 0x08, 0x03, 0x06, 0x0c, 0x0b,
+	0x05, 0x0a, 0x07, 0x0e, 0x0f, 0x0d, 0x09, 0x01,
+	0x02, 0x04, 0x08, 0x03, 0x06, 0x0c, 0x0b, 0x05,
+	0x0a, 0x07, 0x0e, 0x0f, 0x0d, 0x09
+};
+
+static const uint8_t gf16_log[16] = {
+	0x00, 0x00, 0x01, 0x04, 0x02, 0x08, 0x05, 0x0a,
+	0x03, 0x0e, 0x09, 0x07, 0x06, 0x0d, 0x0b, 0x0c
+};
+
+/* decode_lut[] of rc433rx_uart.c, hard or soft (RFLINK_RX_SOFT_DECODE) */
+static uint8_t decode_lut[256];
+static struct symdec sd;
+
+static unsigned int frm_max = RFLINK_FRM_MAX;
+static bool listing;
+
+struct cnt {
+	uint64_t frm[TYP_UNC + 1];
+	/* symbols repaired by the soft decoder and the RS decoder */
+	uint64_t fix;
+	uint64_t fec;
+	uint64_t acq[RC433_ACQ_LEN];
+};
+
+/* USART_RX_vect state, rx in rc433rx_uart.c */
+struct dec {
+	uint8_t state;
+	uint8_t crc;
+	uint8_t nsync;
+	uint8_t ack;
+	uint8_t nera;
+	uint8_t end;
+	uint16_t crc16;
+	/* frame being received, the ring slot */
+	uint8_t typ;
+	uint8_t len;
+	uint16_t era;
+	uint64_t off;
+	uint8_t dat[FRM_LIM];
+	/* last packet delivered */
+	bool copies;
+	uint8_t last[PKT_LEN];
+};
+
+struct chunk {
+	const uint8_t * base;
+	/* decoded from 'warm', counted from 'start' to 'end' */
+	uint64_t warm;
+	uint64_t start;
+	uint64_t end;
+	struct cnt cnt;
+	FILE * out;
+	/* first packet delivered with no packet before it, possibly a copy
+	   of the last one of the chunks before */
+	bool first;
+	uint8_t first_typ;
+	uint8_t first_dat[PKT_LEN];
+	long first_pos;
+	/* last packet delivered, warm-up included */
+	bool last_ok;
+	uint8_t last[PKT_LEN];
+	pthread_t th;
+};
+
+static void decode_init(bool soft)
+{
+	unsigned int b;
+	unsigned int i;
+
+	memset(decode_lut, 0xff, sizeof(decode_lut));
+	for (i = 0; i < 16; i++)
+		decode_lut[encode_lut[i]] = i;
+	for (i = 0; i < MARK_CNT; i++)
+		decode_lut[mark_lut[i][0]] = mark_lut[i][1];
+
+	if (!soft)
+		return;
+
+	/* one bit away from exactly one data codeword and from no marker */
+	for (b = 0; b < 256; b++) {
+		int nib = -1;
+		int n = 0;
+
+		if (decode_lut[b] != 0xff)
+			continue;
+
+		for (i = 0; i < 16; i++) {
+			if (__builtin_popcount(b ^ encode_lut[i]) == 1) {
+				nib = i;
+				n++;
+			}
+		}
+		for (i = 0; i < MARK_CNT; i++) {
+			if (__builtin_popcount(b ^ mark_lut[i][0]) == 1)
+				n++;
+		}
+
+		if (n == 1 && nib >= 0)
+			decode_lut[b] = RF_SYM_FIX | nib;
+	}
+}
+
+static uint8_t crc5(const uint8_t d[])
+{
+	uint8_t crc;
+
+	crc = crc5lut[0x1f ^ (d[0] & 0xe0)];
+	crc = crc5lut[crc ^ d[1]];
+	crc = crc5lut[crc ^ d[2]];
+	crc = crc5lut[crc ^ d[3]];
+	return (crc ^ 0x1f) & 0x1f;
+}
+
+/* ---------------------------------------------------------------------
+ * RS(12,8) over GF(16), rflink_fec_decode() of rc433rx_uart.c
+ * ---------------------------------------------------------------------
+ */
+
+#define RS_N (2 * (PKT_LEN + FEC_LEN))
+#define RS_T2 (2 * FEC_LEN)
+
+static uint8_t gf16_mul(uint8_t a, uint8_t b)
+{
+	if ((a == 0) || (b == 0))
+		return 0;
+	return gf16_exp[gf16_log[a] + gf16_log[b]];
+}
+
+static uint8_t gf16_div(uint8_t a, uint8_t b)
+{
+	if (a == 0)
+		return 0;
+	return gf16_exp[gf16_log[a] + 15 - gf16_log[b]];
+}
+
+static uint8_t gf16_poly_eval(const uint8_t p[], uint8_t n, uint8_t x)
+{
+	uint8_t y = 0;
+
+	while (n--)
+		y = gf16_mul(y, x) ^ p[n];
+	return y;
+}
+
+static int fec_decode(uint8_t c[], uint16_t era)
+{
+	uint8_t s[RS_T2];
+	uint8_t lam[RS_T2 + 1];
+	uint8_t b[RS_T2 + 1];
+	uint8_t t[RS_T2 + 1];
+	uint8_t om[RS_T2];
+	uint8_t nz = 0;
+	uint8_t f = 0;
+	uint8_t l;
+	uint8_t r;
+	int i;
+	int j;
+	int n;
+
+	for (i = 0; i < RS_T2; ++i) {
+		uint8_t a = gf16_exp[i + 1];
+		uint8_t y = 0;
+
+		for (j = 0; j < RS_N; ++j)
+			y = gf16_mul(y, a) ^ c[j];
+		s[i] = y;
+		nz |= y;
+	}
+
+	if (nz == 0)
+		return 0;
+
+	memset(lam, 0, sizeof(lam));
+	lam[0] = 1;
+	for (j = 0; j < RS_N; ++j) {
+		if (era & (1 << j)) {
+			uint8_t x = gf16_exp[RS_N - 1 - j];
+
+			for (i = ++f; i > 0; --i)
+				lam[i] ^= gf16_mul(lam[i - 1], x);
+		}
+	}
+
+	memcpy(b, lam, sizeof(b));
+	l = f;
+	for (r = f + 1; r <= RS_T2; ++r) {
+		uint8_t d = 0;
+
+		for (i = 0; (i <= l) && (i < r); ++i)
+			d ^= gf16_mul(lam[i], s[r - 1 - i]);
+
+		for (i = RS_T2; i > 0; --i)
+			b[i] = b[i - 1];
+		b[0] = 0;
+
+		if (d == 0)
+			continue;
+
+		for (i = 0; i <= RS_T2; ++i)
+			t[i] = lam[i] ^ gf16_mul(d, b[i]);
+
+		if (2 * l <= r + f - 1) {
+			for (i = 0; i <= RS_T2; ++i)
+				b[i] = gf16_div(lam[i], d);
+			l = r + f - l;
+		}
+
+		memcpy(lam, t, sizeof(lam));
+	}
+
+	if (l > RS_T2)
+		return -1;
+
+	for (i = 0; i < RS_T2; ++i) {
+		uint8_t y = 0;
+
+		for (j = 0; j <= i; ++j)
+			y ^= gf16_mul(lam[j], s[i - j]);
+		om[i] = y;
+	}
+
+	n = 0;
+	for (j = 0; j < RS_N; ++j) {
+		uint8_t xi = gf16_exp[15 - (RS_N - 1 - j)];
+		uint8_t dl;
+
+		if (gf16_poly_eval(lam, l + 1, xi) != 0)
+			continue;
+
+		dl = 0;
+		for (i = 1; i <= l; i += 2)
+			dl ^= gf16_mul(lam[i], gf16_exp[(gf16_log[xi] * (i - 1)) % 15]);
+		if (dl == 0)
+			return -1;
+
+		c[j] ^= gf16_div(gf16_poly_eval(om, RS_T2, xi), dl);
+		n++;
+	}
+
+	if (n != l)
+		return -1;
+
+	return n;
+}
+
+/* ---------------------------------------------------------------------
+ * Decoder
+ * ---------------------------------------------------------------------
+ */
+
+static void frm_list(struct chunk * k, uint64_t off, uint8_t typ,
+					 const uint8_t dat[], uint8_t len)
+{
+	uint8_t i;
+
+	if (!listing)
+		return;
+
+	fprintf(k->out, "%12llu %s", (unsigned long long)off, typ_name[typ]);
+	for (i = 0; i < len; i++)
+		fprintf(k->out, " %02x", dat[i]);
+	fputc('\n', k->out);
+}
+
+/* An error found at capture offset 'off'. */
+static void dec_err(struct chunk * k, struct dec * d, uint64_t off,
+					uint8_t typ)
+{
+	d->state = RF_IDLE;
+	if (off < k->start)
+		return;
+	k->cnt.frm[typ]++;
+	frm_list(k, d->off, typ, NULL, 0);
+}
+
+/* rx_frm_publish() and rflink_recv() for the frame ending at 'off' */
+static void dec_publish(struct chunk * k, struct dec * d, uint64_t off)
+{
+	bool on = (off >= k->start);
+	uint8_t typ = d->typ;
+	uint8_t p[PKT_LEN];
+
+	d->state = RF_IDLE;
+	if (on && (d->nsync > 0))
+		k->cnt.acq[d->nsync - 1]++;
+
+	if (typ == TYP_VAR) {
+		if (on) {
+			k->cnt.frm[TYP_VAR]++;
+			frm_list(k, d->off, TYP_VAR, d->dat, d->len);
+		}
+		return;
+	}
+
+	if (typ == TYP_FEC) {
+		uint8_t c[RS_N];
+		uint8_t i;
+		int n;
+
+		for (i = 0; i < PKT_LEN + FEC_LEN; ++i) {
+			c[2 * i] = d->dat[i] & 0x0f;
+			c[2 * i + 1] = d->dat[i] >> 4;
+		}
+
+		n = fec_decode(c, d->era);
+		for (i = 0; i < PKT_LEN; ++i)
+			p[i] = c[2 * i] | (c[2 * i + 1] << 4);
+
+		if ((n < 0) || (crc5(p) != (p[0] & 0x1f))) {
+			if (on) {
+				k->cnt.frm[TYP_UNC]++;
+				frm_list(k, d->off, TYP_UNC, NULL, 0);
+			}
+			return;
+		}
+		if (on)
+			k->cnt.fec += n;
+	} else {
+		memcpy(p, d->dat, PKT_LEN);
+		if (d->ack)
+			typ = TYP_ARQ;
+	}
+
+	p[0] &= 0xe0;
+
+	if (d->copies && (memcmp(p, d->last, PKT_LEN) == 0)) {
+		if (on) {
+			k->cnt.frm[TYP_DUP]++;
+			frm_list(k, d->off, TYP_DUP, p, PKT_LEN);
+		}
+		return;
+	}
+
+	if (on && !d->copies) {
+		/* the chunks before decide whether it is a copy */
+		k->first = true;
+		k->first_typ = typ;
+		memcpy(k->first_dat, p, PKT_LEN);
+		if (listing)
+			k->first_pos = ftell(k->out);
+	}
+
+	memcpy(d->last, p, PKT_LEN);
+	d->copies = true;
+	k->last_ok = true;
+	memcpy(k->last, p, PKT_LEN);
+
+	if (on) {
+		k->cnt.frm[typ]++;
+		frm_list(k, d->off, typ, p, PKT_LEN);
+	}
+}
+
+/* USART_RX_vect, for the byte at 'off' decoded to 'nibble' */
+static void dec_sym(struct chunk * k, struct dec * d, uint64_t off,
+					uint8_t nibble)
+{
+	uint8_t state = d->state;
+	uint8_t pos;
+	uint8_t c;
+
+	if ((nibble >= 0x11) && (nibble <= 0x13)) {
+		d->ack = 0;
+		if (state == RF_SYNC) {
+			d->state = RF_SOF;
+		} else if (state != RF_SOF) {
+			d->state = RF_SYNC;
+			d->nsync = 0;
+		}
+		if (d->nsync < RC433_ACQ_LEN)
+			d->nsync++;
+		return;
+	}
+
+	if ((nibble >= RF_VAR_MARK) && (nibble <= RF_ARQ_MARK) &&
+		((state == RF_SYNC) || (state == RF_SOF)) &&
+		(d->nsync < RC433_ACQ_LEN))
+		d->nsync++;
+
+	if ((nibble == RF_FEC_MARK) &&
+		((state == RF_SYNC) || (state == RF_SOF))) {
+		d->typ = TYP_FEC;
+		d->off = off + 1;
+		d->era = 0;
+		d->nera = 0;
+		d->state = RF_FEC_SOF;
+		return;
+	}
+
+	if ((nibble == RF_ARQ_MARK) &&
+		((state == RF_SYNC) || (state == RF_SOF))) {
+		d->ack = 1;
+		d->state = RF_SOF;
+		return;
+	}
+
+	if ((nibble == RF_VAR_MARK) &&
+		((state == RF_SYNC) || (state == RF_SOF))) {
+		d->typ = TYP_VAR;
+		d->off = off + 1;
+		d->crc16 = 0xffff;
+		d->state = RF_VAR_SOF;
+		return;
+	}
+
+	if (state < RF_SOF) {
+		d->state = RF_IDLE;
+		return;
+	}
+
+	if ((nibble & 0xf0) == RF_SYM_FIX) {
+		nibble &= 0x0f;
+		if (off >= k->start)
+			k->cnt.fix++;
+	}
+
+	if (state >= RF_VAR_SOF) {
+		uint16_t crc;
+
+		if (nibble > 0x0f) {
+			dec_err(k, d, off, TYP_SYM);
+			return;
+		}
+
+		crc = (d->crc16 << 4) ^ crc16lut[(d->crc16 >> 12) ^ nibble];
+		d->crc16 = crc;
+		pos = state - RF_VAR_SOF;
+
+		if (pos < 2) {
+			if (pos == 0) {
+				d->len = nibble;
+			} else {
+				c = d->len | (nibble << 4);
+				if ((c == 0) || (c > frm_max)) {
+					dec_err(k, d, off, TYP_CRC);
+					return;
+				}
+				d->len = c;
+				d->end = RF_VAR_SOF + 2 + (2 * c) + 4;
+			}
+			d->state = state + 1;
+			return;
+		}
+
+		if (state < d->end - 4) {
+			pos -= 2;
+			if (pos & 1)
+				d->dat[pos >> 1] |= nibble << 4;
+			else
+				d->dat[pos >> 1] = nibble;
+		}
+
+		if (++state < d->end) {
+			d->state = state;
+			return;
+		}
+
+		if (crc != 0) {
+			dec_err(k, d, off, TYP_CRC);
+			return;
+		}
+
+		dec_publish(k, d, off);
+		return;
+	}
+
+	if (state >= RF_FEC_SOF) {
+		pos = state - RF_FEC_SOF;
+
+		if (nibble > 0x0f) {
+			if (++d->nera > 2 * FEC_LEN) {
+				dec_err(k, d, off, TYP_SYM);
+				return;
+			}
+			d->era |= (1 << pos);
+			nibble = 0;
+		}
+
+		if (pos & 1)
+			d->dat[pos >> 1] |= nibble << 4;
+		else
+			d->dat[pos >> 1] = nibble;
+
+		if (++state < RF_FEC_EOF) {
+			d->state = state;
+			return;
+		}
+
+		dec_publish(k, d, off);
+		return;
+	}
+
+	if (nibble > 0x0f) {
+		dec_err(k, d, off, TYP_SYM);
+		return;
+	}
+
+	pos = state - RF_SOF;
+
+	if (pos == 0) {
+		d->typ = TYP_PKT;
+		d->off = off;
+		d->dat[0] = nibble;
+		d->state = state + 1;
+		return;
+	}
+
+	if ((pos & 1) == 0) {
+		d->dat[pos >> 1] = nibble;
+		d->state = state + 1;
+		return;
+	}
+
+	c = d->dat[pos >> 1] | (nibble << 4);
+	d->dat[pos >> 1] = c;
+
+	if (pos == 1)
+		d->crc = crc5lut[0x1f ^ (c & 0xe0)];
+	else
+		d->crc = crc5lut[d->crc ^ c];
+
+	if (++state < RF_EOF) {
+		d->state = state;
+		return;
+	}
+
+	if (((d->crc ^ d->dat[0]) & 0x1f) != 0x1f) {
+		dec_err(k, d, off, TYP_CRC);
+		return;
+	}
+
+	dec_publish(k, d, off);
+}
+
+static void * chunk_run(void * arg)
+{
+	struct chunk * k = arg;
+	uint8_t sym[WIN_LEN];
+	struct dec d;
+	uint64_t win = 0;
+	uint64_t win_end = 0;
+	uint64_t off;
+
+	memset(&d, 0, sizeof(d));
+	off = k->warm;
+	while (off < k->end) {
+		if (d.state == RF_IDLE) {
+			/* nothing but a sync symbol leaves RF_IDLE, skip the
+			   noise between the frames */
+			off += symdec_find(&sd, k->base + off, k->end - off);
+			if (off == k->end)
+				break;
+		}
+
+		if (off >= win_end) {
+			win = off;
+			win_end = off + WIN_LEN;
+			if (win_end > k->end)
+				win_end = k->end;
+			symdec_run(&sd, k->base + win, sym, win_end - win);
+		}
+
+		dec_sym(k, &d, off, sym[off - win]);
+		off++;
+	}
+
+	return NULL;
+}
+
+/* ---------------------------------------------------------------------
+ * Firmware cross-check
+ * ---------------------------------------------------------------------
+ */
+
+static int fw_check(const char * argv0, const char * so, const uint8_t * buf,
+					uint64_t len, const struct cnt * c)
+{
+	struct rc433_rx_stat st;
+	struct sim_link lnk;
+	uint8_t (* frm_type)(void);
+	uint8_t dat[FRM_LIM];
+	uint64_t frm[3] = { 0, 0, 0 };
+	uint64_t i;
+	int8_t n;
+	int bad = 0;
+
+	sim_link_load(&lnk, argv0, so, "snif");
+	frm_type = (uint8_t (*)(void))sim_node_sym(lnk.node, "rc433_frm_type");
+	if (lnk.frm_recv == NULL) {
+		fprintf(stderr, "%s: built without variable length frames\n", so);
+		return 1;
+	}
+	sim_link_init(&lnk);
+
+	for (i = 0; i < len; i++) {
+		sim_usart_rx(lnk.node, buf[i], false);
+		while ((n = SIM_CALL(lnk.node, lnk.frm_recv(dat))) > 0)
+			frm[SIM_CALL(lnk.node, frm_type())]++;
+	}
+	SIM_CALL_VOID(lnk.node, lnk.rx_stat_get(&st));
+
+#define FW_CMP(_NAME_, _FW_, _CAP_) \
+	do { \
+		if ((uint64_t)(_FW_) != (uint64_t)(_CAP_)) { \
+			printf("mismatch: %-4s firmware %llu capture %llu\n", _NAME_, \
+				   (unsigned long long)(_FW_), \
+				   (unsigned long long)(_CAP_)); \
+			bad = 1; \
+		} \
+	} while (0)
+
+	/* the firmware counters are 16 bit */
+	FW_CMP("pkt", frm[RC433_TYP_PKT],
+		   c->frm[TYP_PKT] + c->frm[TYP_ARQ]);
+	FW_CMP("fec", frm[RC433_TYP_FEC], c->frm[TYP_FEC]);
+	FW_CMP("var", frm[RC433_TYP_VAR], c->frm[TYP_VAR]);
+	FW_CMP("dup", st.dup, c->frm[TYP_DUP] & 0xffff);
+	FW_CMP("crc", st.err, c->frm[TYP_CRC] & 0xffff);
+	FW_CMP("sym", st.sym, c->frm[TYP_SYM] & 0xffff);
+	FW_CMP("unc", st.unc, c->frm[TYP_UNC] & 0xffff);
+	FW_CMP("fix", st.fix, c->fix & 0xffff);
+	FW_CMP("fec", st.fec, c->fec & 0xffff);
+	FW_CMP("ovr", st.ovr, 0);
+	for (i = 0; i < RC433_ACQ_LEN; i++)
+		FW_CMP("acq", st.acq[i], c->acq[i] & 0xffff);
+
+	printf("firmware: %s\n", bad ? "MISMATCH" : "same counts");
+	return bad;
+}
+
+/* ---------------------------------------------------------------------
+ * Symbol decoding benchmark
+ * ---------------------------------------------------------------------
+ */
+
+#define BENCH_BLK (64 * 1024)
+
+static double now_sec(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+/* The table decoding and the sync search alone, with every instruction
+   set the CPU has, against the byte by byte table walk. Every output is
+   compared with the table, for all 256 byte values and for the capture. */
+static int bench(const uint8_t * buf, uint64_t len)
+{
+	uint8_t in[256 + 64];
+	uint8_t out[256 + 64];
+	uint8_t * ref = malloc(BENCH_BLK);
+	uint8_t * dec = malloc(BENCH_BLK);
+	struct symdec s;
+	int best;
+	int isa;
+	int bad = 0;
+
+	best = symdec_init(&s, decode_lut, SYMDEC_AUTO, 0x11, 0x13);
+
+	for (isa = SYMDEC_SCALAR; isa <= best; isa++) {
+		uint64_t syncs = 0;
+		uint64_t ref_syncs = 0;
+		uint64_t off;
+		double t_dec;
+		double t_find;
+		double t;
+		bool same = true;
+		int i;
+
+		symdec_init(&s, decode_lut, isa, 0x11, 0x13);
+
+		/* every byte value, at every alignment of the vector tail */
+		for (i = 0; i < (int)sizeof(in); i++)
+			in[i] = i;
+		for (i = 0; i < 64; i++) {
+			int j;
+
+			symdec_run(&s, in + i, out, sizeof(in) - i);
+			for (j = 0; j < (int)sizeof(in) - i; j++) {
+				if (out[j] != decode_lut[in[i + j]])
+					same = false;
+			}
+		}
+
+		t = now_sec();
+		for (off = 0; off < len; off += BENCH_BLK) {
+			uint64_t n = (len - off < BENCH_BLK) ? len - off : BENCH_BLK;
+
+			symdec_run(&s, buf + off, dec, n);
+		}
+		t_dec = now_sec() - t;
+
+		t = now_sec();
+		for (off = 0; off < len; off++) {
+			off += symdec_find(&s, buf + off, len - off);
+			if (off < len)
+				syncs++;
+		}
+		t_find = now_sec() - t;
+
+		for (off = 0; off < len; off += BENCH_BLK) {
+			uint64_t n = (len - off < BENCH_BLK) ? len - off : BENCH_BLK;
+			uint64_t j;
+
+			symdec_run(&s, buf + off, dec, n);
+			for (j = 0; j < n; j++) {
+				ref[j] = decode_lut[buf[off + j]];
+				if ((ref[j] >= 0x11) && (ref[j] <= 0x13))
+					ref_syncs++;
+			}
+			if (memcmp(ref, dec, n) != 0)
+				same = false;
+		}
+		if (syncs != ref_syncs)
+			same = false;
+
+		printf("%-7s decode %8.0f MB/s  sync search %8.0f MB/s  %s\n",
+			   symdec_isa_name(isa), (t_dec > 0) ? len / t_dec / 1e6 : 0.0,
+			   (t_find > 0) ? len / t_find / 1e6 : 0.0,
+			   same ? "identical" : "MISMATCH");
+		if (!same)
+			bad = 1;
+	}
+
+	free(ref);
+	free(dec);
+	return bad;
+}
+
+static void usage(const char * prog)
+{
+	fprintf(stderr, "usage: %s [options] capture\n", prog);
+	fprintf(stderr, "  -j threads decoding threads (number of CPUs)\n");
+	fprintf(stderr, "  -l         list the frames and errors\n");
+	fprintf(stderr, "  -S         soft decoding (RFLINK_RX_SOFT_DECODE)\n");
+	fprintf(stderr, "  -m len     largest variable length frame, "
+			"RFLINK_FRM_MAX (%d)\n", RFLINK_FRM_MAX);
+	fprintf(stderr, "  -x         check against the receiver firmware\n");
+	fprintf(stderr, "  -R file    receiver build for -x (snif_mon.so)\n");
+	fprintf(stderr, "  -i isa     symbol decoder, scalar, sse4.1 or avx2 "
+			"(best available)\n");
+	fprintf(stderr, "  -B         benchmark the symbol decoders\n");
+	exit(2);
+}
+
+int main(int argc, char * argv[])
+{
+	const char * rx_so = "snif_mon.so";
+	struct timespec t0;
+	struct timespec t1;
+	struct chunk * k;
+	struct cnt tot;
+	struct stat sb;
+	const uint8_t * buf;
+	uint8_t last[PKT_LEN];
+	bool last_ok = false;
+	bool soft = false;
+	bool check = false;
+	bool bench_only = false;
+	int isa = SYMDEC_AUTO;
+	uint64_t len;
+	uint64_t step;
+	double secs;
+	long jobs;
+	long n;
+	long i;
+	int fd;
+	int c;
+
+	jobs = sysconf(_SC_NPROCESSORS_ONLN);
+
+	while ((c = getopt(argc, argv, "j:lSm:xR:i:Bh")) != -1) {
+		switch (c) {
+		case 'j':
+			jobs = strtol(optarg, NULL, 0);
+			break;
+		case 'l':
+			listing = true;
+			break;
+		case 'S':
+			soft = true;
+			break;
+		case 'm':
+			frm_max = strtoul(optarg, NULL, 0);
+			if ((frm_max < PKT_LEN) || (frm_max > FRM_LIM))
+				usage(argv[0]);
+			break;
+		case 'x':
+			check = true;
+			break;
+		case 'R':
+			rx_so = optarg;
+			break;
+		case 'i':
+			for (isa = SYMDEC_SCALAR; isa <= SYMDEC_AVX2; isa++) {
+				if (strcmp(optarg, symdec_isa_name(isa)) == 0)
+					break;
+			}
+			if (isa > SYMDEC_AVX2)
+				usage(argv[0]);
+			break;
+		case 'B':
+			bench_only = true;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (optind != argc - 1)
+		usage(argv[0]);
+	if (jobs < 1)
+		jobs = 1;
+
+	if (((fd = open(argv[optind], O_RDONLY)) < 0) || (fstat(fd, &sb) < 0)) {
+		perror(argv[optind]);
+		return 1;
+	}
+
+	len = sb.st_size;
+	buf = NULL;
+	if (len > 0) {
+		buf = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (buf == MAP_FAILED) {
+			perror("mmap");
+			return 1;
+		}
+		madvise((void *)buf, len, MADV_SEQUENTIAL);
+	}
+	close(fd);
+
+	decode_init(soft);
+	if (bench_only)
+		return bench(buf, len);
+	/* the sync symbols take the decoder out of RF_IDLE */
+	isa = symdec_init(&sd, decode_lut, isa, 0x11, 0x13);
+
+	/* one chunk per thread, none smaller than CHUNK_MIN */
+	n = (len + CHUNK_MIN - 1) / CHUNK_MIN;
+	if (n > jobs)
+		n = jobs;
+	if (n < 1)
+		n = 1;
+	step = (len + n - 1) / n;
+
+	k = calloc(n, sizeof(struct chunk));
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (i = 0; i < n; i++) {
+		k[i].base = buf;
+		k[i].start = i * step;
+		k[i].end = (i == n - 1) ? len : (i + 1) * step;
+		if (k[i].end > len)
+			k[i].end = len;
+		if (k[i].start > k[i].end)
+			k[i].start = k[i].end;
+		k[i].warm = (k[i].start > WARM_LEN) ? k[i].start - WARM_LEN : 0;
+		if (listing && ((k[i].out = tmpfile()) == NULL)) {
+			perror("tmpfile");
+			return 1;
+		}
+		if (pthread_create(&k[i].th, NULL, chunk_run, &k[i]) != 0) {
+			fprintf(stderr, "pthread_create failed\n");
+			return 1;
+		}
+	}
+
+	memset(&tot, 0, sizeof(tot));
+	for (i = 0; i < n; i++) {
+		unsigned int j;
+
+		pthread_join(k[i].th, NULL);
+
+		/* a chunk whose first packet is the last one of the chunks
+		   before has a copy in it, which it could not know */
+		if (k[i].first && last_ok &&
+			(memcmp(k[i].first_dat, last, PKT_LEN) == 0)) {
+			k[i].cnt.frm[k[i].first_typ]--;
+			k[i].cnt.frm[TYP_DUP]++;
+			if (listing) {
+				fseek(k[i].out, k[i].first_pos + 13, SEEK_SET);
+				fputs(typ_name[TYP_DUP], k[i].out);
+			}
+		}
+		if (k[i].last_ok) {
+			memcpy(last, k[i].last, PKT_LEN);
+			last_ok = true;
+		}
+
+		for (j = 0; j <= TYP_UNC; j++)
+			tot.frm[j] += k[i].cnt.frm[j];
+		tot.fix += k[i].cnt.fix;
+		tot.fec += k[i].cnt.fec;
+		for (j = 0; j < RC433_ACQ_LEN; j++)
+			tot.acq[j] += k[i].cnt.acq[j];
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+
+	if (listing) {
+		char line[256];
+
+		for (i = 0; i < n; i++) {
+			rewind(k[i].out);
+			while (fgets(line, sizeof(line), k[i].out) != NULL)
+				fputs(line, stdout);
+			fclose(k[i].out);
+		}
+	}
+
+	printf("capture:  %llu bytes, %.1f h at 480 characters/s, "
+		   "%ld threads, %s, %.0f MB/s\n", (unsigned long long)len,
+		   len / 480.0 / 3600, n, symdec_isa_name(isa),
+		   (secs > 0) ? len / secs / 1e6 : 0.0);
+	printf("frames:   %llu pkt, %llu arq, %llu fec, %llu var, %llu dup\n",
+		   (unsigned long long)tot.frm[TYP_PKT],
+		   (unsigned long long)tot.frm[TYP_ARQ],
+		   (unsigned long long)tot.frm[TYP_FEC],
+		   (unsigned long long)tot.frm[TYP_VAR],
+		   (unsigned long long)tot.frm[TYP_DUP]);
+	printf("errors:   %llu crc, %llu sym, %llu unc\n",
+		   (unsigned long long)tot.frm[TYP_CRC],
+		   (unsigned long long)tot.frm[TYP_SYM],
+		   (unsigned long long)tot.frm[TYP_UNC]);
+	printf("repaired: %llu fix, %llu fec\n", (unsigned long long)tot.fix,
+		   (unsigned long long)tot.fec);
+	printf("acq:     ");
+	for (i = 0; i < RC433_ACQ_LEN; i++) {
+		if (tot.acq[i])
+			printf(" %ld:%llu", i + 1, (unsigned long long)tot.acq[i]);
+	}
+	printf("\n");
+
+	free(k);
+
+	if (check)
+		return fw_check(argv[0], rx_so, buf, len, &tot);
+
+	return 0;
+}
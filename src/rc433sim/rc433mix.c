@@ -0,0 +1,142 @@
+/*
+ * Copyright(C) 2021 Robinson (Bob) Mittman. All Rights Reserved.
+ * Licensed under the MIT license.
+ * See LICENSE file in the project root for details.
+ *
+ */
+
+/* Drive mixing table test.
+ *
+ * Runs mix_get() of the transmitter (src/rc433xmtr/mix.c, built into the
+ * tool with the default curves and limits) over every steer and speed
+ * the encoders can take, both directions, against the arithmetic the
+ * FORWARD and REVERSE modes of rc433xmtr.c did before the tables, and
+ * reports the levels that differ. -p prints the tables as built, one
+ * line per steer, for a look at other curves (-DMIX_FWD_EXPO=... and
+ * the like in the Makefile rule). */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+#include "io.h"
+#include "mix.h"
+
+/* rc433xmtr.c, FORWARD with 'max' 124, REVERSE with 100 */
+static void ref_mix(int8_t steer, int8_t speed, uint8_t max,
+					uint8_t * left, uint8_t * right)
+{
+	uint8_t m_left;
+	uint8_t m_right;
+
+	if (speed > 0) {
+		if (steer < 0) {
+			uint8_t rate = 16 - ((uint8_t)-steer);
+
+			m_left = (uint8_t)(speed * (rate)) / 4;
+			m_right = (uint8_t)(speed * 16) / 4;
+		} else {
+			uint8_t rate = 16 - ((uint8_t)steer);
+
+			m_left = (uint8_t)(speed * 16) / 4;
+			m_right = (uint8_t)(speed * (rate)) / 4;
+		}
+
+		m_left += 63;
+		m_right += 63;
+
+		if (m_left > max)
+			m_left = max;
+
+		if (m_right > max)
+			m_right = max;
+	} else {
+		m_left = 0;
+		m_right = 0;
+	}
+
+	*left = m_left;
+	*right = m_right;
+}
+
+static void tab_print(uint8_t dir)
+{
+	int steer;
+	int speed;
+	uint8_t l;
+	uint8_t r;
+
+	printf("%s, left/right by speed %d..%d\n",
+		   (dir == MIX_FWD) ? "forward" : "reverse",
+		   ENCODER1_MIN, ENCODER1_MAX);
+	for (steer = ENCODER0_MIN; steer <= ENCODER0_MAX; steer++) {
+		printf("%4d ", steer);
+		for (speed = ENCODER1_MIN; speed <= ENCODER1_MAX; speed++) {
+			mix_get(dir, steer, speed, &l, &r);
+			printf(" %3u/%-3u", l, r);
+		}
+		printf("\n");
+	}
+}
+
+static void usage(const char * prog)
+{
+	fprintf(stderr, "usage: %s [options]\n", prog);
+	fprintf(stderr, "  -p         print the tables\n");
+	exit(2);
+}
+
+int main(int argc, char * argv[])
+{
+	static const uint8_t max[2] = { 124, 100 };
+	uint32_t cnt = 0;
+	uint32_t bad = 0;
+	bool print = false;
+	uint8_t dir;
+	int steer;
+	int speed;
+	int c;
+
+	while ((c = getopt(argc, argv, "ph")) != -1) {
+		switch (c) {
+		case 'p':
+			print = true;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	for (dir = MIX_FWD; dir <= MIX_REV; dir++) {
+		for (steer = ENCODER0_MIN; steer <= ENCODER0_MAX; steer++) {
+			for (speed = ENCODER1_MIN; speed <= ENCODER1_MAX; speed++) {
+				uint8_t l;
+				uint8_t r;
+				uint8_t ref_l;
+				uint8_t ref_r;
+
+				mix_get(dir, steer, speed, &l, &r);
+				ref_mix(steer, speed, max[dir], &ref_l, &ref_r);
+				cnt++;
+				if ((l == ref_l) && (r == ref_r))
+					continue;
+
+				if (bad++ < 10)
+					printf("%s steer %3d speed %2d: %3u/%-3u, "
+						   "expected %3u/%-3u\n",
+						   (dir == MIX_FWD) ? "fwd" : "rev", steer, speed,
+						   l, r, ref_l, ref_r);
+			}
+		}
+	}
+
+	if (print) {
+		tab_print(MIX_FWD);
+		tab_print(MIX_REV);
+	}
+
+	printf("mixing:    %u levels checked, %u differ\n", cnt, bad);
+
+	return (bad == 0) ? 0 : 1;
+}
@@ -0,0 +1,476 @@
+/*
+ * Copyright(C) 2021 Robinson (Bob) Mittman. All Rights Reserved.
+ * Licensed under the MIT license.
+ * See LICENSE file in the project root for details.
+ *
+ */
+
+/* Link monitor test and stream decoder.
+ *
+ * The transmitter (xmtr_link.so) keeps the air busy with back-to-back
+ * frames, every -v th one a variable length frame of up to 32 bytes, the
+ * others 4 byte packets, each sent -c times with the same sequence
+ * number, as the transmitter repeats a command. Characters are lost with
+ * probability -f on the way. The receiver (snif_mon.so, built with
+ * SNIF_MON) streams a record of every frame and error to its TXD, and a
+ * status record every second, which are decoded and checked here:
+ *
+ *   every record has a valid checksum
+ *   every frame record matches a frame sent, in order, and no packet
+ *   has more records than copies
+ *   without losses every frame sent, every copy, has its record and none
+ *   is dropped
+ *
+ * The monitor TXD load is reported against the 480 characters per second
+ * of the line. With -w the stream is also saved, -r decodes a saved or
+ * captured stream instead, one line per record. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "sim.h"
+#include "simnode.h"
+#include "chan.h"
+#include "rc433.h"
+#include "../rc433snif/mon.h"
+
+#define FRM_MAX 32
+
+/* record parser */
+struct rec {
+	uint8_t buf[4 + 64 + 1];
+	int pos;
+	int len;
+	/* counters */
+	uint32_t cnt[4];
+	uint32_t bad;
+	uint32_t skip;
+};
+
+struct mon {
+	struct sim_link tx;
+	struct sim_link rx;
+	void (* status)(void);
+	int8_t (* recv)(uint8_t dat[]);
+	struct chan rnd;
+	double loss;
+	uint32_t frm_max;
+	uint32_t var;
+	uint32_t copies;
+	FILE * out;
+	struct rec rec;
+	/* frames started, the one on the way and its copies left */
+	uint32_t frm;
+	uint32_t cur;
+	uint32_t left;
+	/* frames sent, copies included, and recorded */
+	uint32_t sent;
+	uint32_t rcvd;
+	uint32_t wrong;
+	/* frame of the last record, its records so far */
+	uint32_t last;
+	uint32_t last_cnt;
+	/* last status record */
+	uint16_t drop;
+	/* monitor TXD characters and time span */
+	uint32_t chars;
+	uint64_t t_first;
+	uint64_t t_last;
+	uint64_t t_end;
+	/* the last status record is queued */
+	bool done;
+};
+
+static uint8_t frm_len(struct mon * m, uint32_t n)
+{
+	if ((m->var == 0) || ((n % m->var) != 0))
+		return 4;
+	return 5 + (n / m->var) % (FRM_MAX - 4);
+}
+
+static uint32_t frm_copies(struct mon * m, uint32_t n)
+{
+	return (frm_len(m, n) == 4) ? m->copies : 1;
+}
+
+/* Frame 'n': a packet with the sequence number and 'n' in it, or a
+   variable length frame with 'n' and a pattern of it. */
+static uint8_t frm_make(struct mon * m, uint8_t dat[], uint32_t n)
+{
+	uint8_t len = frm_len(m, n);
+	uint8_t i;
+
+	if (len == 4) {
+		dat[0] = (n << 5) & RC433_SEQ_MSK;
+		dat[1] = n;
+		dat[2] = n >> 8;
+		dat[3] = n >> 16;
+		return len;
+	}
+
+	dat[0] = n;
+	dat[1] = n >> 8;
+	dat[2] = n >> 16;
+	for (i = 3; i < len; i++)
+		dat[i] = n + i;
+
+	return len;
+}
+
+/* ---------------------------------------------------------------------
+ * Records
+ * ---------------------------------------------------------------------
+ */
+
+static uint16_t get16(const uint8_t * p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static void rec_print(const uint8_t * r, int len)
+{
+	static const char * const name[] = { "pkt", "frm", "err", "stat" };
+	const uint8_t * p = r + 4;
+	int i;
+
+	printf("%5u %-4s", get16(r + 2), name[r[1] >> 6]);
+	switch (r[1] >> 6) {
+	case MON_ERR:
+		printf(" crc %u sym %u unc %u ovr %u", p[0], p[1], p[2], p[3]);
+		break;
+	case MON_STAT:
+		if (len != MON_STAT_LEN) {
+			printf(" ?");
+			break;
+		}
+		printf(" ovr %u err %u sym %u fix %u fec %u unc %u cal %u "
+			   "dup %u drop %u ppm %d", get16(p), get16(p + 2),
+			   get16(p + 4), get16(p + 6), get16(p + 8), get16(p + 10),
+			   get16(p + 12), get16(p + 14), get16(p + 16),
+			   (int32_t)(get16(p + 18) | ((uint32_t)get16(p + 20) << 16)));
+		break;
+	default:
+		for (i = 0; i < len; i++)
+			printf(" %02x", p[i]);
+	}
+	printf("\n");
+}
+
+/* Feed one character of the stream, returns the payload length when a
+   valid record ends with it, the record in r->buf. */
+static int rec_put(struct rec * r, uint8_t c)
+{
+	uint8_t buf[sizeof(r->buf)];
+	uint8_t sum;
+	int i;
+
+	if (r->pos == 0) {
+		if (c == MON_SYNC)
+			r->buf[r->pos++] = c;
+		else
+			r->skip++;
+		return 0;
+	}
+
+	r->buf[r->pos++] = c;
+	if (r->pos == 2)
+		r->len = (c & 0x3f) + 1;
+	if (r->pos < r->len + 5)
+		return 0;
+
+	r->pos = 0;
+	for (sum = 0, i = 1; i < r->len + 5; i++)
+		sum += r->buf[i];
+	if (sum != 0) {
+		r->bad++;
+		/* resynchronize past the false sync, a record in the bytes
+		   after it is not checked */
+		memcpy(buf, r->buf, r->len + 5);
+		for (i = 1; i < r->len + 5; i++)
+			rec_put(r, buf[i]);
+		return 0;
+	}
+
+	r->cnt[r->buf[1] >> 6]++;
+	return r->len;
+}
+
+static void rec_check(struct mon * m, const uint8_t * r, int len)
+{
+	uint8_t ref[FRM_MAX];
+	const uint8_t * p = r + 4;
+	uint32_t n;
+
+	switch (r[1] >> 6) {
+	case MON_PKT:
+		n = p[1] | ((uint32_t)p[2] << 8) | ((uint32_t)p[3] << 16);
+		break;
+	case MON_FRM:
+		n = p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16);
+		break;
+	case MON_STAT:
+		if (len == MON_STAT_LEN) {
+			m->drop = get16(p + 16);
+		}
+		return;
+	default:
+		return;
+	}
+
+	if ((n >= m->frm) || (frm_make(m, ref, n) != len) ||
+		(memcmp(ref, p, len) != 0)) {
+		m->wrong++;
+		return;
+	}
+
+	if (n != m->last) {
+		if ((m->rcvd != 0) && (n < m->last)) {
+			m->wrong++;
+			return;
+		}
+		m->last = n;
+		m->last_cnt = 0;
+	}
+
+	/* a copy more than sent */
+	if (m->last_cnt++ == frm_copies(m, n)) {
+		m->wrong++;
+		return;
+	}
+
+	m->rcvd++;
+}
+
+/* ---------------------------------------------------------------------
+ * Lines
+ * ---------------------------------------------------------------------
+ */
+
+static void air_line(void * arg, struct sim_node * node, uint8_t c,
+					 uint64_t t_start, uint64_t t_end)
+{
+	struct mon * m = arg;
+
+	(void)node;
+	(void)t_start;
+	(void)t_end;
+	if ((m->loss > 0) && (chan_uniform(&m->rnd) < m->loss))
+		return;
+	sim_usart_rx(m->rx.node, c, false);
+}
+
+static void mon_line(void * arg, struct sim_node * node, uint8_t c,
+					 uint64_t t_start, uint64_t t_end)
+{
+	struct mon * m = arg;
+	int len;
+
+	(void)node;
+	if (m->chars++ == 0)
+		m->t_first = t_start;
+	m->t_last = t_end;
+	if (m->out != NULL)
+		fputc(c, m->out);
+
+	if ((len = rec_put(&m->rec, c)) > 0)
+		rec_check(m, m->rec.buf, len);
+}
+
+/* ---------------------------------------------------------------------
+ * Nodes
+ * ---------------------------------------------------------------------
+ */
+
+static void tx_main(void * arg, struct sim_node * node)
+{
+	struct mon * m = arg;
+	uint8_t dat[FRM_MAX];
+	uint8_t len;
+	int8_t ok;
+
+	while (((m->frm < m->frm_max) || (m->left != 0)) &&
+		   (SIM_CALL(node, m->tx.tx_pending()) < 2)) {
+		if (m->left == 0) {
+			m->cur = m->frm++;
+			m->left = frm_copies(m, m->cur);
+		}
+		len = frm_make(m, dat, m->cur);
+		if (len == 4)
+			ok = SIM_CALL(node, m->tx.pkt_send(dat));
+		else
+			ok = SIM_CALL(node, m->tx.frm_send(dat, len));
+		if (!ok)
+			break;
+		m->sent++;
+		if ((--m->left == 0) && (m->frm == m->frm_max))
+			m->t_end = sim_now() + SIM_MS(200);
+	}
+}
+
+static void rx_main(void * arg, struct sim_node * node)
+{
+	struct mon * m = arg;
+	uint8_t dat[FRM_MAX];
+
+	while (SIM_CALL(node, m->recv(dat)) > 0)
+		;
+}
+
+static void status_tick(void * arg, uintptr_t dat)
+{
+	struct mon * m = arg;
+
+	(void)dat;
+	SIM_CALL_VOID(m->rx.node, m->status());
+	/* the last one after the last frame, with the final counters */
+	if ((m->frm < m->frm_max) || (m->left != 0) || (sim_now() < m->t_end))
+		sim_at(sim_now() + SIM_MS(1000), status_tick, m, 0);
+	else
+		m->done = true;
+}
+
+static int decode(const char * path)
+{
+	struct rec r;
+	FILE * f;
+	int len;
+	int c;
+
+	if ((f = fopen(path, "rb")) == NULL) {
+		perror(path);
+		return 1;
+	}
+
+	memset(&r, 0, sizeof(r));
+	while ((c = fgetc(f)) != EOF) {
+		if ((len = rec_put(&r, c)) > 0)
+			rec_print(r.buf, len);
+	}
+	fclose(f);
+
+	printf("records:  %u pkt, %u frm, %u err, %u stat, %u bad, "
+		   "%u bytes skipped\n", r.cnt[MON_PKT], r.cnt[MON_FRM],
+		   r.cnt[MON_ERR], r.cnt[MON_STAT], r.bad, r.skip);
+
+	return (r.bad == 0) ? 0 : 1;
+}
+
+static void usage(const char * prog)
+{
+	fprintf(stderr, "usage: %s [options]\n", prog);
+	fprintf(stderr, "  -n frames  frames to send (5000)\n");
+	fprintf(stderr, "  -v n       every n-th frame of variable length, "
+			"0 none (8)\n");
+	fprintf(stderr, "  -c copies  copies of every packet (3)\n");
+	fprintf(stderr, "  -f prob    character loss (0)\n");
+	fprintf(stderr, "  -s seed    random seed (1)\n");
+	fprintf(stderr, "  -w file    save the monitor stream\n");
+	fprintf(stderr, "  -r file    decode a monitor stream\n");
+	exit(2);
+}
+
+int main(int argc, char * argv[])
+{
+	struct chan_cfg cfg;
+	struct mon m;
+	const char * wr = NULL;
+	uint64_t seed = 1;
+	double secs;
+	int c;
+
+	memset(&m, 0, sizeof(m));
+	m.frm_max = 5000;
+	m.var = 8;
+	m.copies = 3;
+
+	while ((c = getopt(argc, argv, "n:v:c:f:s:w:r:h")) != -1) {
+		switch (c) {
+		case 'n':
+			m.frm_max = strtoul(optarg, NULL, 0);
+			if (m.frm_max == 0)
+				usage(argv[0]);
+			break;
+		case 'v':
+			m.var = strtoul(optarg, NULL, 0);
+			break;
+		case 'c':
+			m.copies = strtoul(optarg, NULL, 0);
+			if (m.copies == 0)
+				usage(argv[0]);
+			break;
+		case 'f':
+			m.loss = strtod(optarg, NULL);
+			break;
+		case 's':
+			seed = strtoull(optarg, NULL, 0);
+			break;
+		case 'w':
+			wr = optarg;
+			break;
+		case 'r':
+			return decode(optarg);
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if ((wr != NULL) && ((m.out = fopen(wr, "wb")) == NULL)) {
+		perror(wr);
+		return 1;
+	}
+
+	memset(&cfg, 0, sizeof(cfg));
+	chan_init(&m.rnd, &cfg, seed);
+
+	sim_link_load(&m.tx, argv[0], "xmtr_link.so", "xmtr");
+	sim_link_load(&m.rx, argv[0], "snif_mon.so", "snif");
+	m.recv = (int8_t (*)(uint8_t *))sim_node_sym(m.rx.node, "mon_recv");
+	m.status = (void (*)(void))sim_node_sym(m.rx.node, "mon_status");
+	if ((m.var != 0) && (m.tx.frm_send == NULL)) {
+		fprintf(stderr, "transmitter built without variable length "
+				"frames\n");
+		return 1;
+	}
+
+	sim_line_set(m.tx.node, air_line, &m);
+	sim_line_set(m.rx.node, mon_line, &m);
+	sim_node_main_set(m.tx.node, tx_main, &m);
+	sim_node_main_set(m.rx.node, rx_main, &m);
+
+	sim_link_init(&m.tx);
+	/* io_init() for the time stamps, then the monitor */
+	SIM_CALL_VOID(m.rx.node, ((void (*)(void))
+		sim_node_sym(m.rx.node, "io_init"))());
+	sim_link_init(&m.rx);
+	SIM_CALL_VOID(m.rx.node, ((void (*)(void))
+		sim_node_sym(m.rx.node, "mon_init"))());
+
+	tx_main(&m, m.tx.node);
+	sim_at(SIM_MS(1000), status_tick, &m, 0);
+	/* the receiver timer never stops, run until the last status record
+	   is out */
+	while (!m.done)
+		sim_run(sim_now() + SIM_MS(1000));
+	sim_run(sim_now() + SIM_MS(200));
+
+	if (m.out != NULL)
+		fclose(m.out);
+
+	secs = (double)(m.t_last - m.t_first) / SIM_MS(1000);
+	printf("frames:   %u sent, %u recorded, %u lost, %u wrong\n",
+		   m.sent, m.rcvd, m.sent - m.rcvd, m.wrong);
+	printf("records:  %u pkt, %u frm, %u err, %u stat, %u bad\n",
+		   m.rec.cnt[MON_PKT], m.rec.cnt[MON_FRM], m.rec.cnt[MON_ERR],
+		   m.rec.cnt[MON_STAT], m.rec.bad);
+	printf("monitor:  %u dropped, %.0f characters/s of 480\n", m.drop,
+		   (secs > 0) ? m.chars / secs : 0.0);
+
+	if ((m.rec.bad != 0) || (m.wrong != 0) || (m.rec.cnt[MON_STAT] == 0))
+		return 1;
+	if (m.loss == 0)
+		return ((m.rcvd == m.sent) && (m.drop == 0)) ? 0 : 1;
+
+	return 0;
+}
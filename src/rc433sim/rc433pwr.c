@@ -0,0 +1,466 @@
+/*
+ * Copyright(C) 2021 Robinson (Bob) Mittman. All Rights Reserved.
+ * Licensed under the MIT license.
+ * See LICENSE file in the project root for details.
+ *
+ */
+
+/* Low power mode (IO_LOWPWR) test.
+ *
+ * The transmitter (xmtr_pwr.so: io.c and the link, built with
+ * IO_LOWPWR=1) has its encoders turned now and then: -n turns, on the
+ * average -i ms apart, of 1 to 8 steps 10 to 60 ms apart. The main loop
+ * of the tool stands in for rc433xmtr.c: every encoder event is sent -r
+ * times and io_sleep() ends every wake-up. The receiver (snif_pwr.so)
+ * powers down between frames too and is woken up by the start bit on
+ * RXD. After every turn the tool checks that the encoder counted every
+ * step and that the receiver got the last setting. Reported for each
+ * node: the time awake as the simulator saw it and as the firmware duty
+ * cycle counter (io_duty_get()) has it, the power-downs and the tick
+ * interrupts per second, against a tick that never stops. -t runs the
+ * tickless builds (xmtr_tl.so and snif_tl.so, IO_TICKLESS=1 as well),
+ * which interrupt at the deadlines and while the encoders move only.
+ * With -m the copies are posted to the mailbox (rc433_mbox_post())
+ * rather than queued. A packet received after the event of a newer one
+ * is stale, the tool reports how many and how late at most. -a runs the
+ * sniffer main loop as it is instead (snif_app.so, or snif_app_tl.so
+ * with -t: rc433snif.c built with IO_LOWPWR=1), the packets it takes
+ * tapped by sniftap.c. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+
+#include "sim.h"
+#include "simnode.h"
+#include "chan.h"
+#include "rc433.h"
+
+/* as in io.h of the transmitter */
+#define EV_ENC0 (1 << 1)
+#define EV_ENC1 (1 << 2)
+#define ENC_MIN0 -12
+#define ENC_MAX0 12
+#define ENC_MIN1 0
+#define ENC_MAX1 15
+
+/* periodic ticks per second, as in io.h */
+#define XMTR_TICK_HZ 8000
+#define SNIF_TICK_HZ 125
+
+/* the second pin of a step follows the first one */
+#define STEP_SKEW SIM_US(40)
+/* the last step of a turn to the check */
+#define SETTLE SIM_MS(500)
+
+struct io_duty {
+	uint32_t awake;
+	uint16_t down;
+	uint16_t tick_us;
+};
+
+struct node {
+	struct sim_link lnk;
+	void (* io_init)(void);
+	void (* io_sleep)(void);
+	void (* io_duty_get)(struct io_duty * duty);
+	/* tick vector */
+	int tick;
+	/* periodic tick rate */
+	double hz;
+	/* firmware main(), the sniffer application nodes only */
+	void (* main)(void);
+};
+
+struct pwr {
+	struct node tx;
+	struct node rx;
+	uint8_t (* io_events_get)(void);
+	int8_t (* io_encoder0_get)(void);
+	int8_t (* io_encoder1_get)(void);
+	void (* led_flash)(uint16_t itv);
+	struct chan rnd;
+	uint64_t itv;
+	uint32_t turn_max;
+	uint8_t copies;
+	bool mbox;
+	bool app;
+	/* transmitter application */
+	uint8_t dat[4];
+	uint8_t xmt;
+	/* event of the last command */
+	uint64_t t_cmd;
+	/* encoder pins, both encoders, as on PD2..PD5 */
+	uint8_t pins;
+	/* reference decoder */
+	uint8_t code[2];
+	int8_t q[2];
+	int8_t val[2];
+	/* turn in progress */
+	uint32_t turn;
+	int enc;
+	int steps;
+	/* last packet received */
+	uint8_t rcvd[4];
+	bool got;
+	/* counters */
+	uint32_t step_cnt;
+	uint32_t miscount;
+	uint32_t delivered;
+	uint32_t pkts;
+	uint32_t stale;
+	uint64_t stale_max;
+	uint64_t t_end;
+};
+
+static double rnd_range(struct pwr * p, double lo, double hi)
+{
+	return lo + (hi - lo) * chan_uniform(&p->rnd);
+}
+
+/* ---------------------------------------------------------------------
+ * Encoders
+ * ---------------------------------------------------------------------
+ */
+
+/* io.c: quadrature along 00 01 11 10, a detent at 00 and 11, decoded on
+   every pin change. A step is the two pins of an encoder going from 00 to
+   11 or back, up with the lower pin first. No acceleration. */
+static void ref_dec(struct pwr * p, int e)
+{
+	static const int8_t tab[16] = {
+		0, 1, -1, 0, -1, 0, 0, 1, 1, 0, 0, -1, 0, -1, 1, 0
+	};
+	uint8_t cur = (p->pins >> (2 * e)) & 0x03;
+	int8_t min = e ? ENC_MIN1 : ENC_MIN0;
+	int8_t max = e ? ENC_MAX1 : ENC_MAX0;
+
+	p->q[e] += tab[(p->code[e] << 2) | cur];
+	p->code[e] = cur;
+	if ((cur != 0x00) && (cur != 0x03))
+		return;
+
+	if ((p->q[e] >= 2) && (p->val[e] < max))
+		p->val[e]++;
+	else if ((p->q[e] <= -2) && (p->val[e] > min))
+		p->val[e]--;
+	p->q[e] = 0;
+}
+
+/* 'dat': encoder pin 0..3 of PD2..PD5 */
+static void pin_edge(void * arg, uintptr_t dat)
+{
+	struct pwr * p = arg;
+	int pin = dat & 3;
+
+	p->pins ^= 1 << pin;
+	sim_pin_set(p->tx.lnk.node, 'D', 2 + pin, (p->pins >> pin) & 1);
+	ref_dec(p, pin / 2);
+}
+
+static void turn_check(void * arg, uintptr_t dat);
+
+static void step(void * arg, uintptr_t dat)
+{
+	struct pwr * p = arg;
+	uint64_t t = sim_now();
+	int a = 2 * p->enc;
+	int b = a + 1;
+
+	(void)dat;
+	/* either pin first */
+	if (chan_uniform(&p->rnd) < 0.5) {
+		a++;
+		b--;
+	}
+	sim_at(t, pin_edge, p, a);
+	sim_at(t + STEP_SKEW, pin_edge, p, b);
+	p->step_cnt++;
+
+	if (--p->steps > 0)
+		sim_at(t + SIM_US(rnd_range(p, 10, 60) * 1000), step, p, 0);
+	else
+		sim_at(t + SETTLE, turn_check, p, 0);
+}
+
+static void turn_start(void * arg, uintptr_t dat)
+{
+	struct pwr * p = arg;
+
+	(void)dat;
+	p->enc = (chan_uniform(&p->rnd) < 0.5) ? 0 : 1;
+	p->steps = 1 + (int)(chan_uniform(&p->rnd) * 8);
+	step(p, 0);
+}
+
+static void turn_check(void * arg, uintptr_t dat)
+{
+	struct pwr * p = arg;
+	struct sim_node * node = p->tx.lnk.node;
+	int8_t v0 = SIM_CALL(node, p->io_encoder0_get());
+	int8_t v1 = SIM_CALL(node, p->io_encoder1_get());
+
+	(void)dat;
+	if ((v0 != p->val[0]) || (v1 != p->val[1])) {
+		p->miscount++;
+		p->val[0] = v0;
+		p->val[1] = v1;
+	}
+
+	if (p->got && ((int8_t)p->rcvd[2] == v0) && ((int8_t)p->rcvd[3] == v1))
+		p->delivered++;
+
+	if (++p->turn < p->turn_max) {
+		double ms = -(double)p->itv / SIM_MS(1) *
+			log1p(-chan_uniform(&p->rnd));
+
+		sim_at(sim_now() + SIM_US(ms * 1000), turn_start, p, 0);
+	} else {
+		p->t_end = sim_now();
+	}
+}
+
+/* ---------------------------------------------------------------------
+ * Nodes
+ * ---------------------------------------------------------------------
+ */
+
+static void tx_main(void * arg, struct sim_node * node)
+{
+	struct pwr * p = arg;
+	uint8_t ev = SIM_CALL(node, p->io_events_get());
+
+	if (ev & (EV_ENC0 | EV_ENC1)) {
+		p->dat[0] = RC433_SEQ_NEXT(p->dat[0]);
+		p->dat[1] = 1;
+		p->dat[2] = SIM_CALL(node, p->io_encoder0_get());
+		p->dat[3] = SIM_CALL(node, p->io_encoder1_get());
+		p->xmt = p->copies;
+		p->t_cmd = sim_now();
+		SIM_CALL_VOID(node, p->led_flash(100));
+	}
+
+	if (p->mbox) {
+		/* replaces the copies left of the previous command */
+		if (p->xmt)
+			SIM_CALL_VOID(node, p->tx.lnk.mbox_post(p->dat, p->xmt));
+		p->xmt = 0;
+	}
+
+	while (p->xmt && (SIM_CALL(node, p->tx.lnk.tx_pending()) < 2)) {
+		if (!SIM_CALL(node, p->tx.lnk.pkt_send(p->dat)))
+			break;
+		p->xmt--;
+	}
+
+	SIM_CALL_VOID(node, p->tx.io_sleep());
+}
+
+static void rx_pkt(void * arg, const uint8_t dat[])
+{
+	struct pwr * p = arg;
+
+	if (RC433_SEQ_GET(dat[0]) != RC433_SEQ_GET(p->dat[0])) {
+		uint64_t late = sim_now() - p->t_cmd;
+
+		p->stale++;
+		if (late > p->stale_max)
+			p->stale_max = late;
+	}
+	memcpy(p->rcvd, dat, 4);
+	p->got = true;
+	p->pkts++;
+}
+
+static void rx_main(void * arg, struct sim_node * node)
+{
+	struct pwr * p = arg;
+	uint8_t dat[4];
+
+	while (SIM_CALL(node, p->rx.lnk.pkt_recv(dat)))
+		rx_pkt(p, dat);
+
+	SIM_CALL_VOID(node, p->rx.io_sleep());
+}
+
+/* rc433snif.c, never returns */
+static void app_main(void * arg, struct sim_node * node)
+{
+	struct pwr * p = arg;
+
+	SIM_CALL_VOID(node, p->rx.main());
+}
+
+static void node_load(struct node * n, const char * argv0, const char * so,
+					  const char * name, int tick, double hz)
+{
+	sim_link_load(&n->lnk, argv0, so, name);
+	n->io_init = (void (*)(void))sim_node_sym(n->lnk.node, "io_init");
+	n->io_sleep = (void (*)(void))sim_node_sym(n->lnk.node, "io_sleep");
+	n->io_duty_get = (void (*)(struct io_duty *))
+		sim_node_sym(n->lnk.node, "io_duty_get");
+	n->main = (void (*)(void))sim_node_sym_find(n->lnk.node, "snif_main");
+	n->tick = tick;
+	n->hz = hz;
+}
+
+static void node_init(struct node * n)
+{
+	SIM_CALL_VOID(n->lnk.node, n->io_init());
+	sim_link_init(&n->lnk);
+}
+
+static void node_report(struct node * n, uint64_t wall)
+{
+	struct sim_node * node = n->lnk.node;
+	struct io_duty duty;
+	uint64_t downs;
+	uint64_t down = sim_node_down_time(node, &downs);
+	double s = (double)wall / SIM_PS_PER_S;
+	double fw;
+
+	SIM_CALL_VOID(node, n->io_duty_get(&duty));
+	fw = (double)duty.awake * duty.tick_us / 1e6;
+
+	printf("%-6s %7.3f %% %9.3f %% %8u %9.1f %9.1f\n",
+		   sim_node_name(node), 100.0 * (wall - down) / wall,
+		   100.0 * fw / s, duty.down,
+		   sim_isr_count(node, n->tick) / s, n->hz);
+	/* the firmware counts a power-down as it wakes up */
+	if (sim_node_down(node))
+		downs--;
+	if (duty.down != downs)
+		printf("%-6s %u power-downs counted, %llu simulated\n",
+			   sim_node_name(node), duty.down, (unsigned long long)downs);
+}
+
+static void usage(const char * prog)
+{
+	fprintf(stderr, "usage: %s [options]\n", prog);
+	fprintf(stderr, "  -n turns   encoder turns (100)\n");
+	fprintf(stderr, "  -i ms      mean time between turns (2000)\n");
+	fprintf(stderr, "  -r copies  packets sent per encoder event (3)\n");
+	fprintf(stderr, "  -m         post the copies to the mailbox\n");
+	fprintf(stderr, "  -s seed    random seed (1)\n");
+	fprintf(stderr, "  -t         tickless builds\n");
+	fprintf(stderr, "  -a         sniffer main loop (rc433snif.c)\n");
+	exit(2);
+}
+
+int main(int argc, char * argv[])
+{
+	struct chan_cfg cfg;
+	struct pwr p;
+	uint64_t seed = 1;
+	uint64_t wall;
+	bool tl = false;
+	int c;
+
+	memset(&p, 0, sizeof(p));
+	p.turn_max = 100;
+	p.itv = SIM_MS(2000);
+	p.copies = 3;
+
+	while ((c = getopt(argc, argv, "n:i:r:ms:tah")) != -1) {
+		switch (c) {
+		case 'n':
+			p.turn_max = strtoul(optarg, NULL, 0);
+			break;
+		case 'i':
+			p.itv = SIM_US(strtod(optarg, NULL) * 1000);
+			if (p.itv == 0)
+				usage(argv[0]);
+			break;
+		case 'r':
+			p.copies = strtoul(optarg, NULL, 0);
+			break;
+		case 'm':
+			p.mbox = true;
+			break;
+		case 's':
+			seed = strtoull(optarg, NULL, 0);
+			break;
+		case 't':
+			tl = true;
+			break;
+		case 'a':
+			p.app = true;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if ((p.turn_max == 0) || (p.copies == 0))
+		usage(argv[0]);
+
+	memset(&cfg, 0, sizeof(cfg));
+	chan_init(&p.rnd, &cfg, seed);
+
+	node_load(&p.tx, argv[0], tl ? "xmtr_tl.so" : "xmtr_pwr.so", "xmtr",
+			  SIM_TIMER0_COMPA_VECT, XMTR_TICK_HZ);
+	if (p.app)
+		node_load(&p.rx, argv[0], tl ? "snif_app_tl.so" : "snif_app.so",
+				  "snif", SIM_TIMER2_COMPA_VECT, SNIF_TICK_HZ);
+	else
+		node_load(&p.rx, argv[0], tl ? "snif_tl.so" : "snif_pwr.so", "snif",
+				  SIM_TIMER2_COMPA_VECT, SNIF_TICK_HZ);
+	p.io_events_get = (uint8_t (*)(void))
+		sim_node_sym(p.tx.lnk.node, "io_events_get");
+	p.io_encoder0_get = (int8_t (*)(void))
+		sim_node_sym(p.tx.lnk.node, "io_encoder0_get");
+	p.io_encoder1_get = (int8_t (*)(void))
+		sim_node_sym(p.tx.lnk.node, "io_encoder1_get");
+	p.led_flash = (void (*)(uint16_t))
+		sim_node_sym(p.tx.lnk.node, "led_flash");
+
+	/* pulled up: switches open, encoders at rest */
+	for (c = 0; c < 4; c++) {
+		sim_pin_set(p.tx.lnk.node, 'C', c, true);
+		sim_pin_set(p.tx.lnk.node, 'D', 2 + c, true);
+	}
+	p.pins = 0x0f;
+	p.code[0] = 0x03;
+	p.code[1] = 0x03;
+
+	sim_connect(p.tx.lnk.node, p.rx.lnk.node);
+	sim_node_main_set(p.tx.lnk.node, tx_main, &p);
+
+	node_init(&p.tx);
+	if (p.app) {
+		void (** hook)(void *, const uint8_t *) =
+			sim_node_sym(p.rx.lnk.node, "sim_pkt_hook");
+		void ** hook_arg = sim_node_sym(p.rx.lnk.node, "sim_pkt_arg");
+
+		/* main() sets the node up */
+		*hook = rx_pkt;
+		*hook_arg = &p;
+		sim_node_main_set(p.rx.lnk.node, app_main, &p);
+		sim_node_start(p.rx.lnk.node);
+	} else {
+		sim_node_main_set(p.rx.lnk.node, rx_main, &p);
+		node_init(&p.rx);
+	}
+	p.val[0] = SIM_CALL(p.tx.lnk.node, p.io_encoder0_get());
+	p.val[1] = SIM_CALL(p.tx.lnk.node, p.io_encoder1_get());
+
+	sim_at(SIM_MS(1000), turn_start, &p, 0);
+	/* the ticks stop once both nodes are down */
+	while (p.t_end == 0)
+		sim_run(sim_now() + SIM_MS(1000));
+	wall = sim_now();
+
+	printf("turns:     %u, %u steps, %u miscounted, %u delivered "
+		   "(%u packets)\n", p.turn_max, p.step_cnt, p.miscount,
+		   p.delivered, p.pkts);
+	printf("stale:     %u packets, %.1f ms after a newer command at most\n",
+		   p.stale, (double)p.stale_max / SIM_MS(1));
+	printf("node    awake (sim) awake (fw)    downs   ticks/s   "
+		   "always on\n");
+	node_report(&p.tx, wall);
+	node_report(&p.rx, wall);
+
+	return ((p.miscount == 0) && (p.delivered == p.turn_max)) ? 0 : 1;
+}
@@ -0,0 +1,420 @@
+/*
+ * Copyright(C) 2021 Robinson (Bob) Mittman. All Rights Reserved.
+ * Licensed under the MIT license.
+ * See LICENSE file in the project root for details.
+ *
+ */
+
+/* Loopback benchmark of the rc433 link layer.
+ *
+ * Loads the transmitter (rc433tx_uart.c, 16 MHz) and the receiver
+ * (rc433rx_uart.c, 8 MHz) as two simulated MCUs, wires TXD to RXD and
+ * streams numbered frames through them, 4 byte packets or variable
+ * length frames (-l). Reports the link throughput in simulated time, the
+ * simulation speed on the host, the preamble symbols the receiver saw
+ * before each frame and the number of ISR invocations per delivered
+ * frame. With -T the nodes built with RFLINK_TSTAMP are loaded and the
+ * latency of every stage is read back from them, next to the end to end
+ * latency seen by the simulator. With -P the nodes built with
+ * RFLINK_ISR_PROF are loaded and their ISR profile is checked against
+ * the invocations the simulator counted. The simulator runs an ISR in no
+ * time, so the cycles and the latency only mean something on the
+ * target. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "sim.h"
+#include "simnode.h"
+#include "rc433.h"
+
+struct bench {
+	struct sim_link tx;
+	struct sim_link rx;
+	unsigned int depth;
+	/* variable length frame payload, 0 for packets */
+	unsigned int len;
+	uint64_t itv;
+	/* copies of every packet */
+	unsigned int rep;
+	unsigned int copy;
+	/* preamble length, 0 for the default */
+	unsigned int pre;
+	/* latency: time each frame was due, end to end */
+	bool lat;
+	/* ISR profile */
+	bool prof;
+	uint64_t * t_due;
+	uint64_t e2e_min;
+	uint64_t e2e_max;
+	uint64_t e2e_sum;
+	uint32_t frm_max;
+	uint32_t sent;
+	uint32_t rcvd;
+	uint32_t lost;
+	uint32_t bad;
+	uint32_t next;
+	uint64_t t_first;
+	uint64_t t_last;
+};
+
+static void frm_make(uint8_t dat[], uint32_t n)
+{
+	dat[0] = (n << 5) & 0xe0;
+	dat[1] = n;
+	dat[2] = n >> 8;
+	dat[3] = n >> 16;
+}
+
+/* variable length frame: 3 byte frame number, then a pattern */
+static void var_make(uint8_t dat[], unsigned int len, uint32_t n)
+{
+	unsigned int i;
+
+	for (i = 0; i < len; i++)
+		dat[i] = n + i;
+	dat[0] = n;
+	dat[1] = n >> 8;
+	dat[2] = n >> 16;
+}
+
+static void tx_send(struct bench * b, struct sim_node * node)
+{
+	uint8_t dat[RFLINK_FRM_MAX];
+	uint32_t n;
+	int8_t ret;
+
+	while (((b->sent < b->frm_max) || (b->copy != 0)) &&
+		   (SIM_CALL(node, b->tx.tx_pending()) < b->depth)) {
+		/* frame number, the copies of a packet keep it */
+		n = (b->copy != 0) ? b->sent - 1 : b->sent;
+		if (b->lat && (b->copy == 0))
+			SIM_CALL_VOID(node, b->tx.tx_mark(b->tx.tstamp()));
+		if (b->len) {
+			var_make(dat, b->len, n);
+			ret = SIM_CALL(node, b->tx.frm_send(dat, b->len));
+		} else {
+			frm_make(dat, n);
+			ret = SIM_CALL(node, b->tx.pkt_send(dat));
+		}
+		if (ret <= 0)
+			break;
+		if (b->sent == 0)
+			b->t_first = sim_now();
+		if (b->lat && (b->copy == 0))
+			b->t_due[n] = sim_now();
+		if (b->copy == 0)
+			b->sent++;
+		if (++b->copy < b->rep)
+			continue;
+		b->copy = 0;
+		if (b->itv)
+			break;
+	}
+}
+
+static void tx_main(void * arg, struct sim_node * node)
+{
+	struct bench * b = arg;
+
+	if (b->itv == 0)
+		tx_send(b, node);
+}
+
+/* paced mode: one frame every 'itv' */
+static void tx_tick(void * arg, uintptr_t dat)
+{
+	struct bench * b = arg;
+
+	tx_send(b, b->tx.node);
+	if ((b->sent < b->frm_max) || (b->copy != 0))
+		sim_at(sim_now() + b->itv, tx_tick, b, 0);
+}
+
+static void rx_main(void * arg, struct sim_node * node)
+{
+	struct bench * b = arg;
+	uint8_t dat[RFLINK_FRM_MAX];
+	uint8_t ref[RFLINK_FRM_MAX];
+	uint32_t n;
+	int8_t len;
+
+	while ((len = SIM_CALL(node, b->rx.frm_recv(dat))) > 0) {
+		if (b->len) {
+			n = dat[0] | ((uint32_t)dat[1] << 8) | ((uint32_t)dat[2] << 16);
+			var_make(ref, b->len, n);
+		} else {
+			n = dat[1] | ((uint32_t)dat[2] << 8) | ((uint32_t)dat[3] << 16);
+			frm_make(ref, n);
+		}
+		if ((len != (b->len ? b->len : 4)) || (memcmp(dat, ref, len) != 0) ||
+			(n >= b->sent) || (n < b->next)) {
+			b->bad++;
+			continue;
+		}
+		b->lost += n - b->next;
+		b->next = n + 1;
+		b->rcvd++;
+		b->t_last = sim_now();
+		if (b->lat) {
+			uint64_t d = b->t_last - b->t_due[n];
+
+			if ((b->e2e_max == 0) || (d < b->e2e_min))
+				b->e2e_min = d;
+			if (d > b->e2e_max)
+				b->e2e_max = d;
+			b->e2e_sum += d;
+		}
+	}
+}
+
+/* one stage: count, min avg max and the histogram, in us */
+static void lat_print(const char * name, const struct rc433_lat * l,
+					  uint16_t tick_ns)
+{
+	double us = tick_ns / 1000.0;
+	unsigned int i;
+
+	printf("  %-6s %6u %10.1f %10.1f %10.1f\n", name, l->cnt,
+		   l->min * us, l->cnt ? (double)l->sum / l->cnt * us : 0.0,
+		   l->max * us);
+	printf("        ");
+	for (i = 0; i < RC433_LAT_BINS; i++) {
+		if (l->hist[i])
+			printf(" <%.0f:%u", (1u << i) * us, l->hist[i]);
+	}
+	printf("\n");
+}
+
+/* Simulator vectors counted in one profile entry */
+static const int prof_vect[RC433_ISR_NUM][3] = {
+	[RC433_ISR_RX] = { SIM_USART_RX_VECT },
+	[RC433_ISR_UDRE] = { SIM_USART_UDRE_VECT },
+	[RC433_ISR_TXC] = { SIM_USART_TX_VECT },
+	[RC433_ISR_TMR0] = { SIM_TIMER0_COMPA_VECT },
+	[RC433_ISR_TMR2] = { SIM_TIMER2_COMPA_VECT },
+	[RC433_ISR_PCINT] = { SIM_PCINT0_VECT, SIM_PCINT1_VECT, SIM_PCINT2_VECT }
+};
+
+static const char * const prof_name[RC433_ISR_NUM] = {
+	[RC433_ISR_RX] = "USART_RX",
+	[RC433_ISR_UDRE] = "USART_UDRE",
+	[RC433_ISR_TXC] = "USART_TX",
+	[RC433_ISR_TMR0] = "TIMER0_COMPA",
+	[RC433_ISR_TMR2] = "TIMER2_COMPA",
+	[RC433_ISR_PCINT] = "PCINT"
+};
+
+/* The profile of one node, returns the entries that disagree with the
+   simulator count */
+static unsigned int prof_print(struct sim_link * lnk)
+{
+	struct rc433_isr_prof p;
+	unsigned int bad = 0;
+	unsigned int i;
+	unsigned int j;
+
+	SIM_CALL_VOID(lnk->node, lnk->isr_prof_get(&p, 0));
+
+	for (i = 0; i < RC433_ISR_NUM; i++) {
+		const struct rc433_isr * r = &p.isr[i];
+		uint64_t n = 0;
+
+		for (j = 0; (j < 3) && prof_vect[i][j]; j++)
+			n += sim_isr_count(lnk->node, prof_vect[i][j]);
+		if ((r->cnt == 0) && (n == 0))
+			continue;
+
+		printf("  %-6s %-13s %8u %8llu %8.1f %6u %6u%s\n",
+			   sim_node_name(lnk->node), prof_name[i], r->cnt,
+			   (unsigned long long)n,
+			   r->cnt ? (double)r->sum / r->cnt : 0.0, r->max, r->lat,
+			   (r->cnt == n) ? "" : "  mismatch");
+		if (r->cnt != n)
+			bad++;
+	}
+
+	return bad;
+}
+
+static void usage(const char * prog)
+{
+	fprintf(stderr, "usage: %s [-n frames] [-d depth] [-i ms] [-l len] "
+			"[-r copies] [-p len] [-T|-P]\n",
+			prog);
+	fprintf(stderr, "  -n frames  number of frames to send (1000)\n");
+	fprintf(stderr, "  -d depth   frames kept queued on the transmitter (4)\n");
+	fprintf(stderr, "  -i ms      send one frame every 'ms' instead of "
+			"back-to-back\n");
+	fprintf(stderr, "  -l len     variable length frames of 'len' bytes "
+			"(1..%d)\n", RFLINK_FRM_MAX);
+	fprintf(stderr, "  -r copies  send every packet 'copies' times (1)\n");
+	fprintf(stderr, "  -p len     preamble length, %d..%d (%d)\n",
+			RC433_PRE_MIN, RC433_PRE_MAX, RC433_PRE_MAX);
+	fprintf(stderr, "  -T         latency of every stage (RFLINK_TSTAMP "
+			"nodes)\n");
+	fprintf(stderr, "  -P         ISR profile (RFLINK_ISR_PROF nodes)\n");
+	exit(2);
+}
+
+int main(int argc, char * argv[])
+{
+	struct bench b;
+	struct rc433_rx_stat st;
+	struct timespec t0;
+	struct timespec t1;
+	double host;
+	double link;
+	uint64_t ev;
+	unsigned int i;
+	int vect;
+	int c;
+
+	memset(&b, 0, sizeof(b));
+	b.frm_max = 1000;
+	b.depth = 4;
+	b.rep = 1;
+
+	while ((c = getopt(argc, argv, "n:d:i:l:r:p:TPh")) != -1) {
+		switch (c) {
+		case 'n':
+			b.frm_max = strtoul(optarg, NULL, 0);
+			break;
+		case 'd':
+			b.depth = strtoul(optarg, NULL, 0);
+			break;
+		case 'i':
+			b.itv = SIM_US(strtod(optarg, NULL) * 1000);
+			break;
+		case 'l':
+			b.len = strtoul(optarg, NULL, 0);
+			if ((b.len == 0) || (b.len > RFLINK_FRM_MAX))
+				usage(argv[0]);
+			break;
+		case 'r':
+			b.rep = strtoul(optarg, NULL, 0);
+			if (b.rep == 0)
+				usage(argv[0]);
+			break;
+		case 'p':
+			b.pre = strtoul(optarg, NULL, 0);
+			if ((b.pre < RC433_PRE_MIN) || (b.pre > RC433_PRE_MAX))
+				usage(argv[0]);
+			break;
+		case 'T':
+			b.lat = true;
+			break;
+		case 'P':
+			b.prof = true;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	/* both need Timer1 */
+	if ((b.len && (b.rep > 1)) || (b.lat && b.prof))
+		usage(argv[0]);
+
+	sim_link_load(&b.tx, argv[0], b.lat ? "xmtr_ts.so" :
+				  b.prof ? "xmtr_prof.so" : "xmtr_link.so", "xmtr");
+	sim_link_load(&b.rx, argv[0], b.lat ? "snif_ts.so" :
+				  b.prof ? "snif_prof.so" : "snif_link.so", "snif");
+	if (b.lat) {
+		if ((b.tx.tx_lat_get == NULL) || (b.rx.rx_lat_get == NULL)) {
+			fprintf(stderr, "nodes built without RFLINK_TSTAMP\n");
+			return 1;
+		}
+		b.t_due = calloc(b.frm_max, sizeof(uint64_t));
+	}
+	if (b.prof &&
+		((b.tx.isr_prof_get == NULL) || (b.rx.isr_prof_get == NULL))) {
+		fprintf(stderr, "nodes built without RFLINK_ISR_PROF\n");
+		return 1;
+	}
+
+	sim_connect(b.tx.node, b.rx.node);
+	sim_node_main_set(b.tx.node, tx_main, &b);
+	sim_node_main_set(b.rx.node, rx_main, &b);
+
+	sim_link_init(&b.tx);
+	sim_link_init(&b.rx);
+
+	if (b.pre)
+		SIM_CALL(b.tx.node, b.tx.preamble_set(b.pre));
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	if (b.itv)
+		tx_tick(&b, 0);
+	else
+		tx_main(&b, b.tx.node);
+	ev = sim_run(UINT64_MAX);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	SIM_CALL_VOID(b.rx.node, b.rx.rx_stat_get(&st));
+
+	host = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+	link = (double)(b.t_last - b.t_first) / SIM_PS_PER_S;
+
+	printf("frames:   %u sent, %u received, %u lost, %u bad\n",
+		   b.sent, b.rcvd, b.lost + (b.sent - b.next), b.bad);
+	printf("receiver: %u overrun, %u crc, %u symbol, %u duplicate\n",
+		   st.ovr, st.err, st.sym, st.dup);
+	printf("preamble:");
+	for (i = 0; i < RC433_ACQ_LEN; i++) {
+		if (st.acq[i])
+			printf(" %u%s:%u", i + 1, (i + 1 == RC433_ACQ_LEN) ? "+" : "",
+				   st.acq[i]);
+	}
+	printf(" (symbols seen: frames)\n");
+	printf("link:     %.3f s simulated, %.2f frames/s, %.1f payload bytes/s\n",
+		   link, link > 0 ? b.rcvd / link : 0.0,
+		   link > 0 ? (b.len ? b.len : 4) * b.rcvd / link : 0.0);
+	printf("host:     %.3f s, %llu events, %.0f frames/s\n", host,
+		   (unsigned long long)ev, host > 0 ? b.rcvd / host : 0.0);
+	if (b.lat) {
+		struct rc433_tx_lat tl;
+		struct rc433_rx_lat rl;
+
+		SIM_CALL_VOID(b.tx.node, b.tx.tx_lat_get(&tl));
+		SIM_CALL_VOID(b.rx.node, b.rx.rx_lat_get(&rl));
+		printf("latency (us):   frames        min        avg        max\n");
+		printf(" %s\n", sim_node_name(b.tx.node));
+		lat_print("app", &tl.app, tl.tick_ns);
+		lat_print("queue", &tl.queue, tl.tick_ns);
+		lat_print("air", &tl.air, tl.tick_ns);
+		printf(" %s\n", sim_node_name(b.rx.node));
+		lat_print("air", &rl.air, rl.tick_ns);
+		lat_print("recv", &rl.deliver, rl.tick_ns);
+		printf(" end to end\n");
+		printf("  %-6s %6u %10.1f %10.1f %10.1f\n", "sim", b.rcvd,
+			   (double)b.e2e_min / SIM_US(1),
+			   b.rcvd ? (double)b.e2e_sum / b.rcvd / SIM_US(1) : 0.0,
+			   (double)b.e2e_max / SIM_US(1));
+	}
+	printf("ISR invocations per frame:\n");
+	for (vect = 1; vect < SIM_VECT_CNT; vect++) {
+		uint64_t n;
+
+		if ((n = sim_isr_count(b.tx.node, vect)) != 0)
+			printf("  %-6s %-18s %8.2f\n", sim_node_name(b.tx.node),
+				   sim_vect_name(vect), b.rcvd ? (double)n / b.rcvd : 0.0);
+		if ((n = sim_isr_count(b.rx.node, vect)) != 0)
+			printf("  %-6s %-18s %8.2f\n", sim_node_name(b.rx.node),
+				   sim_vect_name(vect), b.rcvd ? (double)n / b.rcvd : 0.0);
+	}
+	if (b.prof) {
+		unsigned int bad;
+
+		printf("ISR profile:              calls      sim  avg cyc    max    lat\n");
+		bad = prof_print(&b.tx);
+		bad += prof_print(&b.rx);
+		if (bad)
+			return 1;
+	}
+
+	return (b.rcvd == b.sent) ? 0 : 1;
+}
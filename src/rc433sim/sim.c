@@ -0,0 +1,1237 @@
+/*
+ * Copyright(C) 2021 Robinson (Bob) Mittman. All Rights Reserved.
+ * Licensed under the MIT license.
+ * See LICENSE file in the project root for details.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dlfcn.h>
+#include <ucontext.h>
+
+#include "sim.h"
+
+/* register bits, as in the host <avr/io.h> */
+#define RXC0    7
+#define TXC0    6
+#define UDRE0   5
+#define FE0     4
+#define DOR0    3
+#define U2X0    1
+#define MPCM0   0
+#define RXCIE0  7
+#define TXCIE0  6
+#define UDRIE0  5
+#define RXEN0   4
+#define TXEN0   3
+#define UCSZ02  2
+#define UPM01   5
+#define USBS0   3
+#define UCSZ00  1
+#define SM1     2
+#define SE      0
+
+#define SIM_NODE_MAX 8
+#define SIM_DISPATCH_MAX 10000
+/* stack of the main context of a node */
+#define SIM_STACK_SIZE (256 * 1024)
+
+static const char * const vect_name[SIM_VECT_CNT] = {
+	[SIM_INT0_VECT] = "INT0_vect",
+	[SIM_INT1_VECT] = "INT1_vect",
+	[SIM_PCINT0_VECT] = "PCINT0_vect",
+	[SIM_PCINT1_VECT] = "PCINT1_vect",
+	[SIM_PCINT2_VECT] = "PCINT2_vect",
+	[SIM_WDT_VECT] = "WDT_vect",
+	[SIM_TIMER2_COMPA_VECT] = "TIMER2_COMPA_vect",
+	[SIM_TIMER2_COMPB_VECT] = "TIMER2_COMPB_vect",
+	[SIM_TIMER2_OVF_VECT] = "TIMER2_OVF_vect",
+	[SIM_TIMER1_CAPT_VECT] = "TIMER1_CAPT_vect",
+	[SIM_TIMER1_COMPA_VECT] = "TIMER1_COMPA_vect",
+	[SIM_TIMER1_COMPB_VECT] = "TIMER1_COMPB_vect",
+	[SIM_TIMER1_OVF_VECT] = "TIMER1_OVF_vect",
+	[SIM_TIMER0_COMPA_VECT] = "TIMER0_COMPA_vect",
+	[SIM_TIMER0_COMPB_VECT] = "TIMER0_COMPB_vect",
+	[SIM_TIMER0_OVF_VECT] = "TIMER0_OVF_vect",
+	[SIM_SPI_STC_VECT] = "SPI_STC_vect",
+	[SIM_USART_RX_VECT] = "USART_RX_vect",
+	[SIM_USART_UDRE_VECT] = "USART_UDRE_vect",
+	[SIM_USART_TX_VECT] = "USART_TX_vect",
+};
+
+/* ---------------------------------------------------------------------
+ * Event queue
+ * ---------------------------------------------------------------------
+ */
+
+struct sim_ev {
+	uint64_t t;
+	uint64_t seq;
+	sim_event_t fn;
+	void * arg;
+	uintptr_t dat;
+};
+
+static struct {
+	uint64_t now;
+	uint64_t seq;
+	unsigned int cnt;
+	unsigned int max;
+	struct sim_ev * heap;
+	unsigned int node_cnt;
+	struct sim_node * node[SIM_NODE_MAX];
+	/* event loop, while 'cur' runs its main context */
+	ucontext_t ctx;
+	struct sim_node * cur;
+} sim;
+
+static inline bool ev_before(const struct sim_ev * a, const struct sim_ev * b)
+{
+	return (a->t < b->t) || ((a->t == b->t) && (a->seq < b->seq));
+}
+
+void sim_at(uint64_t t, sim_event_t fn, void * arg, uintptr_t dat)
+{
+	struct sim_ev ev;
+	unsigned int i;
+
+	if (sim.cnt == sim.max) {
+		sim.max = sim.max ? 2 * sim.max : 64;
+		sim.heap = realloc(sim.heap, sim.max * sizeof(struct sim_ev));
+		if (sim.heap == NULL) {
+			fprintf(stderr, "sim: out of memory\n");
+			exit(1);
+		}
+	}
+
+	ev.t = (t < sim.now) ? sim.now : t;
+	ev.seq = sim.seq++;
+	ev.fn = fn;
+	ev.arg = arg;
+	ev.dat = dat;
+
+	/* sift up */
+	for (i = sim.cnt++; i > 0; ) {
+		unsigned int p = (i - 1) / 2;
+		if (!ev_before(&ev, &sim.heap[p]))
+			break;
+		sim.heap[i] = sim.heap[p];
+		i = p;
+	}
+	sim.heap[i] = ev;
+}
+
+static struct sim_ev ev_pop(void)
+{
+	struct sim_ev top = sim.heap[0];
+	struct sim_ev last = sim.heap[--sim.cnt];
+	unsigned int i = 0;
+
+	/* sift down */
+	for (;;) {
+		unsigned int c = 2 * i + 1;
+		if (c >= sim.cnt)
+			break;
+		if ((c + 1 < sim.cnt) && ev_before(&sim.heap[c + 1], &sim.heap[c]))
+			c++;
+		if (!ev_before(&sim.heap[c], &last))
+			break;
+		sim.heap[i] = sim.heap[c];
+		i = c;
+	}
+	if (sim.cnt)
+		sim.heap[i] = last;
+
+	return top;
+}
+
+uint64_t sim_now(void)
+{
+	return sim.now;
+}
+
+/* ---------------------------------------------------------------------
+ * Nodes
+ * ---------------------------------------------------------------------
+ */
+
+struct sim_tmr {
+	uint8_t id;
+	/* prescaler, 0 if stopped */
+	uint16_t presc;
+	/* counter value at 't_ref' */
+	uint32_t cnt_ref;
+	uint64_t t_ref;
+	/* invalidates scheduled events */
+	uint32_t gen;
+	/* shadow of the control registers */
+	uint8_t tccra;
+	uint8_t tccrb;
+	uint16_t ocra;
+	uint16_t ocrb;
+	uint8_t timsk;
+};
+
+struct sim_node {
+	const char * name;
+	void * dl;
+	struct sim_io * io;
+	unsigned long f_cpu;
+	int32_t ppm;
+	/* OSCCAL applied to the clock */
+	uint8_t osccal;
+	void (* vect[SIM_VECT_CNT])(void);
+	uint64_t isr_cnt[SIM_VECT_CNT];
+
+	sim_main_t main;
+	void * main_arg;
+	bool woken;
+	int depth;
+	/* main context, started on the first wake-up */
+	ucontext_t ctx;
+	void * stack;
+	/* the last main call went to sleep */
+	bool slept;
+
+	/* powered down since 't_down' */
+	bool down;
+	uint64_t t_down;
+	uint64_t down_ps;
+	uint64_t down_cnt;
+
+	struct {
+		bool busy;
+		bool full;
+		uint8_t shift;
+		uint8_t buf;
+		sim_line_t line;
+		void * line_arg;
+	} utx;
+
+	struct {
+		/* two level receive FIFO */
+		uint8_t cnt;
+		uint8_t dat[2];
+		bool fe[2];
+	} urx;
+
+	struct sim_tmr tmr[3];
+
+	/* register values loaded before the last firmware call */
+	struct {
+		uint8_t ucsr0a;
+		uint8_t pcifr;
+		uint8_t eifr;
+		uint8_t tifr[3];
+		uint16_t tcnt[3];
+	} ld;
+};
+
+/* A tagged register was written if the tag is gone, or if a read-modify-
+   write changed its value. */
+static inline bool reg_written(uint32_t v, uint32_t ld, uint32_t msk)
+{
+	return ((v & SIM_TAG) == 0) || ((v & msk) != ld);
+}
+
+/* write-one-to-clear flag register */
+static inline uint32_t reg_w1c(uint32_t v, uint8_t ld)
+{
+	if (reg_written(v, ld, 0xff))
+		return ld & ~(v & 0xff);
+	return ld;
+}
+
+/* clock error, OSCCAL included */
+static int32_t node_ppm(struct sim_node * node)
+{
+	return node->ppm +
+		((int32_t)node->osccal - SIM_OSCCAL_RST) * SIM_OSCCAL_PPM;
+}
+
+static uint64_t node_cycle_ps(struct sim_node * node, uint64_t cycles)
+{
+	long double f = (long double)node->f_cpu *
+		(1.0L + (long double)node_ppm(node) / 1e6L);
+
+	return (uint64_t)(((long double)cycles * SIM_PS_PER_S) / f + 0.5L);
+}
+
+/* ---------------------------------------------------------------------
+ * Timers
+ * ---------------------------------------------------------------------
+ */
+
+static const uint16_t tmr0_presc[8] = { 0, 1, 8, 64, 256, 1024, 0, 0 };
+static const uint16_t tmr2_presc[8] = { 0, 1, 8, 32, 64, 128, 256, 1024 };
+
+static void tmr_regs_get(struct sim_node * node, struct sim_tmr * tmr,
+						 uint8_t * tccra, uint8_t * tccrb,
+						 uint16_t * ocra, uint16_t * ocrb,
+						 uint8_t * timsk, uint32_t ** tcnt,
+						 uint32_t ** tifr)
+{
+	struct sim_io * io = node->io;
+
+	switch (tmr->id) {
+	case 0:
+		*tccra = io->tccr0a;
+		*tccrb = io->tccr0b;
+		*ocra = io->ocr0a;
+		*ocrb = io->ocr0b;
+		*timsk = io->timsk0;
+		*tcnt = &io->tcnt0;
+		*tifr = &io->tifr0;
+		break;
+	case 1:
+		*tccra = io->tccr1a;
+		*tccrb = io->tccr1b;
+		*ocra = io->ocr1a;
+		*ocrb = io->ocr1b;
+		*timsk = io->timsk1;
+		*tcnt = &io->tcnt1;
+		*tifr = &io->tifr1;
+		break;
+	default:
+		*tccra = io->tccr2a;
+		*tccrb = io->tccr2b;
+		*ocra = io->ocr2a;
+		*ocrb = io->ocr2b;
+		*timsk = io->timsk2;
+		*tcnt = &io->tcnt2;
+		*tifr = &io->tifr2;
+		break;
+	}
+}
+
+/* counter top in the current mode: CTC or normal */
+static uint32_t tmr_top(struct sim_tmr * tmr)
+{
+	if (tmr->id == 1) {
+		if (tmr->tccrb & (1 << 3)) /* WGM12 */
+			return tmr->ocra;
+		return 0xffff;
+	}
+	if ((tmr->tccra & 0x03) == 0x02) /* WGMx1 */
+		return tmr->ocra;
+	return 0xff;
+}
+
+static uint32_t tmr_max(struct sim_tmr * tmr)
+{
+	return (tmr->id == 1) ? 0xffff : 0xff;
+}
+
+static uint64_t tmr_tick_ps(struct sim_node * node, struct sim_tmr * tmr)
+{
+	return node_cycle_ps(node, tmr->presc);
+}
+
+/* advance a counter by 'n' ticks */
+static uint32_t tmr_advance(struct sim_tmr * tmr, uint32_t cnt, uint64_t n)
+{
+	uint32_t top = tmr_top(tmr);
+	uint32_t max = tmr_max(tmr);
+
+	if (cnt > top) {
+		/* past top, runs up to max first */
+		if (n <= max - cnt)
+			return cnt + n;
+		n -= max - cnt + 1;
+		cnt = 0;
+	}
+
+	return (cnt + n) % ((uint64_t)top + 1);
+}
+
+static uint64_t tmr_ticks(struct sim_node * node, struct sim_tmr * tmr)
+{
+	if (tmr->presc == 0)
+		return 0;
+	return (sim.now - tmr->t_ref) / tmr_tick_ps(node, tmr);
+}
+
+static uint32_t tmr_cnt(struct sim_node * node, struct sim_tmr * tmr)
+{
+	return tmr_advance(tmr, tmr->cnt_ref, tmr_ticks(node, tmr));
+}
+
+/* ticks from 'cnt' until the counter next enters 'val' */
+static uint64_t tmr_dist(struct sim_tmr * tmr, uint32_t cnt, uint32_t val)
+{
+	uint32_t top = tmr_top(tmr);
+	uint32_t max = tmr_max(tmr);
+	uint64_t d;
+
+	if (cnt > top) {
+		if (val > cnt)
+			return val - cnt;
+		d = max - cnt + 1;
+		cnt = 0;
+		if (val > top)
+			return d + max + 1; /* never, in practice */
+		return d + val;
+	}
+
+	if (val > top)
+		return UINT64_MAX;
+
+	if (val > cnt)
+		return val - cnt;
+
+	return (uint64_t)top + 1 - cnt + val;
+}
+
+static void tmr_event(void * arg, uintptr_t dat);
+
+static void tmr_sched(struct sim_node * node, struct sim_tmr * tmr)
+{
+	uint64_t k;
+	uint64_t d;
+	uint64_t dd;
+	uint32_t cnt;
+
+	tmr->gen++;
+
+	if (tmr->presc == 0)
+		return;
+
+	k = tmr_ticks(node, tmr);
+	cnt = tmr_advance(tmr, tmr->cnt_ref, k);
+
+	d = UINT64_MAX;
+	if (tmr->timsk & (1 << 1))
+		d = tmr_dist(tmr, cnt, tmr->ocra);
+	if ((tmr->timsk & (1 << 2)) &&
+		((dd = tmr_dist(tmr, cnt, tmr->ocrb)) < d))
+		d = dd;
+	if ((tmr->timsk & (1 << 0)) && (tmr_top(tmr) == tmr_max(tmr)) &&
+		((dd = tmr_dist(tmr, cnt, 0)) < d))
+		d = dd;
+
+	if (d == UINT64_MAX)
+		return;
+
+	sim_at(tmr->t_ref + (k + d) * tmr_tick_ps(node, tmr), tmr_event,
+		   node, ((uintptr_t)tmr->gen << 2) | tmr->id);
+}
+
+static void node_dispatch(struct sim_node * node);
+
+static void tmr_event(void * arg, uintptr_t dat)
+{
+	struct sim_node * node = arg;
+	struct sim_tmr * tmr = &node->tmr[dat & 3];
+	uint8_t tccra, tccrb, timsk;
+	uint16_t ocra, ocrb;
+	uint32_t * tcnt;
+	uint32_t * tifr;
+	uint32_t cnt;
+	uint32_t flags = 0;
+
+	if ((uint32_t)(dat >> 2) != tmr->gen)
+		return;
+
+	tmr_regs_get(node, tmr, &tccra, &tccrb, &ocra, &ocrb, &timsk,
+				 &tcnt, &tifr);
+
+	cnt = tmr_cnt(node, tmr);
+	if (cnt == tmr->ocra)
+		flags |= (1 << 1);
+	if (cnt == tmr->ocrb)
+		flags |= (1 << 2);
+	if ((cnt == 0) && (tmr_top(tmr) == tmr_max(tmr)))
+		flags |= (1 << 0);
+
+	*tifr = (*tifr | flags) & 0xff;
+
+	tmr_sched(node, tmr);
+	node_dispatch(node);
+}
+
+static void tmr_presc_set(struct sim_tmr * tmr, uint8_t tccrb)
+{
+	uint8_t cs = tccrb & 0x07;
+
+	if (tmr->id == 2)
+		tmr->presc = tmr2_presc[cs];
+	else
+		tmr->presc = tmr0_presc[cs];
+}
+
+/* pick up firmware writes to the timer registers */
+static void tmr_sync(struct sim_node * node, struct sim_tmr * tmr)
+{
+	uint8_t tccra, tccrb, timsk;
+	uint16_t ocra, ocrb;
+	uint32_t * tcnt;
+	uint32_t * tifr;
+	bool resched = false;
+	uint64_t t_ref = sim.now;
+	uint64_t k;
+	uint32_t cnt;
+
+	tmr_regs_get(node, tmr, &tccra, &tccrb, &ocra, &ocrb, &timsk,
+				 &tcnt, &tifr);
+
+	if (reg_written(*tcnt, node->ld.tcnt[tmr->id], tmr_max(tmr))) {
+		/* counter written */
+		cnt = *tcnt & tmr_max(tmr);
+		resched = true;
+	} else {
+		/* the prescaler keeps counting: anchor at the last count */
+		k = tmr_ticks(node, tmr);
+		cnt = tmr_advance(tmr, tmr->cnt_ref, k);
+		if ((tmr->presc != 0) && ((tccrb & 0x07) == (tmr->tccrb & 0x07)))
+			t_ref = tmr->t_ref + k * tmr_tick_ps(node, tmr);
+	}
+
+	if ((tccra != tmr->tccra) || ((tccrb & 0x1f) != (tmr->tccrb & 0x1f)) ||
+		(ocra != tmr->ocra) || (ocrb != tmr->ocrb) || (timsk != tmr->timsk))
+		resched = true;
+
+	*tifr = reg_w1c(*tifr, node->ld.tifr[tmr->id]);
+
+	if (resched) {
+		tmr->cnt_ref = cnt;
+		tmr->t_ref = t_ref;
+		tmr->tccra = tccra;
+		tmr->tccrb = tccrb;
+		tmr->ocra = ocra;
+		tmr->ocrb = ocrb;
+		tmr->timsk = timsk;
+		tmr_presc_set(tmr, tccrb);
+		tmr_sched(node, tmr);
+	}
+}
+
+/* ---------------------------------------------------------------------
+ * USART
+ * ---------------------------------------------------------------------
+ */
+
+uint64_t sim_usart_bit_time(struct sim_node * node)
+{
+	struct sim_io * io = node->io;
+	uint32_t div = (io->ucsr0a & (1 << U2X0)) ? 8 : 16;
+
+	return node_cycle_ps(node, (uint64_t)div * ((io->ubrr0 & 0x0fff) + 1));
+}
+
+static unsigned int usart_frame_bits(struct sim_node * node)
+{
+	struct sim_io * io = node->io;
+	unsigned int bits;
+
+	bits = 1 + 5 + ((io->ucsr0c >> UCSZ00) & 3);
+	if (io->ucsr0b & (1 << UCSZ02))
+		bits = 1 + 9;
+	if (io->ucsr0c & (1 << UPM01))
+		bits++;
+	bits += (io->ucsr0c & (1 << USBS0)) ? 2 : 1;
+
+	return bits;
+}
+
+static void usart_tx_done(void * arg, uintptr_t dat);
+
+static void usart_tx_start(struct sim_node * node, uint8_t c)
+{
+	uint64_t t = sim.now;
+
+	node->utx.busy = true;
+	node->utx.shift = c;
+	node->io->ucsr0a &= ~(1 << TXC0);
+	sim_at(t + usart_frame_bits(node) * sim_usart_bit_time(node),
+		   usart_tx_done, node, t);
+}
+
+static void usart_tx_done(void * arg, uintptr_t dat)
+{
+	struct sim_node * node = arg;
+
+	if (node->utx.line)
+		node->utx.line(node->utx.line_arg, node, node->utx.shift,
+					   (uint64_t)dat, sim.now);
+
+	if (node->utx.full) {
+		node->utx.full = false;
+		node->io->ucsr0a |= (1 << UDRE0);
+		usart_tx_start(node, node->utx.buf);
+	} else {
+		node->utx.busy = false;
+		node->io->ucsr0a |= (1 << TXC0);
+	}
+
+	node_dispatch(node);
+}
+
+bool sim_usart_txd(struct sim_node * node)
+{
+	if (node->io->ucsr0b & (1 << TXEN0))
+		return true;
+	return (node->io->portd & (1 << 1)) != 0;
+}
+
+void sim_usart_rx(struct sim_node * node, uint8_t c, bool fe)
+{
+	struct sim_io * io = node->io;
+
+	if ((io->ucsr0b & (1 << RXEN0)) == 0)
+		return;
+
+	if (node->down) {
+		/* the USART is not clocked, the start bit only makes an edge
+		   on RXD */
+		if (io->pcmsk2 & (1 << 0)) {
+			io->pcifr |= (1 << 2);
+			node_dispatch(node);
+		}
+		return;
+	}
+
+	if (node->urx.cnt == 2) {
+		/* data overrun: the character is lost */
+		io->ucsr0a |= (1 << DOR0);
+		return;
+	}
+
+	node->urx.dat[node->urx.cnt] = c;
+	node->urx.fe[node->urx.cnt] = fe;
+	node->urx.cnt++;
+	if (node->urx.fe[0])
+		io->ucsr0a |= (1 << FE0);
+	else
+		io->ucsr0a &= ~(1 << FE0);
+	io->ucsr0a |= (1 << RXC0);
+
+	node_dispatch(node);
+}
+
+void sim_pin_set(struct sim_node * node, char port, int bit, bool level)
+{
+	struct sim_io * io = node->io;
+	uint8_t * pin;
+	uint8_t msk;
+	int n;
+
+	switch (port) {
+	case 'B':
+		pin = &io->pinb;
+		msk = io->pcmsk0;
+		n = 0;
+		break;
+	case 'C':
+		pin = &io->pinc;
+		msk = io->pcmsk1;
+		n = 1;
+		break;
+	case 'D':
+		pin = &io->pind;
+		msk = io->pcmsk2;
+		n = 2;
+		break;
+	default:
+		fprintf(stderr, "sim: %s: no port %c\n", node->name, port);
+		exit(1);
+	}
+
+	if (((*pin >> bit) & 1) == level)
+		return;
+
+	*pin ^= (1 << bit);
+	if (msk & (1 << bit)) {
+		io->pcifr |= (1 << n);
+		node_dispatch(node);
+	}
+}
+
+/* UDR0 has been read by the receive ISR: pop the FIFO */
+static void usart_rx_pop(struct sim_node * node)
+{
+	struct sim_io * io = node->io;
+
+	if (node->urx.cnt == 0)
+		return;
+
+	node->urx.dat[0] = node->urx.dat[1];
+	node->urx.fe[0] = node->urx.fe[1];
+	if (--node->urx.cnt == 0)
+		io->ucsr0a &= ~((1 << RXC0) | (1 << FE0) | (1 << DOR0));
+	else if (node->urx.fe[0])
+		io->ucsr0a |= (1 << FE0);
+	else
+		io->ucsr0a &= ~(1 << FE0);
+}
+
+static void usart_sync(struct sim_node * node)
+{
+	struct sim_io * io = node->io;
+
+	if (reg_written(io->ucsr0a, node->ld.ucsr0a, 0xff)) {
+		/* UCSR0A written: TXC0 is cleared by writing one, U2X0 and
+		   MPCM0 are plain bits */
+		uint8_t w = io->ucsr0a;
+		uint8_t a = node->ld.ucsr0a;
+
+		a &= ~((1 << U2X0) | (1 << MPCM0));
+		if (w & (1 << TXC0))
+			a &= ~(1 << TXC0);
+		io->ucsr0a = a | (w & ((1 << U2X0) | (1 << MPCM0)));
+	} else {
+		io->ucsr0a = node->ld.ucsr0a;
+	}
+
+	if ((io->udr0 & SIM_TAG) == 0) {
+		/* UDR0 written */
+		uint8_t c = io->udr0;
+
+		if ((io->ucsr0b & (1 << TXEN0)) == 0)
+			return;
+
+		if (!node->utx.busy) {
+			usart_tx_start(node, c);
+		} else if (!node->utx.full) {
+			node->utx.buf = c;
+			node->utx.full = true;
+			io->ucsr0a &= ~(1 << UDRE0);
+		} else {
+			/* written with UDRE0 clear, the data is lost */
+			node->utx.buf = c;
+		}
+	}
+}
+
+/* ---------------------------------------------------------------------
+ * Interrupts
+ * ---------------------------------------------------------------------
+ */
+
+static bool irq_pending(struct sim_node * node, int vect)
+{
+	struct sim_io * io = node->io;
+
+	switch (vect) {
+	case SIM_INT0_VECT:
+		return (io->eifr & io->eimsk & (1 << 0)) != 0;
+	case SIM_INT1_VECT:
+		return (io->eifr & io->eimsk & (1 << 1)) != 0;
+	case SIM_PCINT0_VECT:
+		return (io->pcifr & io->pcicr & (1 << 0)) != 0;
+	case SIM_PCINT1_VECT:
+		return (io->pcifr & io->pcicr & (1 << 1)) != 0;
+	case SIM_PCINT2_VECT:
+		return (io->pcifr & io->pcicr & (1 << 2)) != 0;
+	case SIM_TIMER2_COMPA_VECT:
+		return (io->tifr2 & io->timsk2 & (1 << 1)) != 0;
+	case SIM_TIMER2_COMPB_VECT:
+		return (io->tifr2 & io->timsk2 & (1 << 2)) != 0;
+	case SIM_TIMER2_OVF_VECT:
+		return (io->tifr2 & io->timsk2 & (1 << 0)) != 0;
+	case SIM_TIMER1_CAPT_VECT:
+		return (io->tifr1 & io->timsk1 & (1 << 5)) != 0;
+	case SIM_TIMER1_COMPA_VECT:
+		return (io->tifr1 & io->timsk1 & (1 << 1)) != 0;
+	case SIM_TIMER1_COMPB_VECT:
+		return (io->tifr1 & io->timsk1 & (1 << 2)) != 0;
+	case SIM_TIMER1_OVF_VECT:
+		return (io->tifr1 & io->timsk1 & (1 << 0)) != 0;
+	case SIM_TIMER0_COMPA_VECT:
+		return (io->tifr0 & io->timsk0 & (1 << 1)) != 0;
+	case SIM_TIMER0_COMPB_VECT:
+		return (io->tifr0 & io->timsk0 & (1 << 2)) != 0;
+	case SIM_TIMER0_OVF_VECT:
+		return (io->tifr0 & io->timsk0 & (1 << 0)) != 0;
+	case SIM_USART_RX_VECT:
+		return (io->ucsr0a & io->ucsr0b & (1 << 7)) != 0;
+	case SIM_USART_UDRE_VECT:
+		return (io->ucsr0a & io->ucsr0b & (1 << 5)) != 0;
+	case SIM_USART_TX_VECT:
+		return (io->ucsr0a & io->ucsr0b & (1 << 6)) != 0;
+	}
+
+	return false;
+}
+
+/* flags the hardware clears when the vector is executed */
+static void irq_ack(struct sim_node * node, int vect)
+{
+	struct sim_io * io = node->io;
+
+	switch (vect) {
+	case SIM_INT0_VECT:
+		io->eifr &= ~(1 << 0);
+		break;
+	case SIM_INT1_VECT:
+		io->eifr &= ~(1 << 1);
+		break;
+	case SIM_PCINT0_VECT:
+	case SIM_PCINT1_VECT:
+	case SIM_PCINT2_VECT:
+		io->pcifr &= ~(1 << (vect - SIM_PCINT0_VECT));
+		break;
+	case SIM_TIMER2_COMPA_VECT:
+		io->tifr2 &= ~(1 << 1);
+		break;
+	case SIM_TIMER2_COMPB_VECT:
+		io->tifr2 &= ~(1 << 2);
+		break;
+	case SIM_TIMER2_OVF_VECT:
+		io->tifr2 &= ~(1 << 0);
+		break;
+	case SIM_TIMER1_CAPT_VECT:
+		io->tifr1 &= ~(1 << 5);
+		break;
+	case SIM_TIMER1_COMPA_VECT:
+		io->tifr1 &= ~(1 << 1);
+		break;
+	case SIM_TIMER1_COMPB_VECT:
+		io->tifr1 &= ~(1 << 2);
+		break;
+	case SIM_TIMER1_OVF_VECT:
+		io->tifr1 &= ~(1 << 0);
+		break;
+	case SIM_TIMER0_COMPA_VECT:
+		io->tifr0 &= ~(1 << 1);
+		break;
+	case SIM_TIMER0_COMPB_VECT:
+		io->tifr0 &= ~(1 << 2);
+		break;
+	case SIM_TIMER0_OVF_VECT:
+		io->tifr0 &= ~(1 << 0);
+		break;
+	case SIM_USART_TX_VECT:
+		io->ucsr0a &= ~(1 << TXC0);
+		break;
+	}
+}
+
+static void node_load_regs(struct sim_node * node)
+{
+	struct sim_io * io = node->io;
+	int i;
+
+	for (i = 0; i < 3; i++)
+		node->ld.tcnt[i] = tmr_cnt(node, &node->tmr[i]);
+
+	node->ld.tifr[0] = io->tifr0;
+	node->ld.tifr[1] = io->tifr1;
+	node->ld.tifr[2] = io->tifr2;
+	node->ld.ucsr0a = io->ucsr0a;
+	node->ld.pcifr = io->pcifr;
+	node->ld.eifr = io->eifr;
+
+	io->tcnt0 = node->ld.tcnt[0] | SIM_TAG;
+	io->tcnt1 = node->ld.tcnt[1] | SIM_TAG;
+	io->tcnt2 = node->ld.tcnt[2] | SIM_TAG;
+	io->tifr0 = node->ld.tifr[0] | SIM_TAG;
+	io->tifr1 = node->ld.tifr[1] | SIM_TAG;
+	io->tifr2 = node->ld.tifr[2] | SIM_TAG;
+	io->ucsr0a = node->ld.ucsr0a | SIM_TAG;
+	io->pcifr = node->ld.pcifr | SIM_TAG;
+	io->eifr = node->ld.eifr | SIM_TAG;
+	io->udr0 = (node->urx.cnt ? node->urx.dat[0] : 0) | SIM_TAG;
+}
+
+static void node_clk_set(struct sim_node * node, int32_t ppm,
+						 uint8_t osccal);
+
+static void node_store_regs(struct sim_node * node)
+{
+	struct sim_io * io = node->io;
+	int i;
+
+	for (i = 0; i < 3; i++)
+		tmr_sync(node, &node->tmr[i]);
+
+	if (io->osccal != node->osccal)
+		node_clk_set(node, node->ppm, io->osccal);
+
+	io->pcifr = reg_w1c(io->pcifr, node->ld.pcifr);
+	io->eifr = reg_w1c(io->eifr, node->ld.eifr);
+
+	usart_sync(node);
+}
+
+/* Power down: the timers hold their count, their events are void. */
+static void node_down(struct sim_node * node)
+{
+	int i;
+
+	for (i = 0; i < 3; i++) {
+		struct sim_tmr * tmr = &node->tmr[i];
+		tmr->cnt_ref = tmr_cnt(node, tmr);
+		tmr->t_ref = sim.now;
+		tmr->presc = 0;
+		tmr->gen++;
+	}
+
+	node->down = true;
+	node->t_down = sim.now;
+	node->down_cnt++;
+}
+
+static void node_wake(struct sim_node * node)
+{
+	int i;
+
+	node->down = false;
+	node->down_ps += sim.now - node->t_down;
+
+	for (i = 0; i < 3; i++) {
+		struct sim_tmr * tmr = &node->tmr[i];
+		tmr->t_ref = sim.now;
+		tmr_presc_set(tmr, tmr->tccrb);
+		tmr_sched(node, tmr);
+	}
+}
+
+static void node_dispatch(struct sim_node * node)
+{
+	int n = 0;
+
+	if (node->depth)
+		return;
+
+	node->depth++;
+
+	while (node->io->sreg & 0x80) {
+		int vect;
+
+		for (vect = 1; vect < SIM_VECT_CNT; vect++) {
+			if (irq_pending(node, vect))
+				break;
+		}
+
+		if (vect == SIM_VECT_CNT)
+			break;
+
+		if (node->down) {
+			/* the wake-up sources come first */
+			if (vect > SIM_WDT_VECT)
+				break;
+			node_wake(node);
+		}
+
+		if (node->vect[vect] == NULL) {
+			fprintf(stderr, "sim: %s: %s enabled without handler "
+					"(would jump to __bad_interrupt)\n",
+					node->name, vect_name[vect]);
+			exit(1);
+		}
+
+		if (++n > SIM_DISPATCH_MAX) {
+			fprintf(stderr, "sim: %s: interrupt storm on %s\n",
+					node->name, vect_name[vect]);
+			exit(1);
+		}
+
+		irq_ack(node, vect);
+		node->isr_cnt[vect]++;
+
+		node_load_regs(node);
+		node->io->sreg &= ~0x80;
+		node->vect[vect]();
+		node->io->sreg |= 0x80;
+		node_store_regs(node);
+		if (vect == SIM_USART_RX_VECT)
+			usart_rx_pop(node);
+
+		node->woken = true;
+	}
+
+	node->depth--;
+}
+
+void sim_node_enter(struct sim_node * node)
+{
+	node->depth++;
+	node_load_regs(node);
+}
+
+void sim_node_leave(struct sim_node * node)
+{
+	node_store_regs(node);
+	node->depth--;
+	node_dispatch(node);
+}
+
+/* sleep_cpu() of the node, SE set. Like the sleep instruction it returns
+   after the interrupt that wakes the node up, an interrupt pending
+   already included: in between the main context is suspended and the
+   event loop goes on. A mode with the clocks stopped (SM1 set) powers
+   the node down first. */
+static void node_sleep(void * arg)
+{
+	struct sim_node * node = arg;
+
+	if (sim.cur != node) {
+		fprintf(stderr, "sim: %s: sleep_cpu() outside the main "
+				"context\n", node->name);
+		exit(1);
+	}
+
+	node_store_regs(node);
+	if (node->io->smcr & (1 << SM1))
+		node_down(node);
+	node->depth--;
+
+	node->woken = false;
+	node_dispatch(node);
+	if (!node->woken)
+		swapcontext(&node->ctx, &sim.ctx);
+	node->woken = false;
+	node->slept = true;
+
+	node->depth++;
+	node_load_regs(node);
+}
+
+struct sim_node * sim_node_load(const char * path, const char * name)
+{
+	struct sim_node * node;
+	const unsigned long * f_cpu;
+	int i;
+
+	if (sim.node_cnt == SIM_NODE_MAX) {
+		fprintf(stderr, "sim: too many nodes\n");
+		exit(1);
+	}
+
+	node = calloc(1, sizeof(struct sim_node));
+	node->name = name;
+
+	/* RTLD_LOCAL: every node keeps its own copy of the firmware globals */
+	if ((node->dl = dlopen(path, RTLD_NOW | RTLD_LOCAL)) == NULL) {
+		fprintf(stderr, "sim: %s\n", dlerror());
+		exit(1);
+	}
+
+	node->io = sim_node_sym(node, "sim_io");
+	f_cpu = sim_node_sym(node, "sim_f_cpu");
+	node->f_cpu = *f_cpu;
+
+	for (i = 1; i < SIM_VECT_CNT; i++) {
+		if (vect_name[i] != NULL)
+			node->vect[i] = (void (*)(void))dlsym(node->dl, vect_name[i]);
+	}
+
+	for (i = 0; i < 3; i++) {
+		node->tmr[i].id = i;
+		node->tmr[i].t_ref = sim.now;
+	}
+
+	node->io->ucsr0a = (1 << UDRE0);
+	node->io->osccal = SIM_OSCCAL_RST;
+	node->io->sleep = node_sleep;
+	node->io->sleep_arg = node;
+	node->osccal = SIM_OSCCAL_RST;
+	sim.node[sim.node_cnt++] = node;
+
+	return node;
+}
+
+const char * sim_node_name(struct sim_node * node)
+{
+	return node->name;
+}
+
+void * sim_node_sym(struct sim_node * node, const char * sym)
+{
+	void * p;
+
+	if ((p = dlsym(node->dl, sym)) == NULL) {
+		fprintf(stderr, "sim: %s: %s\n", node->name, dlerror());
+		exit(1);
+	}
+
+	return p;
+}
+
+void * sim_node_sym_find(struct sim_node * node, const char * sym)
+{
+	return dlsym(node->dl, sym);
+}
+
+void sim_node_main_set(struct sim_node * node, sim_main_t fn, void * arg)
+{
+	node->main = fn;
+	node->main_arg = arg;
+}
+
+void sim_node_start(struct sim_node * node)
+{
+	node->woken = true;
+}
+
+struct sim_io * sim_node_io(struct sim_node * node)
+{
+	return node->io;
+}
+
+unsigned long sim_node_f_cpu(struct sim_node * node)
+{
+	return node->f_cpu;
+}
+
+static void node_clk_set(struct sim_node * node, int32_t ppm,
+						 uint8_t osccal)
+{
+	int i;
+
+	/* re-anchor the running timers at the current count */
+	for (i = 0; i < 3; i++) {
+		struct sim_tmr * tmr = &node->tmr[i];
+		tmr->cnt_ref = tmr_cnt(node, tmr);
+		tmr->t_ref = sim.now;
+	}
+
+	node->ppm = ppm;
+	node->osccal = osccal;
+
+	for (i = 0; i < 3; i++)
+		tmr_sched(node, &node->tmr[i]);
+}
+
+void sim_node_clk_ppm_set(struct sim_node * node, int32_t ppm)
+{
+	node_clk_set(node, ppm, node->osccal);
+}
+
+int32_t sim_node_clk_ppm(struct sim_node * node)
+{
+	return node_ppm(node);
+}
+
+uint64_t sim_isr_count(struct sim_node * node, int vect)
+{
+	return node->isr_cnt[vect];
+}
+
+uint64_t sim_node_down_time(struct sim_node * node, uint64_t * cnt)
+{
+	if (cnt != NULL)
+		*cnt = node->down_cnt;
+	if (node->down)
+		return node->down_ps + (sim.now - node->t_down);
+	return node->down_ps;
+}
+
+bool sim_node_down(struct sim_node * node)
+{
+	return node->down;
+}
+
+const char * sim_vect_name(int vect)
+{
+	return vect_name[vect];
+}
+
+/* ---------------------------------------------------------------------
+ * Line
+ * ---------------------------------------------------------------------
+ */
+
+void sim_line_set(struct sim_node * node, sim_line_t fn, void * arg)
+{
+	node->utx.line = fn;
+	node->utx.line_arg = arg;
+}
+
+static void wire_line(void * arg, struct sim_node * node, uint8_t c,
+					  uint64_t t_start, uint64_t t_end)
+{
+	(void)node;
+	(void)t_start;
+	(void)t_end;
+
+	sim_usart_rx((struct sim_node *)arg, c, false);
+}
+
+void sim_connect(struct sim_node * tx, struct sim_node * rx)
+{
+	sim_line_set(tx, wire_line, rx);
+}
+
+/* ---------------------------------------------------------------------
+ * Main loop
+ * ---------------------------------------------------------------------
+ */
+
+/* The main context of a node: the application main loop, called again
+   after every wake-up. A call that went to sleep was woken up already. */
+static void node_main(void)
+{
+	struct sim_node * node = sim.cur;
+
+	for (;;) {
+		node->slept = false;
+		node->main(node->main_arg, node);
+		if (!node->slept)
+			swapcontext(&node->ctx, &sim.ctx);
+	}
+}
+
+/* Run the main context of 'node' until it sleeps or its main returns. */
+static void node_resume(struct sim_node * node)
+{
+	if (node->stack == NULL) {
+		if ((node->stack = malloc(SIM_STACK_SIZE)) == NULL) {
+			fprintf(stderr, "sim: out of memory\n");
+			exit(1);
+		}
+		getcontext(&node->ctx);
+		node->ctx.uc_stack.ss_sp = node->stack;
+		node->ctx.uc_stack.ss_size = SIM_STACK_SIZE;
+		node->ctx.uc_link = NULL;
+		makecontext(&node->ctx, node_main, 0);
+	}
+
+	sim.cur = node;
+	swapcontext(&sim.ctx, &node->ctx);
+	sim.cur = NULL;
+}
+
+static void sim_wakeups(void)
+{
+	bool again;
+	unsigned int i;
+
+	do {
+		again = false;
+		for (i = 0; i < sim.node_cnt; i++) {
+			struct sim_node * node = sim.node[i];
+			if (node->woken) {
+				node->woken = false;
+				if (node->main) {
+					node_resume(node);
+					again = true;
+				}
+			}
+		}
+	} while (again);
+}
+
+uint64_t sim_run(uint64_t until)
+{
+	uint64_t n = 0;
+
+	sim_wakeups();
+
+	while ((sim.cnt > 0) && (sim.heap[0].t <= until)) {
+		struct sim_ev ev = ev_pop();
+
+		sim.now = ev.t;
+		ev.fn(ev.arg, ev.dat);
+		n++;
+
+		sim_wakeups();
+	}
+
+	if ((until != UINT64_MAX) && (until > sim.now))
+		sim.now = until;
+
+	return n;
+}
@@ -0,0 +1,179 @@
+/*
+ * Copyright(C) 2021 Robinson (Bob) Mittman. All Rights Reserved.
+ * Licensed under the MIT license.
+ * See LICENSE file in the project root for details.
+ *
+ */
+
+/* Discrete event simulator for the rc433 firmware.
+ *
+ * Every simulated MCU is a firmware build for the host, compiled against
+ * the replacement avr headers in this directory and loaded as a shared
+ * object, so each one has its own globals and register file. The
+ * simulator models USART0 and the three timers closely enough for the
+ * link layer ISR chains, dispatches interrupts in vector priority order
+ * and calls back into the application after every wake-up.
+ *
+ * Time is kept in picoseconds, which keeps the 8 and 16 MHz clock periods
+ * exact. ISRs take no simulated time.
+ *
+ * sleep_cpu() suspends the firmware main context until an interrupt
+ * wakes the node up and returns after its ISR, as on the target. In
+ * power-down, power-save or standby mode the node is powered down in the
+ * meantime: the timers hold their count, the characters received are
+ * lost, a character on RXD raising the RXD (PCINT16) pin change flag,
+ * and only INT0/1, the pin change interrupts and the watchdog wake it up
+ * again. Asynchronous Timer2 is not modelled. */
+
+#ifndef __SIM_H__
+#define __SIM_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "simio.h"
+
+#define SIM_PS_PER_S 1000000000000ull
+#define SIM_MS(__MS__) ((uint64_t)(__MS__) * 1000000000ull)
+#define SIM_US(__US__) ((uint64_t)(__US__) * 1000000ull)
+
+/* interrupt vectors, numbered as in the ATmega328P datasheet */
+enum {
+	SIM_INT0_VECT = 1,
+	SIM_INT1_VECT = 2,
+	SIM_PCINT0_VECT = 3,
+	SIM_PCINT1_VECT = 4,
+	SIM_PCINT2_VECT = 5,
+	SIM_WDT_VECT = 6,
+	SIM_TIMER2_COMPA_VECT = 7,
+	SIM_TIMER2_COMPB_VECT = 8,
+	SIM_TIMER2_OVF_VECT = 9,
+	SIM_TIMER1_CAPT_VECT = 10,
+	SIM_TIMER1_COMPA_VECT = 11,
+	SIM_TIMER1_COMPB_VECT = 12,
+	SIM_TIMER1_OVF_VECT = 13,
+	SIM_TIMER0_COMPA_VECT = 14,
+	SIM_TIMER0_COMPB_VECT = 15,
+	SIM_TIMER0_OVF_VECT = 16,
+	SIM_SPI_STC_VECT = 17,
+	SIM_USART_RX_VECT = 18,
+	SIM_USART_UDRE_VECT = 19,
+	SIM_USART_TX_VECT = 20,
+	SIM_VECT_CNT = 21
+};
+
+struct sim_node;
+
+/* Called for every character a node shifts out of its USART.
+   't_start' is the leading edge of the start bit, 't_end' the end of the
+   last stop bit. */
+typedef void (* sim_line_t)(void * arg, struct sim_node * node,
+							uint8_t c, uint64_t t_start, uint64_t t_end);
+
+/* Application main loop of a node, run in a context of its own: called
+   after each wake-up, and again at once after a call that went to sleep,
+   as sleep_cpu() returns woken up already. A call that never returns
+   runs the firmware main() as it is. */
+typedef void (* sim_main_t)(void * arg, struct sim_node * node);
+
+/* Generic scheduled callback. */
+typedef void (* sim_event_t)(void * arg, uintptr_t dat);
+
+/* Load a firmware shared object. Exits on error. */
+struct sim_node * sim_node_load(const char * path, const char * name);
+
+const char * sim_node_name(struct sim_node * node);
+
+/* Look up a firmware symbol. Exits if it is missing. */
+void * sim_node_sym(struct sim_node * node, const char * sym);
+
+/* Look up a firmware symbol, NULL if it is missing. */
+void * sim_node_sym_find(struct sim_node * node, const char * sym);
+
+/* Bracket every call into the firmware main context: enter loads the
+   timer counters and receive data into the register file, leave applies
+   register writes to the peripheral models and dispatches the
+   interrupts that became pending. */
+void sim_node_enter(struct sim_node * node);
+void sim_node_leave(struct sim_node * node);
+
+#define SIM_CALL(__NODE__, __EXPR__) ({ \
+	struct sim_node * __n = (__NODE__); \
+	sim_node_enter(__n); \
+	__typeof__(__EXPR__) __r = (__EXPR__); \
+	sim_node_leave(__n); \
+	__r; })
+
+#define SIM_CALL_VOID(__NODE__, __EXPR__) do { \
+	struct sim_node * __n = (__NODE__); \
+	sim_node_enter(__n); \
+	__EXPR__; \
+	sim_node_leave(__n); } while (0)
+
+void sim_node_main_set(struct sim_node * node, sim_main_t fn, void * arg);
+
+/* Call the main loop of 'node' at the next sim_run() rather than after
+   its first interrupt, for a firmware main() that sets the node up. */
+void sim_node_start(struct sim_node * node);
+
+/* Register file of the node, for pin level stimulus and inspection. */
+struct sim_io * sim_node_io(struct sim_node * node);
+
+unsigned long sim_node_f_cpu(struct sim_node * node);
+
+/* OSCCAL model of the internal RC oscillator: the register reads
+   SIM_OSCCAL_RST after reset and every step away from it moves the
+   clock by SIM_OSCCAL_PPM, about what the ATmega328P shows around 8 MHz.
+   Writes take effect when the firmware call returns. */
+#define SIM_OSCCAL_RST 0x60
+#define SIM_OSCCAL_PPM 5000
+
+/* Scale the node clock by (1 + ppm / 1e6), e.g. RC oscillator error.
+   The OSCCAL offset is applied on top. */
+void sim_node_clk_ppm_set(struct sim_node * node, int32_t ppm);
+
+/* Current clock error of the node, OSCCAL included, in ppm. */
+int32_t sim_node_clk_ppm(struct sim_node * node);
+
+/* Where the characters transmitted by 'node' go. */
+void sim_line_set(struct sim_node * node, sim_line_t fn, void * arg);
+
+/* Plain wire: every character sent by 'tx' is received by 'rx' at the
+   end of its stop bit. */
+void sim_connect(struct sim_node * tx, struct sim_node * rx);
+
+/* Present a received character to the USART of 'node', now. */
+void sim_usart_rx(struct sim_node * node, uint8_t c, bool fe);
+
+/* Drive input pin 'bit' of port 'port' ('B', 'C' or 'D') of 'node' to
+   'level', now. Updates PINx and raises the pin change interrupt when the
+   level changes on a pin enabled in PCMSKx. */
+void sim_pin_set(struct sim_node * node, char port, int bit, bool level);
+
+/* USART bit time of 'node' from its current UBRR0/U2X0 setting. */
+uint64_t sim_usart_bit_time(struct sim_node * node);
+
+/* Current level of the TXD pin (USART output or PORTD1 when the
+   transmitter is disabled). */
+bool sim_usart_txd(struct sim_node * node);
+
+uint64_t sim_isr_count(struct sim_node * node, int vect);
+
+/* Time 'node' has spent powered down, and in '*cnt' (if not NULL) the
+   number of times it went down. */
+uint64_t sim_node_down_time(struct sim_node * node, uint64_t * cnt);
+
+/* The node is powered down now. */
+bool sim_node_down(struct sim_node * node);
+
+const char * sim_vect_name(int vect);
+
+/* Schedule a callback at absolute time 't'. */
+void sim_at(uint64_t t, sim_event_t fn, void * arg, uintptr_t dat);
+
+uint64_t sim_now(void);
+
+/* Run the event loop until time 'until' or until there is nothing left
+   to do. Returns the number of events processed. */
+uint64_t sim_run(uint64_t until);
+
+#endif /* __SIM_H__ */
@@ -0,0 +1,17 @@
+/*
+ * Copyright(C) 2021 Robinson (Bob) Mittman. All Rights Reserved.
+ * Licensed under the MIT license. 
+ * See LICENSE file in the project root for details.
+ *
+ */
+
+/* Linked into every simulated MCU: its register file and clock. */
+
+#include <avr/io.h>
+
+struct sim_io sim_io = {
+	.ucsr0a = (1 << UDRE0),
+	.osccal = 0x80
+};
+
+const unsigned long sim_f_cpu = F_CPU;
@@ -0,0 +1,100 @@
+/*
+ * Copyright(C) 2021 Robinson (Bob) Mittman. All Rights Reserved.
+ * Licensed under the MIT license. 
+ * See LICENSE file in the project root for details.
+ *
+ */
+
+/* Register file of a simulated ATmega328P.
+ *
+ * Each simulated MCU is a shared object holding its own copy of this
+ * structure (see simio.c). The firmware sees the fields through the
+ * register names defined in the host <avr/io.h>, the simulator reaches
+ * them through dlsym("sim_io").
+ *
+ * UDR0, the TCNTn counters and the registers with write-one-to-clear
+ * flags (UCSR0A, TIFRn, PCIFR, EIFR) are wider than on the target: before
+ * running any firmware code the simulator loads them with the current
+ * value ORed with SIM_TAG. A firmware write clears the tag, which is how
+ * the simulator tells a write from a read. Firmware must therefore only
+ * read these registers into 8 (or 16) bit variables or mask them, never
+ * use them whole in arithmetic or comparisons. */
+
+#ifndef __SIMIO_H__
+#define __SIMIO_H__
+
+#include <stdint.h>
+
+#define SIM_TAG 0x10000ul
+
+struct sim_io {
+	uint8_t sreg;
+
+	/* USART0 */
+	uint32_t udr0;
+	uint32_t ucsr0a;
+	uint8_t ucsr0b;
+	uint8_t ucsr0c;
+	uint16_t ubrr0;
+
+	/* ports */
+	uint8_t portb;
+	uint8_t ddrb;
+	uint8_t pinb;
+	uint8_t portc;
+	uint8_t ddrc;
+	uint8_t pinc;
+	uint8_t portd;
+	uint8_t ddrd;
+	uint8_t pind;
+
+	/* Timer/Counter 0 */
+	uint8_t tccr0a;
+	uint8_t tccr0b;
+	uint32_t tcnt0;
+	uint8_t ocr0a;
+	uint8_t ocr0b;
+	uint8_t timsk0;
+	uint32_t tifr0;
+
+	/* Timer/Counter 1 */
+	uint8_t tccr1a;
+	uint8_t tccr1b;
+	uint8_t tccr1c;
+	uint32_t tcnt1;
+	uint16_t ocr1a;
+	uint16_t ocr1b;
+	uint16_t icr1;
+	uint8_t timsk1;
+	uint32_t tifr1;
+
+	/* Timer/Counter 2 */
+	uint8_t tccr2a;
+	uint8_t tccr2b;
+	uint32_t tcnt2;
+	uint8_t ocr2a;
+	uint8_t ocr2b;
+	uint8_t timsk2;
+	uint32_t tifr2;
+
+	/* pin change and external interrupts */
+	uint8_t pcicr;
+	uint32_t pcifr;
+	uint8_t pcmsk0;
+	uint8_t pcmsk1;
+	uint8_t pcmsk2;
+	uint8_t eicra;
+	uint8_t eimsk;
+	uint32_t eifr;
+
+	/* system */
+	uint8_t smcr;
+	uint8_t mcucr;
+	uint8_t prr;
+	uint8_t osccal;
+	/* sleep_cpu() with SE set, installed by the simulator */
+	void (* sleep)(void * arg);
+	void * sleep_arg;
+};
+
+#endif /* __SIMIO_H__ */
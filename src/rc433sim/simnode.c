@@ -0,0 +1,75 @@
+/*
+ * Copyright(C) 2021 Robinson (Bob) Mittman. All Rights Reserved.
+ * Licensed under the MIT license.
+ * See LICENSE file in the project root for details.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "simnode.h"
+
+void sim_link_load(struct sim_link * lnk, const char * argv0,
+				   const char * so, const char * name)
+{
+	char path[PATH_MAX];
+	const char * sep;
+	struct sim_node * node;
+
+	if ((sep = strrchr(argv0, '/')) != NULL)
+		snprintf(path, sizeof(path), "%.*s/%s", (int)(sep - argv0),
+				 argv0, so);
+	else
+		snprintf(path, sizeof(path), "./%s", so);
+
+	node = sim_node_load(path, name);
+
+	memset(lnk, 0, sizeof(struct sim_link));
+	lnk->node = node;
+	lnk->init = (void (*)(void))sim_node_sym(node, "rc433_init");
+	lnk->pkt_send = (int8_t (*)(uint8_t *))
+		sim_node_sym_find(node, "rc433_pkt_send");
+	lnk->fec_send = (int8_t (*)(uint8_t *))
+		sim_node_sym_find(node, "rc433_fec_send");
+	lnk->frm_send = (int8_t (*)(const uint8_t *, uint8_t))
+		sim_node_sym_find(node, "rc433_frm_send");
+	lnk->tx_pending = (uint8_t (*)(void))
+		sim_node_sym_find(node, "rc433_tx_pending");
+	lnk->arq_send = (int8_t (*)(uint8_t *))
+		sim_node_sym_find(node, "rc433_arq_send");
+	lnk->arq_status = (int8_t (*)(void))
+		sim_node_sym_find(node, "rc433_arq_status");
+	lnk->arq_tries = (uint8_t (*)(void))
+		sim_node_sym_find(node, "rc433_arq_tries");
+	lnk->mbox_post = (void (*)(uint8_t *, uint8_t))
+		sim_node_sym_find(node, "rc433_mbox_post");
+	lnk->preamble_set = (int8_t (*)(uint8_t))
+		sim_node_sym_find(node, "rc433_preamble_set");
+	lnk->tx_mark = (void (*)(uint16_t))
+		sim_node_sym_find(node, "rc433_tx_mark");
+	lnk->tx_lat_get = (void (*)(struct rc433_tx_lat *))
+		sim_node_sym_find(node, "rc433_tx_lat_get");
+	lnk->pkt_recv = (int8_t (*)(uint8_t *))
+		sim_node_sym_find(node, "rc433_pkt_recv");
+	lnk->frm_recv = (int8_t (*)(uint8_t *))
+		sim_node_sym_find(node, "rc433_frm_recv");
+	lnk->rx_stat_get = (void (*)(struct rc433_rx_stat *))
+		sim_node_sym_find(node, "rc433_rx_stat_get");
+	lnk->rx_lat_get = (void (*)(struct rc433_rx_lat *))
+		sim_node_sym_find(node, "rc433_rx_lat_get");
+	lnk->tstamp = (uint16_t (*)(void))
+		sim_node_sym_find(node, "rc433_tstamp");
+	lnk->isr_prof_get = (void (*)(struct rc433_isr_prof *, uint8_t))
+		sim_node_sym_find(node, "rc433_isr_prof_get");
+}
+
+void sim_link_init(struct sim_link * lnk)
+{
+	SIM_CALL_VOID(lnk->node, lnk->init());
+	/* sei() */
+	sim_node_io(lnk->node)->sreg |= 0x80;
+	SIM_CALL_VOID(lnk->node, (void)0);
+}
@@ -0,0 +1,50 @@
+/*
+ * Copyright(C) 2021 Robinson (Bob) Mittman. All Rights Reserved.
+ * Licensed under the MIT license.
+ * See LICENSE file in the project root for details.
+ *
+ */
+
+/* rc433 link layer API of a simulated node */
+
+#ifndef __SIMNODE_H__
+#define __SIMNODE_H__
+
+#include "sim.h"
+#include "rc433.h"
+
+struct sim_link {
+	struct sim_node * node;
+	void (* init)(void);
+	/* transmitter side, NULL if not linked in */
+	int8_t (* pkt_send)(uint8_t dat[]);
+	int8_t (* fec_send)(uint8_t dat[]);
+	int8_t (* frm_send)(const uint8_t dat[], uint8_t len);
+	uint8_t (* tx_pending)(void);
+	int8_t (* arq_send)(uint8_t dat[]);
+	int8_t (* arq_status)(void);
+	uint8_t (* arq_tries)(void);
+	void (* mbox_post)(uint8_t dat[], uint8_t copies);
+	int8_t (* preamble_set)(uint8_t len);
+	void (* tx_mark)(uint16_t t);
+	void (* tx_lat_get)(struct rc433_tx_lat * lat);
+	/* receiver side, NULL if not linked in */
+	int8_t (* pkt_recv)(uint8_t dat[]);
+	int8_t (* frm_recv)(uint8_t dat[]);
+	void (* rx_stat_get)(struct rc433_rx_stat * stat);
+	void (* rx_lat_get)(struct rc433_rx_lat * lat);
+	/* both sides, NULL unless built with RFLINK_TSTAMP */
+	uint16_t (* tstamp)(void);
+	/* both sides, NULL unless built with RFLINK_ISR_PROF */
+	void (* isr_prof_get)(struct rc433_isr_prof * prof, uint8_t clr);
+};
+
+/* Load the firmware shared object 'so', looked up in the directory of
+   the running program 'argv0'. */
+void sim_link_load(struct sim_link * lnk, const char * argv0,
+				   const char * so, const char * name);
+
+/* rc433_init() and sei() */
+void sim_link_init(struct sim_link * lnk);
+
+#endif /* __SIMNODE_H__ */
@@ -0,0 +1,29 @@
+/*
+ * Copyright(C) 2021 Robinson (Bob) Mittman. All Rights Reserved.
+ * Licensed under the MIT license.
+ * See LICENSE file in the project root for details.
+ *
+ */
+
+/* Linked into the sniffer application nodes (snif_app.so): rc433snif.c
+   is built with rc433_pkt_recv() renamed to snif_pkt_recv(), which hands
+   every packet its main loop takes to the tool as well. */
+
+#include <stddef.h>
+#include <stdint.h>
+#include "rc433.h"
+
+/* called with every packet, set by the tool */
+void (* sim_pkt_hook)(void * arg, const uint8_t dat[]);
+void * sim_pkt_arg;
+
+int8_t snif_pkt_recv(uint8_t dat[])
+{
+	if (!rc433_pkt_recv(dat))
+		return 0;
+
+	if (sim_pkt_hook != NULL)
+		sim_pkt_hook(sim_pkt_arg, dat);
+
+	return 1;
+}
@@ -0,0 +1,267 @@
+/*
+ * Copyright(C) 2021 Robinson (Bob) Mittman. All Rights Reserved.
+ * Licensed under the MIT license.
+ * See LICENSE file in the project root for details.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "symdec.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SYMDEC_X86 1
+#else
+#define SYMDEC_X86 0
+#endif
+
+static void run_scalar(const struct symdec * sd, const uint8_t * in,
+					   uint8_t * out, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		out[i] = sd->lut[in[i]];
+}
+
+static size_t find_scalar(const struct symdec * sd, const uint8_t * in,
+						  size_t n)
+{
+	size_t i;
+	int j;
+
+	for (i = 0; i < n; i++) {
+		for (j = 0; j < sd->nfind; j++) {
+			if (in[i] == sd->find[j])
+				return i;
+		}
+	}
+
+	return n;
+}
+
+#if (SYMDEC_X86)
+__attribute__((target("sse4.1")))
+static void run_sse41(const struct symdec * sd, const uint8_t * in,
+					  uint8_t * out, size_t n)
+{
+	const __m128i msk = _mm_set1_epi8(0x0f);
+	__m128i row[16];
+	__m128i hi[16];
+	size_t i;
+	int k;
+
+	for (k = 0; k < sd->nrow; k++) {
+		row[k] = _mm_loadu_si128((const __m128i *)sd->row[k]);
+		hi[k] = _mm_set1_epi8(sd->row_hi[k]);
+	}
+
+	for (i = 0; i + 16 <= n; i += 16) {
+		__m128i x = _mm_loadu_si128((const __m128i *)(in + i));
+		__m128i lo = _mm_and_si128(x, msk);
+		__m128i h = _mm_and_si128(_mm_srli_epi16(x, 4), msk);
+		__m128i r = _mm_set1_epi8((char)0xff);
+
+		for (k = 0; k < sd->nrow; k++)
+			r = _mm_blendv_epi8(r, _mm_shuffle_epi8(row[k], lo),
+								_mm_cmpeq_epi8(h, hi[k]));
+
+		_mm_storeu_si128((__m128i *)(out + i), r);
+	}
+
+	run_scalar(sd, in + i, out + i, n - i);
+}
+
+__attribute__((target("sse4.1")))
+static size_t find_sse41(const struct symdec * sd, const uint8_t * in,
+						 size_t n)
+{
+	__m128i v[SYMDEC_FIND_MAX];
+	size_t i;
+	int j;
+
+	for (j = 0; j < sd->nfind; j++)
+		v[j] = _mm_set1_epi8(sd->find[j]);
+
+	for (i = 0; i + 16 <= n; i += 16) {
+		__m128i x = _mm_loadu_si128((const __m128i *)(in + i));
+		__m128i m = _mm_setzero_si128();
+		unsigned int bits;
+
+		for (j = 0; j < sd->nfind; j++)
+			m = _mm_or_si128(m, _mm_cmpeq_epi8(x, v[j]));
+
+		if ((bits = _mm_movemask_epi8(m)) != 0)
+			return i + __builtin_ctz(bits);
+	}
+
+	return i + find_scalar(sd, in + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void run_avx2(const struct symdec * sd, const uint8_t * in,
+					 uint8_t * out, size_t n)
+{
+	const __m256i msk = _mm256_set1_epi8(0x0f);
+	__m256i row[16];
+	__m256i hi[16];
+	size_t i;
+	int k;
+
+	for (k = 0; k < sd->nrow; k++) {
+		row[k] = _mm256_broadcastsi128_si256(
+			_mm_loadu_si128((const __m128i *)sd->row[k]));
+		hi[k] = _mm256_set1_epi8(sd->row_hi[k]);
+	}
+
+	for (i = 0; i + 32 <= n; i += 32) {
+		__m256i x = _mm256_loadu_si256((const __m256i *)(in + i));
+		__m256i lo = _mm256_and_si256(x, msk);
+		__m256i h = _mm256_and_si256(_mm256_srli_epi16(x, 4), msk);
+		__m256i r = _mm256_set1_epi8((char)0xff);
+
+		for (k = 0; k < sd->nrow; k++)
+			r = _mm256_blendv_epi8(r, _mm256_shuffle_epi8(row[k], lo),
+								   _mm256_cmpeq_epi8(h, hi[k]));
+
+		_mm256_storeu_si256((__m256i *)(out + i), r);
+	}
+
+	run_sse41(sd, in + i, out + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static size_t find_avx2(const struct symdec * sd, const uint8_t * in,
+						size_t n)
+{
+	__m256i v[SYMDEC_FIND_MAX];
+	size_t i;
+	int j;
+
+	for (j = 0; j < sd->nfind; j++)
+		v[j] = _mm256_set1_epi8(sd->find[j]);
+
+	for (i = 0; i + 32 <= n; i += 32) {
+		__m256i x = _mm256_loadu_si256((const __m256i *)(in + i));
+		__m256i m = _mm256_setzero_si256();
+		unsigned int bits;
+
+		for (j = 0; j < sd->nfind; j++)
+			m = _mm256_or_si256(m, _mm256_cmpeq_epi8(x, v[j]));
+
+		if ((bits = _mm256_movemask_epi8(m)) != 0)
+			return i + __builtin_ctz(bits);
+	}
+
+	return i + find_sse41(sd, in + i, n - i);
+}
+#endif
+
+int symdec_init(struct symdec * sd, const uint8_t lut[256], int isa,
+				uint8_t lo, uint8_t hi)
+{
+	int b;
+	int h;
+	int l;
+
+	memset(sd, 0, sizeof(struct symdec));
+	memcpy(sd->lut, lut, sizeof(sd->lut));
+
+	for (h = 0; h < 16; h++) {
+		bool used = false;
+
+		for (l = 0; l < 16; l++) {
+			if (lut[(h << 4) | l] != 0xff)
+				used = true;
+		}
+		if (!used)
+			continue;
+
+		memcpy(sd->row[sd->nrow], &lut[h << 4], 16);
+		sd->row_hi[sd->nrow] = h;
+		sd->nrow++;
+	}
+
+	for (b = 0; b < 256; b++) {
+		if ((lut[b] < lo) || (lut[b] > hi))
+			continue;
+		if (sd->nfind == SYMDEC_FIND_MAX) {
+			fprintf(stderr, "symdec: more than %d bytes decode to "
+					"0x%02x..0x%02x\n", SYMDEC_FIND_MAX, lo, hi);
+			exit(1);
+		}
+		sd->find[sd->nfind++] = b;
+	}
+
+#if (SYMDEC_X86)
+	if (isa == SYMDEC_AUTO) {
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2"))
+			isa = SYMDEC_AVX2;
+		else if (__builtin_cpu_supports("sse4.1"))
+			isa = SYMDEC_SSE41;
+		else
+			isa = SYMDEC_SCALAR;
+	} else if (((isa == SYMDEC_AVX2) && !__builtin_cpu_supports("avx2")) ||
+			   ((isa == SYMDEC_SSE41) && !__builtin_cpu_supports("sse4.1"))) {
+		fprintf(stderr, "symdec: the CPU has no %s\n",
+				symdec_isa_name(isa));
+		exit(1);
+	}
+#else
+	if (isa == SYMDEC_AUTO)
+		isa = SYMDEC_SCALAR;
+	if (isa != SYMDEC_SCALAR) {
+		fprintf(stderr, "symdec: %s is x86 only\n", symdec_isa_name(isa));
+		exit(1);
+	}
+#endif
+
+	sd->isa = isa;
+	return isa;
+}
+
+void symdec_run(const struct symdec * sd, const uint8_t * in, uint8_t * out,
+				size_t n)
+{
+#if (SYMDEC_X86)
+	if (sd->isa == SYMDEC_AVX2) {
+		run_avx2(sd, in, out, n);
+		return;
+	}
+	if (sd->isa == SYMDEC_SSE41) {
+		run_sse41(sd, in, out, n);
+		return;
+	}
+#endif
+	run_scalar(sd, in, out, n);
+}
+
+size_t symdec_find(const struct symdec * sd, const uint8_t * in, size_t n)
+{
+	if (sd->nfind == 0)
+		return n;
+#if (SYMDEC_X86)
+	if (sd->isa == SYMDEC_AVX2)
+		return find_avx2(sd, in, n);
+	if (sd->isa == SYMDEC_SSE41)
+		return find_sse41(sd, in, n);
+#endif
+	return find_scalar(sd, in, n);
+}
+
+const char * symdec_isa_name(int isa)
+{
+	switch (isa) {
+	case SYMDEC_SSE41:
+		return "sse4.1";
+	case SYMDEC_AVX2:
+		return "avx2";
+	default:
+		return "scalar";
+	}
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright(C) 2021 Robinson (Bob) Mittman. All Rights Reserved.
+ * Licensed under the MIT license.
+ * See LICENSE file in the project root for details.
+ *
+ */
+
+/* Bulk 4b/8b symbol decoding for the host tools.
+ *
+ * A 256 entry table, the decode_lut[] of rc433rx_uart.c, is applied to a
+ * run of line bytes 16 (SSE4.1) or 32 (AVX2) at a time: the high nibble
+ * of every byte selects one 16 byte row of the table, which PSHUFB
+ * indexes with the low nibble. Rows that hold nothing but 0xff, most of
+ * them, are skipped. The results are those of the table, byte for byte.
+ * On other CPUs, or when asked to, the table is walked one byte at a
+ * time. */
+
+#ifndef __SYMDEC_H__
+#define __SYMDEC_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define SYMDEC_SCALAR 0
+#define SYMDEC_SSE41  1
+#define SYMDEC_AVX2   2
+/* the best the CPU has */
+#define SYMDEC_AUTO   -1
+
+/* largest set of bytes symdec_find() looks for */
+#define SYMDEC_FIND_MAX 8
+
+struct symdec {
+	int isa;
+	uint8_t lut[256];
+	/* rows of the table that are not all 0xff, and their high nibble */
+	int nrow;
+	uint8_t row[16][16];
+	uint8_t row_hi[16];
+	/* the bytes symdec_find() looks for */
+	int nfind;
+	uint8_t find[SYMDEC_FIND_MAX];
+};
+
+/* Use 'lut', with the instruction set 'isa' or the best one available
+   (SYMDEC_AUTO). symdec_find() looks for the bytes that decode to
+   'lo'..'hi', at most SYMDEC_FIND_MAX of them. Returns the instruction
+   set used. */
+int symdec_init(struct symdec * sd, const uint8_t lut[256], int isa,
+				uint8_t lo, uint8_t hi);
+
+/* out[i] = lut[in[i]] */
+void symdec_run(const struct symdec * sd, const uint8_t * in, uint8_t * out,
+				size_t n);
+
+/* Offset of the first byte of 'in' that decodes to 'lo'..'hi', 'n' if
+   there is none. */
+size_t symdec_find(const struct symdec * sd, const uint8_t * in, size_t n);
+
+const char * symdec_isa_name(int isa);
+
+#endif /* __SYMDEC_H__ */
@@ -0,0 +1,41 @@
+/*
+ * Copyright(C) 2021 Robinson (Bob) Mittman. All Rights Reserved.
+ * Licensed under the MIT license. 
+ * See LICENSE file in the project root for details.
+ *
+ */
+
+/* Host replacement for <util/atomic.h>, same construction as avr-libc. */
+
+#ifndef __SIM_UTIL_ATOMIC_H__
+#define __SIM_UTIL_ATOMIC_H__
+
+#include <avr/io.h>
+
+static __inline__ uint8_t __iCliRetVal(void)
+{
+	sim_io.sreg &= ~0x80;
+	return 1;
+}
+
+static __inline__ void __iSeiParam(const uint8_t * __s)
+{
+	sim_io.sreg |= 0x80;
+	(void)__s;
+}
+
+static __inline__ void __iRestore(const uint8_t * __s)
+{
+	sim_io.sreg = *__s;
+}
+
+#define ATOMIC_FORCEON uint8_t sreg_save \
+	__attribute__((__cleanup__(__iSeiParam))) = 0
+
+#define ATOMIC_RESTORESTATE uint8_t sreg_save \
+	__attribute__((__cleanup__(__iRestore))) = sim_io.sreg
+
+#define ATOMIC_BLOCK(type) for (type, __ToDo = __iCliRetVal(); \
+	__ToDo; __ToDo = 0)
+
+#endif /* __SIM_UTIL_ATOMIC_H__ */
@@ -0,0 +1,17 @@
+/*
+ * Copyright(C) 2021 Robinson (Bob) Mittman. All Rights Reserved.
+ * Licensed under the MIT license. 
+ * See LICENSE file in the project root for details.
+ *
+ */
+
+/* Host replacement for <util/delay.h>: busy waits take no simulated
+   time. */
+
+#ifndef __SIM_UTIL_DELAY_H__
+#define __SIM_UTIL_DELAY_H__
+
+#define _delay_ms(ms) do { (void)(ms); } while (0)
+#define _delay_us(us) do { (void)(us); } while (0)
+
+#endif /* __SIM_UTIL_DELAY_H__ */
@@ -6,48 +6,99 @@
  */
 
 #include "io.h"
+#include "rc433.h"
+#include "isrprof.h"
 #include <avr/interrupt.h> 
+#include <avr/sleep.h> 
 #include <util/atomic.h>
 
 struct {
-	struct {
-		volatile uint8_t set;
-	} ev;
-
-	volatile uint8_t tmr[2];
-	volatile uint8_t led_tmr;
+	struct tmr led;
+#if (IO_TICKLESS)
+	/* counter at the last update of tmr_now */
+	uint8_t cnt;
+#endif
+#if (IO_LOWPWR)
+	/* powering down is allowed from tick 'hold' on, once 'held' clears */
+	uint16_t hold;
+	uint8_t held;
+#endif
+	struct io_duty duty;
 } io;
 
-/* compare interrupt service routine */
-ISR(TIMER2_COMPA_vect) 
+#if (IO_TICKLESS)
+#define IO_TMR_LAT PROF_LAT_FREE(TCNT2, OCR2A, IO_TMR_DIV)
+#define IO_TMR_CS ((1 << CS22) | (1 << CS21) | (1 << CS20))
+
+/* Move tmr_now up to the counter, at least once per turn. Interrupts
+   disabled. Returns the count. */
+static inline uint8_t io_tmr_update(void)
 {
-	uint8_t ev;
-	uint8_t tmr;
+	uint8_t c = TCNT2;
+	uint8_t n = c - io.cnt;
 
-	dbg0_toggle();
+	io.cnt = c;
+	tmr_advance(n);
+	io.duty.awake += n;
 
-	ev = 0;
+	return c;
+}
+#else
+#define IO_TMR_LAT PROF_LAT(TCNT2, IO_TMR_TOP, IO_TMR_DIV)
+#define IO_TMR_CS ((1 << CS22) | (1 << CS21))
+#endif
 
-	if ((tmr = io.tmr[0]) != 0) {
-		if (--tmr == 0)
-			ev |= EV_TMR0; 
-		io.tmr[0] = tmr;
-	}
+/* compare interrupt service routine */
+PROF_ISR(TIMER2_COMPA_vect, RC433_ISR_TMR2, IO_TMR_LAT) 
+{
+	dbg0_toggle();
 
-	if ((tmr = io.tmr[1]) != 0) {
-		if (--tmr == 0)
-			ev |= EV_TMR1; 
-		io.tmr[1] = tmr;
-	}
+#if (IO_TICKLESS)
+	/* the longest period, unless io_sleep() has a nearer deadline */
+	OCR2A = io_tmr_update() + IO_TMR_MAX;
+#else
+	tmr_tick();
+	io.duty.awake++;
+#endif
+}
 
-	if ((tmr = io.led_tmr) != 0) {
-		if (--tmr == 0)
-			led_off();
-		io.led_tmr = tmr;
-	}
+#if (IO_LOWPWR)
+static inline void io_hold(void)
+{
+	io.hold = tmr_now + IO_PWR_HOLD;
+	io.held = 1;
+}
+#endif
+
+#if (IO_TICKLESS)
+/* Program the compare match for the nearest deadline, the end of the
+   power down hold included, two counts away at least so that the counter
+   cannot get past it before the write. Interrupts disabled, tmr_now up
+   to date. Returns 0 if a deadline is due already. */
+static uint8_t io_tmr_sched(void)
+{
+	uint16_t d = tmr_next();
+
+#if (IO_LOWPWR)
+	if (io.held && ((uint16_t)(io.hold - tmr_now) < d))
+		d = io.hold - tmr_now;
+#endif
+	if (d == 0)
+		return 0;
+
+	if (d > IO_TMR_MAX)
+		d = IO_TMR_MAX;
+	else if (d < 2)
+		d = 2;
+	OCR2A = io.cnt + d;
+
+	return 1;
+}
+#endif
 
-	/* set event bits */
-	io.ev.set |= ev;
+static void io_led_off(struct tmr * t)
+{
+	led_off();
 }
 
 void io_init(void) 
@@ -56,53 +107,138 @@ void io_init(void)
 	/* Set PB0 as output debug */
 	DDRB = (1 << 5) | (1 << 0);
 
-	io.ev.set = 0;
-	io.tmr[0] = 0;
-	io.tmr[1] = 0;
-	io.led_tmr = 0;
-
+	tmr_init();
+	tmr_setup(&io.led, io_led_off, 0);
+
+	io.duty.awake = 0;
+	io.duty.down = 0;
+	io.duty.tick_us = IO_TICK_US;
+#if (IO_LOWPWR)
+	io_hold();
+#endif
+
+#if (IO_TICKLESS)
+	/* normal mode, the counter runs free */
+	TCCR2A = 0;
+	TCNT2 = 0;
+	io.cnt = 0;
+	OCR2A = IO_TMR_MAX;
+#else
 	/* Set timer CTC mode */
 	TCCR2A = (1 << WGM21);
-	/* enable Timer Match A Interrupts */
-	TIMSK2 = (1 << OCIE2A);
     /* reset timer counter */
 	TCNT2 = 0; 
 	/* */
 	OCR2A = IO_TMR_TOP; 
-    /* enable timer clock with prescaler = 256 */ 
-	TCCR2B = (1 << CS22) | (1 << CS21);
+#endif
+	/* enable Timer Match A Interrupts */
+	TIMSK2 = (1 << OCIE2A);
+    /* enable timer clock with prescaler = 256, 1024 tickless */ 
+	TCCR2B = IO_TMR_CS;
 }
 
-void io_tmr0_set(uint8_t itv)
+#if (IO_TICKLESS)
+uint16_t io_ms(void)
 {
-	io.tmr[0] = itv;
-}
+	uint32_t t;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		io_tmr_update();
+		t = io.duty.awake;
+	}
 
-void io_tmr1_set(uint8_t itv)
+	/* ticks of IO_TICK_US, without overflowing */
+	return ((uint16_t)(t / 1000) * IO_TICK_US) +
+		(uint16_t)(((t % 1000) * IO_TICK_US) / 1000);
+}
+#else
+uint16_t io_ms(void)
 {
-	io.tmr[1] = itv;
+	uint16_t t;
+	uint8_t c;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		c = TCNT2;
+		t = tmr_now;
+		/* the counter wrapped, the interrupt is still pending */
+		if ((TIFR2 & (1 << OCF2A)) && (c < (IO_TMR_TOP / 2)))
+			t++;
+	}
+
+	return (t * IO_TICKS_MS) + ((c * IO_TICKS_MS) / ((IO_TMR_TOP) + 1));
 }
+#endif
 
-void led_flash(uint8_t itv)
+void led_flash(uint16_t itv)
 {
-	io.led_tmr = itv;
+	tmr_start(&io.led, itv, 0);
 	led_on();
 }
 
 uint8_t io_events_get(void)
 {
-	uint8_t set;
-
-	/* acknowledge events */
+#if (IO_TICKLESS)
 	ATOMIC_BLOCK(ATOMIC_FORCEON)
 	{
-   //cli();
-		set = io.ev.set;
-		io.ev.set = 0;
-   //sei();
+		io_tmr_update();
 	}
+#endif
 
-	/* return events bitmap */
-	return set;
+	/* the timers are the only source */
+	return tmr_run();
 }
 
+void io_duty_get(struct io_duty * duty)
+{
+	ATOMIC_BLOCK(ATOMIC_FORCEON)
+	{
+		*duty = io.duty;
+	}
+}
+
+void io_sleep(void)
+{
+	cli();
+#if (IO_TICKLESS)
+	io_tmr_update();
+#endif
+#if (IO_LOWPWR)
+	if (!rc433_rx_idle())
+		io_hold();
+	else if (io.held && ((int16_t)(tmr_now - io.hold) >= 0))
+		io.held = 0;
+
+	if (!io.held && (tmr_pending() == 0)) {
+		rc433_rx_wake();
+		/* stop the tick */
+		TCCR2B = 0;
+		set_sleep_mode(SLEEP_MODE_PWR_DOWN);
+		sleep_enable();
+		sei();
+		sleep_cpu();
+		sleep_disable();
+		set_sleep_mode(SLEEP_MODE_IDLE);
+		/* restart it, tickless from the count it stopped at */
+#if !(IO_TICKLESS)
+		TCNT2 = 0;
+#endif
+		TCCR2B = IO_TMR_CS;
+		io_hold();
+		io.duty.down++;
+		return;
+	}
+#endif
+#if (IO_TICKLESS)
+	if (!io_tmr_sched()) {
+		sei();
+		return;
+	}
+#endif
+	/* the interrupts are enabled with the sleep instruction next */
+	sleep_enable();
+	sei();
+	sleep_cpu();
+	sleep_disable();
+}
@@ -9,14 +9,50 @@
 #define __IO_H__
 
 #include <avr/io.h>
-
+#include "tmr.h"
+
+/* Tickless: Timer2 runs free at clk/1024 and interrupts at the nearest
+   deadline only, programmed by io_sleep(), or at the latest once per
+   turn of the counter. A tick is one count, 128 us at 8 MHz, instead of
+   the 8 ms of the periodic tick. Needs TMR_SORTED (tmr.h). */
+#ifndef IO_TICKLESS
+#define IO_TICKLESS 0
+#endif
+
+#if (IO_TICKLESS)
+#if !(TMR_SORTED)
+#error "IO_TICKLESS needs TMR_SORTED"
+#endif
+#define IO_TMR_DIV 1024
+/* counts to the next interrupt at most, a turn less the ISR latency */
+#define IO_TMR_MAX 254
+#define IO_TICK_US (((IO_TMR_DIV) * 1000000l) / (F_CPU))
+#else
 #define IO_TMR_TOP 249
-#define IO_TICKS_MS ((((IO_TMR_TOP) + 1l) * 256 * 1000l) / (F_CPU))
-
-#define IO_MS2TICKS(__MS__) ((__MS__) / IO_TICKS_MS)
-
+#define IO_TMR_DIV 256
+#define IO_TICKS_MS ((((IO_TMR_TOP) + 1l) * (IO_TMR_DIV) * 1000l) / (F_CPU))
+#define IO_TICK_US (IO_TICKS_MS * 1000l)
+#endif
+
+#define IO_MS2TICKS(__MS__) (((__MS__) * 1000l) / IO_TICK_US)
+
+/* Power down in io_sleep() while nothing is going on: no timer running
+   and the receiver between frames. The tick stops and the start bit of
+   the next character on RXD wakes the MCU up. io_ms() does not advance
+   while powered down. */
+#ifndef IO_LOWPWR
+#define IO_LOWPWR 0
+#endif
+
+/* ticks to stay up after a wake-up or a character, longer than the gap
+   between the frames of a burst, less than 0x8000 */
+#ifndef IO_PWR_HOLD
+#define IO_PWR_HOLD IO_MS2TICKS(50)
+#endif
+
+/* event bits of the application timers (tmr.h) */
 #define EV_TMR0 (1 << 0)
-#define EV_TMR1 (1 << 0)
+#define EV_TMR1 (1 << 1)
 
 static inline void led_off(void) {
 	PORTB &= ~(1 << 5);
@@ -56,13 +92,29 @@ static inline void dbg1_toggle(void) {
 
 void io_init(void);
 
-void  io_tmr0_set(uint8_t itv);
+/* Event bits of the timers that fired, tmr_run(). Their callbacks run
+   from here. */
+uint8_t io_events_get(void);
 
-void  io_tmr1_set(uint8_t itv);
+/* milliseconds, wrapping, also from an interrupt service routine */
+uint16_t io_ms(void);
 
-uint8_t io_events_get(void);
+/* LED on for 'itv' ticks */
+void led_flash(uint16_t itv);
+
+/* Duty cycle. The timer runs whenever the MCU is not powered down, so the
+   time awake is 'awake' ticks of 'tick_us' and the time powered down the
+   rest of the time since io_init(). */
+struct io_duty {
+	uint32_t awake;
+	uint16_t down;
+	uint16_t tick_us;
+};
+
+void io_duty_get(struct io_duty * duty);
 
-void led_flash(uint8_t itv);
+/* Sleep until the next interrupt, powered down when possible. */
+void io_sleep(void);
 
 #endif /* __IO_H__ */
 
@@ -0,0 +1,175 @@
+/*
+ * Copyright(C) 2021 Robinson (Bob) Mittman. All Rights Reserved.
+ * Licensed under the MIT license.
+ * See LICENSE file in the project root for details.
+ *
+ */
+
+#include "io.h"
+#include "mon.h"
+#include "isrprof.h"
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+
+#ifndef MON_BUF_LEN
+#define MON_BUF_LEN 64
+#endif
+
+#if (MON_BUF_LEN & (MON_BUF_LEN - 1)) || (MON_BUF_LEN > 128)
+#error "MON_BUF_LEN must be a power of two not greater than 128"
+#endif
+
+#define MON_BUF_MSK (MON_BUF_LEN - 1)
+
+/* sync, type and length, time, checksum */
+#define MON_REC_OVH 5
+
+/* Byte queue to USART_UDRE_vect. mon_put() owns 'head', the ISR 'tail'. */
+struct {
+	volatile uint8_t head;
+	volatile uint8_t tail;
+	uint16_t drop;
+	/* receiver error counters at the last error record */
+	uint16_t err;
+	uint16_t sym;
+	uint16_t unc;
+	uint16_t ovr;
+	uint8_t buf[MON_BUF_LEN];
+} mon;
+
+PROF_ISR(USART_UDRE_vect, RC433_ISR_UDRE, 0)
+{
+	uint8_t tail = mon.tail;
+
+	if (tail == mon.head) {
+		/* drained, disable the Data Register Empty Interrupt */
+		UCSR0B &= ~(1 << UDRIE0);
+		return;
+	}
+
+	UDR0 = mon.buf[tail & MON_BUF_MSK];
+	mon.tail = tail + 1;
+}
+
+/* Queue a record stamped 't', 1 to 64 bytes of payload. Never waits: a
+   record that does not fit is dropped. */
+static uint8_t mon_put(uint8_t type, uint16_t t, const uint8_t dat[],
+					   uint8_t len)
+{
+	uint8_t head = mon.head;
+	uint8_t sum;
+	uint8_t c;
+	uint8_t i;
+
+	if ((uint8_t)(MON_BUF_LEN - (uint8_t)(head - mon.tail)) <
+		len + MON_REC_OVH) {
+		mon.drop++;
+		return 0;
+	}
+
+	mon.buf[head++ & MON_BUF_MSK] = MON_SYNC;
+	c = (type << 6) | (len - 1);
+	mon.buf[head++ & MON_BUF_MSK] = c;
+	sum = c;
+	c = t;
+	mon.buf[head++ & MON_BUF_MSK] = c;
+	sum += c;
+	c = t >> 8;
+	mon.buf[head++ & MON_BUF_MSK] = c;
+	sum += c;
+
+	for (i = 0; i < len; ++i) {
+		c = dat[i];
+		mon.buf[head++ & MON_BUF_MSK] = c;
+		sum += c;
+	}
+
+	mon.buf[head++ & MON_BUF_MSK] = -sum;
+	mon.head = head;
+
+	ATOMIC_BLOCK(ATOMIC_FORCEON)
+	{
+		/* enable the Data Register Empty Interrupt */
+		UCSR0B |= (1 << UDRIE0);
+	}
+
+	return 1;
+}
+
+static inline uint8_t mon_delta(uint16_t now, uint16_t * last)
+{
+	uint16_t d = now - *last;
+
+	*last = now;
+	return (d > 0xff) ? 0xff : d;
+}
+
+int8_t mon_recv(uint8_t dat[])
+{
+	struct rc433_rx_stat st;
+	uint8_t e[4];
+	int8_t len;
+
+	rc433_rx_stat_get(&st);
+	if ((st.err != mon.err) || (st.sym != mon.sym) ||
+		(st.unc != mon.unc) || (st.ovr != mon.ovr)) {
+		e[0] = mon_delta(st.err, &mon.err);
+		e[1] = mon_delta(st.sym, &mon.sym);
+		e[2] = mon_delta(st.unc, &mon.unc);
+		e[3] = mon_delta(st.ovr, &mon.ovr);
+		mon_put(MON_ERR, io_ms(), e, 4);
+	}
+
+#if (RFLINK_FRM_MAX)
+	len = rc433_frm_recv(dat);
+#else
+	len = rc433_pkt_recv(dat);
+#endif
+	if (len > 0) {
+		mon_put((rc433_frm_type() == RC433_TYP_VAR) ? MON_FRM : MON_PKT,
+				rc433_rx_time(), dat, len);
+	}
+
+	return len;
+}
+
+static inline uint8_t * mon_u16(uint8_t * p, uint16_t v)
+{
+	*p++ = v;
+	*p++ = v >> 8;
+	return p;
+}
+
+void mon_status(void)
+{
+	struct rc433_rx_stat st;
+	uint8_t s[MON_STAT_LEN];
+	uint8_t * p = s;
+
+	rc433_rx_stat_get(&st);
+	p = mon_u16(p, st.ovr);
+	p = mon_u16(p, st.err);
+	p = mon_u16(p, st.sym);
+	p = mon_u16(p, st.fix);
+	p = mon_u16(p, st.fec);
+	p = mon_u16(p, st.unc);
+	p = mon_u16(p, st.cal);
+	p = mon_u16(p, st.dup);
+	p = mon_u16(p, mon.drop);
+	p = mon_u16(p, st.clk_ppm);
+	mon_u16(p, (uint32_t)st.clk_ppm >> 16);
+
+	mon_put(MON_STAT, io_ms(), s, MON_STAT_LEN);
+}
+
+void mon_init(void)
+{
+	struct rc433_rx_stat st;
+
+	/* the errors from now on */
+	rc433_rx_stat_get(&st);
+	mon.err = st.err;
+	mon.sym = st.sym;
+	mon.unc = st.unc;
+	mon.ovr = st.ovr;
+}
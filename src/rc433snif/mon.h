@@ -0,0 +1,57 @@
+/*
+ * Copyright(C) 2021 Robinson (Bob) Mittman. All Rights Reserved.
+ * Licensed under the MIT license.
+ * See LICENSE file in the project root for details.
+ *
+ */
+
+/* Link monitor: the frames received, the receive errors and the receiver
+   status are streamed to a host on TXD, at the link baud rate, as binary
+   records:
+
+     0      MON_SYNC
+     1      type << 6 | (payload length - 1)
+     2, 3   io_ms(), little endian: when the frame was received, when the
+            record was queued for the others
+     4..    payload
+     last   checksum, the bytes from 1 on add up to 0
+
+   A packet record is 9 bytes, shorter than the shortest frame on the air,
+   so the stream keeps up with back-to-back frames. Every copy of a
+   repeated packet gets its record: the link is built with
+   RFLINK_RX_DEDUP=0. Records are queued whole or dropped whole when the
+   buffer is full, and counted. */
+
+#ifndef __MON_H__
+#define __MON_H__
+
+#include <stdint.h>
+#include "rc433.h"
+
+#define MON_SYNC 0xa5
+
+/* payload: 4 byte packet */
+#define MON_PKT  0
+/* payload: variable length frame */
+#define MON_FRM  1
+/* payload: CRC, symbol, uncorrectable FEC and overrun errors since the
+   previous record, one byte each, saturated */
+#define MON_ERR  2
+/* payload: the ovr, err, sym, fix, fec, unc, cal and dup counters of
+   struct rc433_rx_stat and the records dropped, 16 bit each, then
+   clk_ppm, 32 bit, all little endian */
+#define MON_STAT 3
+
+#define MON_STAT_LEN 22
+
+void mon_init(void);
+
+/* rc433_frm_recv() (rc433_pkt_recv() without variable length frames)
+   that also sends a record of every frame and of the errors seen since
+   the last call */
+int8_t mon_recv(uint8_t dat[]);
+
+/* send a status record */
+void mon_status(void);
+
+#endif /* __MON_H__ */
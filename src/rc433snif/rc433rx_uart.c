@@ -6,9 +6,13 @@
  */
 
 #include "io.h"
+#include "rc433.h"
+#include "isrprof.h"
 #include <util/delay.h>
+#include <util/atomic.h>
 #include <avr/interrupt.h> 
 #include <avr/sleep.h> 
+#include <stddef.h>
 
 #define USART_BAUDRATE 4800
 
@@ -29,6 +33,34 @@
 #define EIGHT_BIT   (3 << UCSZ00)
 #define DATA_BIT   EIGHT_BIT 
 
+/* Check the frame inside USART_RX_vect: the CRC5 is accumulated as the
+   symbols arrive and the frame is dropped on the first invalid symbol or
+   on a CRC mismatch, so only good frames reach the ring. */
+#ifndef RFLINK_RX_CHECK_ISR
+#define RFLINK_RX_CHECK_ISR 1
+#endif
+
+/* Answer the packets sent with rc433_arq_send() with an ACK frame on
+   TXD. A passive link monitor, which has TXD to itself, leaves it out and
+   still receives them. */
+#ifndef RFLINK_RX_ACK
+#define RFLINK_RX_ACK RFLINK_ARQ
+#endif
+
+#if (RFLINK_RX_ACK) && !(RFLINK_ARQ)
+#error "RFLINK_RX_ACK needs RFLINK_ARQ"
+#endif
+
+/* Stamp every frame with io_ms() as USART_RX_vect completes it,
+   rc433_rx_time(). */
+#ifndef RFLINK_RX_TIME
+#define RFLINK_RX_TIME 0
+#endif
+
+#if (RFLINK_ISR_PROF) && (RFLINK_TSTAMP)
+#error "RFLINK_ISR_PROF and RFLINK_TSTAMP both need Timer1"
+#endif
+
 const uint8_t crc5lut[256] = {
 	0x00, 0x0e, 0x1c, 0x12, 0x11, 0x1f, 0x0d, 0x03, 
 	0x0b, 0x05, 0x17, 0x19, 0x1a, 0x14, 0x06, 0x08, 
@@ -59,17 +91,89 @@ const uint8_t crc5lut[256] = {
 	0x08, 0x06, 0x14, 0x1a, 0x19, 0x17, 0x05, 0x0b, 
 	0x03, 0x0d, 0x1f, 0x11, 0x12, 0x1c, 0x0e, 0x00, 
 	0x1b, 0x15, 0x07, 0x09, 0x0a, 0x04, 0x16, 0x18, 
-	0x12, 0x1e, 0x0c, 0x02, 0x01, 0x0f, 0x1d, 0x13, 
+	0x10, 0x1e, 0x0c, 0x02, 0x01, 0x0f, 0x1d, 0x13, 
 	0x0d, 0x03, 0x11, 0x1f, 0x1c, 0x12, 0x00, 0x0e, 
 	0x06, 0x08, 0x1a, 0x14, 0x17, 0x19, 0x0b, 0x05 
 };
 
+/* Soft decoding: bytes at Hamming distance 1 from exactly one data
+   codeword (and from no sync marker) decode to that nibble with bit 5
+   set, so the ISR can count the correction. Bytes at distance 1 from
+   two codewords stay invalid. Only exact sync markers are accepted. */
+#ifndef RFLINK_RX_SOFT_DECODE
+#define RFLINK_RX_SOFT_DECODE 0
+#endif
+
+#define RF_SYM_FIX 0x20
+
+#define PKT_LEN 4
+
+/* RS parity bytes of a FEC frame */
+#define FEC_LEN 2
+
+/* decode_lut[0xfc], [0xc0] and [0x1f]: replace the last sync of a FEC,
+   a variable length or an acknowledged frame */
+#define RF_FEC_MARK 0x14
+#define RF_VAR_MARK 0x10
+#define RF_ARQ_MARK 0x15
+
+#if (RFLINK_RX_SOFT_DECODE)
+const uint8_t decode_lut[256] = {
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0x2c, 0xff, 0xff, 0xff, 0xff,
+	/* 0x10 */
+	0xff, 0xff, 0xff, 0xff, 0xff, 0x2d, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x15,
+	/* 0x20 */
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0x2f, 0xff, 0xff, 0x2f, 0x0f, 0xff, 0x2f,
+	/* 0x30 */
+	0xff, 0xff, 0xff, 0xff, 0x25, 0xff, 0x05, 0x25,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0x2f, 0x25, 0xff,
+	/* 0x40 */
+	0xff, 0xff, 0xff, 0x2c, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0x0c, 0x2a, 0x0a, 0xff, 0xff,
+	/* 0x50 */
+	0xff, 0x2d, 0xff, 0xff, 0xff, 0x0d, 0x01, 0xff,
+	0x26, 0xff, 0x06, 0xff, 0xff, 0xff, 0xff, 0xff,
+	/* 0x60 */
+	0xff, 0x2b, 0xff, 0xff, 0xff, 0x0b, 0x00, 0xff,
+	0x23, 0xff, 0x03, 0xff, 0xff, 0xff, 0xff, 0xff,
+	/* 0x70 */
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	/* 0x80 */
+	0xff, 0xff, 0xff, 0xff, 0xff, 0x2e, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	/* 0x90 */
+	0xff, 0xff, 0xff, 0xff, 0x24, 0xff, 0x04, 0x24,
+	0x28, 0xff, 0x08, 0x28, 0xff, 0xff, 0xff, 0xff,
+	/* 0xa0 */
+	0xff, 0x2e, 0xff, 0xff, 0xff, 0x0e, 0x02, 0xff,
+	0x27, 0xff, 0x07, 0x27, 0xff, 0xff, 0xff, 0xff,
+	/* 0xb0 */
+	0xff, 0xff, 0x09, 0x29, 0xff, 0x2e, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	/* 0xc0 */
+	0x10, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0x2c, 0xff, 0x2a, 0xff, 0xff,
+	/* 0xd0 */
+	0xff, 0xff, 0xff, 0xff, 0xff, 0x2d, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	/* 0xe0 */
+	0x11, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	/* 0xf0 */
+	0x12, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0x13, 0xff, 0xff, 0xff, 0x14, 0xff, 0xff, 0xff 
+};
+#else
 const uint8_t decode_lut[256] = {
     0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 
 	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 
 	/* 0x10 */
 	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 
-	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x15, 
 	/* 0x20 */
 	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 
 	0xff, 0xff, 0xff, 0xff, 0xff, 0x0f, 0xff, 0xff, 
@@ -113,7 +217,9 @@ const uint8_t decode_lut[256] = {
 	0x12, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 
 	0x13, 0xff, 0xff, 0xff, 0x14, 0xff, 0xff, 0xff 
 };
+#endif
 
+#if !(RFLINK_RX_CHECK_ISR) || (RFLINK_FEC)
 static uint8_t rflink_crc5(uint8_t d[])
 {
 	uint8_t crc;
@@ -130,6 +236,278 @@ static uint8_t rflink_crc5(uint8_t d[])
 	crc ^= 0x1f;
 	return crc & 0x1f;
 }
+#endif
+
+#if (RFLINK_FEC)
+/* GF(16), x^4 + x + 1. The exp table is doubled so the sum of two logs
+   needs no reduction. */
+static const uint8_t gf16_exp[30] = {
+	0x01, 0x02, 0x04, 0x08, 0x03, 0x06, 0x0c, 0x0b, 
+	0x05, 0x0a, 0x07, 0x0e, 0x0f, 0x0d, 0x09, 0x01, 
+	0x02, 0x04, 0x08, 0x03, 0x06, 0x0c, 0x0b, 0x05, 
+	0x0a, 0x07, 0x0e, 0x0f, 0x0d, 0x09
+};
+
+static const uint8_t gf16_log[16] = {
+	0x00, 0x00, 0x01, 0x04, 0x02, 0x08, 0x05, 0x0a, 
+	0x03, 0x0e, 0x09, 0x07, 0x06, 0x0d, 0x0b, 0x0c
+};
+
+static uint8_t gf16_mul(uint8_t a, uint8_t b)
+{
+	if ((a == 0) || (b == 0))
+		return 0;
+	return gf16_exp[gf16_log[a] + gf16_log[b]];
+}
+
+static uint8_t gf16_div(uint8_t a, uint8_t b)
+{
+	if (a == 0)
+		return 0;
+	return gf16_exp[gf16_log[a] + 15 - gf16_log[b]];
+}
+
+/* evaluate p(x), 'n' coefficients, low order first */
+static uint8_t gf16_poly_eval(const uint8_t p[], uint8_t n, uint8_t x)
+{
+	uint8_t y = 0;
+
+	while (n--)
+		y = gf16_mul(y, x) ^ p[n];
+	return y;
+}
+
+#define RS_N (2 * (PKT_LEN + FEC_LEN))
+#define RS_T2 (2 * FEC_LEN)
+
+/* Errors and erasures decoder of the shortened RS(12,8) code. 'c' holds
+   the 12 received nibbles in line order, c[j] is the coefficient of
+   x^(11 - j); bit j of 'era' flags c[j] as erased. Corrects 'c' in place
+   and returns the number of symbols repaired, -1 if it can't. */
+static int8_t rflink_fec_decode(uint8_t c[], uint16_t era)
+{
+	uint8_t s[RS_T2];
+	uint8_t lam[RS_T2 + 1];
+	uint8_t b[RS_T2 + 1];
+	uint8_t t[RS_T2 + 1];
+	uint8_t om[RS_T2];
+	uint8_t nz = 0;
+	uint8_t f = 0;
+	uint8_t l;
+	uint8_t r;
+	uint8_t i;
+	uint8_t j;
+	int8_t n;
+
+	/* syndromes S1..S4 */
+	for (i = 0; i < RS_T2; ++i) {
+		uint8_t a = gf16_exp[i + 1];
+		uint8_t y = 0;
+
+		for (j = 0; j < RS_N; ++j)
+			y = gf16_mul(y, a) ^ c[j];
+		s[i] = y;
+		nz |= y;
+	}
+
+	if (nz == 0)
+		return 0;
+
+	/* erasure locator */
+	for (i = 0; i <= RS_T2; ++i)
+		lam[i] = 0;
+	lam[0] = 1;
+	for (j = 0; j < RS_N; ++j) {
+		if (era & (1 << j)) {
+			uint8_t x = gf16_exp[RS_N - 1 - j];
+
+			for (i = ++f; i > 0; --i)
+				lam[i] ^= gf16_mul(lam[i - 1], x);
+		}
+	}
+
+	/* Berlekamp-Massey, started from the erasure locator */
+	for (i = 0; i <= RS_T2; ++i)
+		b[i] = lam[i];
+	l = f;
+	for (r = f + 1; r <= RS_T2; ++r) {
+		uint8_t d = 0;
+
+		for (i = 0; (i <= l) && (i < r); ++i)
+			d ^= gf16_mul(lam[i], s[r - 1 - i]);
+
+		/* b = x b */
+		for (i = RS_T2; i > 0; --i)
+			b[i] = b[i - 1];
+		b[0] = 0;
+
+		if (d == 0)
+			continue;
+
+		for (i = 0; i <= RS_T2; ++i)
+			t[i] = lam[i] ^ gf16_mul(d, b[i]);
+
+		if (2 * l <= r + f - 1) {
+			for (i = 0; i <= RS_T2; ++i)
+				b[i] = gf16_div(lam[i], d);
+			l = r + f - l;
+		}
+
+		for (i = 0; i <= RS_T2; ++i)
+			lam[i] = t[i];
+	}
+
+	if (l > RS_T2)
+		return -1;
+
+	/* evaluator: S(x) lambda(x) mod x^4 */
+	for (i = 0; i < RS_T2; ++i) {
+		uint8_t y = 0;
+
+		for (j = 0; j <= i; ++j)
+			y ^= gf16_mul(lam[j], s[i - j]);
+		om[i] = y;
+	}
+
+	/* Chien search over the 12 positions in use, Forney for the values */
+	n = 0;
+	for (j = 0; j < RS_N; ++j) {
+		/* X^-1 for position x^(11 - j) */
+		uint8_t xi = gf16_exp[15 - (RS_N - 1 - j)];
+		uint8_t dl;
+
+		if (gf16_poly_eval(lam, l + 1, xi) != 0)
+			continue;
+
+		/* formal derivative: odd terms only */
+		dl = 0;
+		for (i = 1; i <= l; i += 2)
+			dl ^= gf16_mul(lam[i], gf16_exp[(gf16_log[xi] * (i - 1)) % 15]);
+		if (dl == 0)
+			return -1;
+
+		c[j] ^= gf16_div(gf16_poly_eval(om, RS_T2, xi), dl);
+		n++;
+	}
+
+	/* every root must be in the shortened codeword */
+	if (n != l)
+		return -1;
+
+	return n;
+}
+#endif
+
+/* Clock calibration. The sniffer runs from the internal RC oscillator,
+   factory trimmed to a few percent and drifting with temperature and
+   supply, while the transmitter is crystal controlled. Every character
+   starts with the falling edge of its start bit, and a 0xf0 sync symbol
+   has no other, so the syncs of the preamble, back to back, fall 10
+   transmitter bit times apart. RXD (PD0) is also PCINT16: the pin change
+   interrupt timestamps the falling edges with the free running Timer1
+   and the periods close to the nominal length steer OSCCAL, one step at
+   a time, until the local bit time matches the transmitter. Falling to
+   falling, the duty cycle distortion of the receiver slicer, which moves
+   the rising edges, does not count. The loop keeps running, so it also
+   follows the drift. Off by default (make CAL=1): it keeps Timer1
+   running and takes an interrupt on every RXD edge. */
+#ifndef RFLINK_RX_CAL
+#define RFLINK_RX_CAL 0
+#endif
+
+/* Timer1 runs at clk/1 for the calibration and the ISR profiling, at
+   clk/8 when the frames are time stamped: 1 us and a 65 ms period at
+   8 MHz */
+#if (RFLINK_TSTAMP)
+#define TMR1_CS (1 << CS11)
+#define TMR1_DIV 8
+#else
+#define TMR1_CS (1 << CS10)
+#define TMR1_DIV 1
+#endif
+
+#if (RFLINK_RX_CAL)
+/* 0xf0 period in Timer1 ticks, 10 bit times at the UBRR0 rate rather
+   than at USART_BAUDRATE: the transmitter UBRR0 rounds the same way, so
+   this is the length that makes the two USARTs agree */
+#define CAL_NOM ((int16_t)(10 * 16 * ((F_CPU) / ((USART_BAUDRATE) * 16ul)) / \
+						   TMR1_DIV))
+/* acceptance window, +-8%, less than a bit: the periods of 9 or 11 bit
+   times and the gaps between frames are left out. Whatever else falls
+   10 bit times apart is a character period as well. */
+#define CAL_WIN (CAL_NOM / 12)
+/* periods averaged per correction */
+#define CAL_AVG 8
+/* dead band, +-0.8%, wider than one OSCCAL step */
+#define CAL_TOL (CAL_NOM / 128)
+
+struct {
+	uint16_t t0;
+	int16_t acc;
+	uint8_t cnt;
+	/* last averaged error, in Timer1 ticks over CAL_AVG periods */
+	volatile int16_t err;
+	volatile uint16_t adj;
+} cal;
+
+PROF_ISR(PCINT2_vect, RC433_ISR_PCINT, 0)
+{
+	uint16_t t = TCNT1;
+	int16_t d;
+	uint8_t osc;
+
+	/* falling edges only */
+	if (PIND & (1 << 0))
+		return;
+
+	d = (int16_t)(uint16_t)(t - cal.t0) - CAL_NOM;
+	cal.t0 = t;
+	if ((d > CAL_WIN) || (d < -CAL_WIN))
+		return;
+
+	cal.acc += d;
+	if (++cal.cnt < CAL_AVG)
+		return;
+
+	cal.err = cal.acc;
+	osc = OSCCAL;
+	/* a long period means the local clock is fast. Stay in the
+	   current OSCCAL range, the two ranges overlap. */
+	if ((cal.acc > CAL_TOL * CAL_AVG) && ((osc & 0x7f) != 0x00)) {
+		OSCCAL = osc - 1;
+		cal.adj++;
+	} else if ((cal.acc < -CAL_TOL * CAL_AVG) && ((osc & 0x7f) != 0x7f)) {
+		OSCCAL = osc + 1;
+		cal.adj++;
+	}
+
+	cal.acc = 0;
+	cal.cnt = 0;
+}
+
+static void cal_init(void)
+{
+	/* pin change interrupt on PD0 (RXD) */
+	PCMSK2 |= (1 << PCINT16);
+	PCICR |= (1 << PCIE2);
+}
+#else
+/* wake-up only, armed by rc433_rx_wake() */
+PROF_ISR(PCINT2_vect, RC433_ISR_PCINT, 0)
+{
+	PCICR &= ~(1 << PCIE2);
+}
+#endif
+
+void rc433_rx_wake(void)
+{
+#if !(RFLINK_RX_CAL)
+	PCIFR = (1 << PCIF2);
+	PCMSK2 |= (1 << PCINT16);
+	PCICR |= (1 << PCIE2);
+#endif
+	/* otherwise always armed, the calibration ISR takes the edge */
+}
 
 void usart_init(void)
 {
@@ -149,127 +527,744 @@ void usart_init(void)
 	DDRD |= (1 << 1);
 	/* Set PD0 as input RXD */
 	DDRD &= ~(1 << 0);
+
+#if (RFLINK_RX_CAL) || (RFLINK_TSTAMP) || (RFLINK_ISR_PROF)
+	/* Timer1 free running */
+	TCCR1A = 0;
+	TCCR1B = TMR1_CS;
+#endif
+
+#if (RFLINK_RX_CAL)
+	cal_init();
+#endif
 }
 
+#ifndef RFLINK_RX_FIFO_LEN
+#define RFLINK_RX_FIFO_LEN 4
+#endif
+
+#if (RFLINK_RX_FIFO_LEN & (RFLINK_RX_FIFO_LEN - 1)) || (RFLINK_RX_FIFO_LEN > 128)
+#error "RFLINK_RX_FIFO_LEN must be a power of two not greater than 128"
+#endif
+
+#define RX_FIFO_MSK (RFLINK_RX_FIFO_LEN - 1)
+
+#if (RFLINK_FRM_MAX) && ((RFLINK_FRM_MAX < PKT_LEN) || (RFLINK_FRM_MAX > 64))
+#error "RFLINK_FRM_MAX must be 0 or between 4 and 64"
+#endif
+
+#define RF_MAX(_A_, _B_) (((_A_) > (_B_)) ? (_A_) : (_B_))
+
+/* slot size, the longest frame type compiled in */
+#if (RFLINK_FEC)
+#define PKT_DAT_LEN RF_MAX(PKT_LEN + FEC_LEN, RFLINK_FRM_MAX)
+#else
+#define PKT_DAT_LEN RF_MAX(PKT_LEN, RFLINK_FRM_MAX)
+#endif
+
+/* compiler barrier: keep the slot accesses on the right side of the
+   head/tail updates */
+#define barrier() __asm__ __volatile__ ("" ::: "memory")
+
+/* frame types */
+#define RF_TYP_PKT RC433_TYP_PKT
+#define RF_TYP_FEC RC433_TYP_FEC
+#define RF_TYP_VAR RC433_TYP_VAR
+
 struct pkt {
-	uint8_t dat[4];
+	uint8_t typ;
+	/* payload length of a variable length frame */
+	uint8_t len;
+#if (RFLINK_FEC)
+	/* erased (invalid) symbols of a FEC frame */
+	uint16_t era;
+#endif
+#if (RFLINK_TSTAMP)
+	/* Timer1 at the first symbol after the preamble, then at the last */
+	uint16_t ts;
+#endif
+#if (RFLINK_RX_TIME)
+	/* io_ms() at the last symbol */
+	uint16_t ms;
+#endif
+	uint8_t dat[PKT_DAT_LEN];
 };
 
+/* Single producer (USART_RX_vect) single consumer (rc433_pkt_recv()) ring of
+   decoded frames. The ISR owns 'head' and the slot it points to, the main
+   loop owns 'tail'. A slot is only visible to the consumer after 'head'
+   moves past it, so no interrupt masking is needed on either side. */
 struct {
 	volatile uint8_t head;
 	volatile uint8_t tail;
 	uint8_t state;
-	struct pkt pkt;
+	uint8_t crc;
+	struct pkt * frm;
+	volatile uint16_t ovr;
+	volatile uint16_t err;
+	volatile uint16_t sym;
+	volatile uint16_t fix;
+	/* sync symbols of the current preamble, marker included */
+	uint8_t nsync;
+	/* a character came in, cleared by rc433_rx_idle() */
+	volatile uint8_t act;
+	volatile uint16_t acq[RC433_ACQ_LEN];
+	/* type of the last frame delivered, main loop only */
+	uint8_t typ;
+#if (RFLINK_RX_TIME)
+	/* and its time stamp */
+	uint16_t ms;
+#endif
+#if (RFLINK_TSTAMP)
+	struct rc433_lat air;
+	/* updated by the receive functions only */
+	struct rc433_lat deliver;
+#endif
+#if (RFLINK_FEC)
+	/* erasures in the FEC frame being received */
+	uint8_t nera;
+	/* updated by rc433_pkt_recv() only */
+	uint16_t fec;
+	uint16_t unc;
+#endif
+#if (RFLINK_RX_DEDUP)
+	/* last packet delivered and its copies, main loop only */
+	uint8_t last[PKT_LEN];
+	uint8_t copies;
+	uint16_t dup;
+#endif
+#if (RFLINK_ARQ)
+	/* the packet being received asks for an ACK */
+	uint8_t ack;
+#endif
+#if (RFLINK_FRM_MAX)
+	/* state after the last CRC nibble of the variable length frame */
+	uint8_t end;
+	uint16_t crc16;
+#endif
+	struct pkt pkt[RFLINK_RX_FIFO_LEN];
 } rx;
 
 #define RF_IDLE 0
 #define RF_SYNC 1
 #define RF_SOF  2
-#define RF_EOF 11
+#define RF_EOF (RF_SOF + 2 * PKT_LEN)
+/* FEC frame: data and parity nibbles */
+#define RF_FEC_SOF (RF_EOF + 1)
+#define RF_FEC_EOF (RF_FEC_SOF + 2 * (PKT_LEN + FEC_LEN))
+/* variable length frame: length byte, payload, 4 CRC nibbles. The end
+   depends on the length, see rx.end. */
+#define RF_VAR_SOF (RF_FEC_EOF + 1)
+
+#if (RFLINK_FRM_MAX)
+static const uint16_t crc16lut[16] = {
+	0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7, 
+	0x8108, 0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef
+};
+
+/* CRC-16-CCITT, one nibble at a time, in line order */
+static inline uint16_t crc16_nib(uint16_t crc, uint8_t nib)
+{
+	return (crc << 4) ^ crc16lut[(crc >> 12) ^ nib];
+}
+#endif
 
-ISR(USART_RX_vect)
+#if (RFLINK_RX_ACK)
+#if !(RFLINK_RX_CHECK_ISR)
+#error "RFLINK_RX_ACK needs RFLINK_RX_CHECK_ISR, the ACK is sent from the ISR"
+#endif
+
+#define RF_SYNC_SYM 0xf0
+#define RF_ACK_SYM 0x07
+
+/* ACK frame: 2 mostly high characters to key the transmitter and let
+   the other end settle, 3 syncs, RF_ACK_SYM and the first byte of the
+   packet acknowledged */
+#define RF_ACK_SYM_LEN 8
+
+static const uint8_t encode_lut[16] = {
+	0x66, 0x56, 0xa6, 0x6a, 0x96, 0x36, 0x5a, 0xaa, 0x9a, 0xb2, 0x4d, 
+	0x65, 0x4b, 0x55, 0xa5, 0x2d };
+
+/* ACK transmitter, USART_UDRE_vect and USART_TX_vect */
+struct {
+	volatile uint8_t busy;
+	uint8_t pos;
+	uint8_t sym[RF_ACK_SYM_LEN];
+} ack;
+
+/* Called from USART_RX_vect when a good packet asks for an ACK. */
+static void rflink_ack_send(uint8_t id)
 {
+	if (ack.busy) {
+		/* still sending the previous one, the transmitter will retry */
+		return;
+	}
+
+	ack.sym[0] = 0xff;
+	ack.sym[1] = 0xff;
+	ack.sym[2] = RF_SYNC_SYM;
+	ack.sym[3] = RF_SYNC_SYM;
+	ack.sym[4] = RF_SYNC_SYM;
+	ack.sym[5] = RF_ACK_SYM;
+	ack.sym[6] = encode_lut[id & 0x0f];
+	ack.sym[7] = encode_lut[id >> 4];
+	ack.pos = 0;
+	ack.busy = 1;
+
+	/* half duplex: stop listening while our carrier is on, enable the
+	   Data Register Empty Interrupt */
+	UCSR0B = (UCSR0B & ~(1 << RXEN0)) | (1 << UDRIE0);
+}
+
+PROF_ISR(USART_UDRE_vect, RC433_ISR_UDRE, 0)
+{
+	uint8_t pos = ack.pos;
+
+	UDR0 = ack.sym[pos];
+
+	if (++pos == RF_ACK_SYM_LEN) {
+		/* disable the Data Register Empty Interrupt, enable the Tx
+		   Complete Interrupt */
+		UCSR0B = (UCSR0B & ~(1 << UDRIE0)) | (1 << TXCIE0);
+	}
+
+	ack.pos = pos;
+}
+
+PROF_ISR(USART_TX_vect, RC433_ISR_TXC, 0)
+{
+	/* last stop bit out, listen again */
+	UCSR0B = (UCSR0B & ~(1 << TXCIE0)) | (1 << RXEN0);
+	rx.state = RF_IDLE;
+	ack.busy = 0;
+}
+#endif
+
+#if (RFLINK_TSTAMP)
+#define TS_TICK_NS ((uint16_t)((TMR1_DIV * 1000000000ull) / (F_CPU)))
+#endif
+
+/* Claim the slot at 'head' for a new frame, NULL if the ring is full. */
+static inline struct pkt * rx_frm_open(uint8_t typ)
+{
+	uint8_t head = rx.head;
+	struct pkt * frm;
+
+	if ((uint8_t)(head - rx.tail) == RFLINK_RX_FIFO_LEN) {
+		/* no room for this frame, drop it */
+		rx.ovr++;
+		rx.state = RF_IDLE;
+		return NULL;
+	}
+
+	frm = &rx.pkt[head & RX_FIFO_MSK];
+	frm->typ = typ;
+#if (RFLINK_TSTAMP)
+	frm->ts = TCNT1;
+#endif
+	rx.frm = frm;
+
+	return frm;
+}
+
+/* Make the frame at 'head' visible to the main loop. */
+static inline void rx_frm_publish(void)
+{
+#if (RFLINK_TSTAMP)
+	uint16_t t = TCNT1;
+
+	prof_lat_add(&rx.air, t - rx.frm->ts);
+	rx.frm->ts = t;
+#endif
+#if (RFLINK_RX_TIME)
+	rx.frm->ms = io_ms();
+#endif
+	rx.acq[rx.nsync - 1]++;
+	/* the slot is written before it is published */
+	barrier();
+	rx.head++;
+	rx.state = RF_IDLE;
+}
+
+PROF_ISR(USART_RX_vect, RC433_ISR_RX, 0)
+{
+	struct pkt * frm;
 	uint8_t nibble;
 	uint8_t state;
+	uint8_t pos;
 	uint8_t c;
 
 	c = UDR0;
+	rx.act = 1;
 
 	nibble = decode_lut[c];
 
   	state = rx.state;
 
 	if ((nibble >= 0x11) && (nibble <= 0x13)) {
+#if (RFLINK_ARQ)
+		rx.ack = 0;
+#endif
 		if (state == RF_SYNC) {
 			rx.state = RF_SOF; /* SOF */
 		} else if (state != RF_SOF) {
 			rx.state = RF_SYNC; /* SYNC */
+			rx.nsync = 0;
+		}
+		if (rx.nsync < RC433_ACQ_LEN)
+			rx.nsync++;
+		return;
+	}
+
+	/* the frame type markers end the preamble */
+	if ((nibble >= RF_VAR_MARK) && (nibble <= RF_ARQ_MARK) &&
+		((state == RF_SYNC) || (state == RF_SOF)) &&
+		(rx.nsync < RC433_ACQ_LEN))
+		rx.nsync++;
+
+	/* frame type markers, in place of the last sync */
+#if (RFLINK_FEC)
+	if ((nibble == RF_FEC_MARK) &&
+		((state == RF_SYNC) || (state == RF_SOF))) {
+		if ((frm = rx_frm_open(RF_TYP_FEC)) != NULL) {
+			frm->era = 0;
+			rx.nera = 0;
+			rx.state = RF_FEC_SOF;
+		}
+		return;
+	}
+#endif
+
+#if (RFLINK_ARQ)
+	if ((nibble == RF_ARQ_MARK) &&
+		((state == RF_SYNC) || (state == RF_SOF))) {
+		/* a plain packet that asks for an ACK */
+		rx.ack = 1;
+		rx.state = RF_SOF;
+		return;
+	}
+#endif
+
+#if (RFLINK_FRM_MAX)
+	if ((nibble == RF_VAR_MARK) &&
+		((state == RF_SYNC) || (state == RF_SOF))) {
+		if (rx_frm_open(RF_TYP_VAR) != NULL) {
+			rx.crc16 = 0xffff;
+			rx.state = RF_VAR_SOF;
+		}
+		return;
+	}
+#endif
+
+	if (state < RF_SOF) {
+		rx.state = RF_IDLE;
+		return;
+	}
+
+#if (RFLINK_RX_SOFT_DECODE)
+	if ((nibble & 0xf0) == RF_SYM_FIX) {
+		nibble &= 0x0f;
+		rx.fix++;
+	}
+#endif
+
+#if (RFLINK_FRM_MAX)
+	if (state >= RF_VAR_SOF) {
+		uint16_t crc;
+
+		if (nibble > 0x0f) {
+			rx.sym++;
+			rx.state = RF_IDLE;
+			return;
+		}
+
+		/* the CRC-16 is always checked here, it needs the length */
+		crc = crc16_nib(rx.crc16, nibble);
+		rx.crc16 = crc;
+		frm = rx.frm;
+		pos = state - RF_VAR_SOF;
+
+		if (pos < 2) {
+			/* length byte */
+			if (pos == 0) {
+				frm->len = nibble;
+			} else {
+				c = frm->len | (nibble << 4);
+				if ((c == 0) || (c > RFLINK_FRM_MAX)) {
+					rx.err++;
+					rx.state = RF_IDLE;
+					return;
+				}
+				frm->len = c;
+				rx.end = RF_VAR_SOF + 2 + (2 * c) + 4;
+			}
+			rx.state = state + 1;
+			return;
+		}
+
+		if (state < rx.end - 4) {
+			/* payload */
+			pos -= 2;
+			if (pos & 1)
+				frm->dat[pos >> 1] |= nibble << 4;
+			else
+				frm->dat[pos >> 1] = nibble;
+		}
+
+		if (++state < rx.end) {
+			rx.state = state;
+			return;
+		}
+
+		/* the CRC nibbles bring the remainder to 0 */
+		if (crc != 0) {
+			rx.err++;
+			rx.state = RF_IDLE;
+			return;
 		}
+
+		rx_frm_publish();
 		return;
 	}
+#endif
+
+#if (RFLINK_FEC)
+	if (state >= RF_FEC_SOF) {
+		frm = rx.frm;
+		pos = state - RF_FEC_SOF;
+
+		if (nibble > 0x0f) {
+			/* keep going, the decoder fills in erased symbols */
+			if (++rx.nera > 2 * FEC_LEN) {
+				rx.sym++;
+				rx.state = RF_IDLE;
+				return;
+			}
+			frm->era |= (1 << pos);
+			nibble = 0;
+		}
 
-	switch (state) {
-	case RF_SOF:
-		rx.pkt.dat[0] = nibble;
-		state = 3;
-		break;
-		
-	case 3:
-		rx.pkt.dat[0] |= nibble << 4;
-		state = 4;
-		break;
-
-	case 4:
-		rx.pkt.dat[1] = nibble;
-		state = 5;
-		break;
-
-	case 5:
-		rx.pkt.dat[1] |= nibble << 4;
-		state = 6;
-		break;
-
-	case 6:
-		rx.pkt.dat[2] = nibble;
-		state = 7;
-		break;
-
-	case 7:
-		rx.pkt.dat[2] |= nibble << 4;
-		state = 8;
-		break;
-
-	case 8:
-		rx.pkt.dat[3] = nibble;
-		state = 9;
-		break;
-
-	case 9:
-		rx.pkt.dat[3] |= nibble << 4;
-		rx.head++;
-		state = RF_IDLE;
-		break;
-
-	default:
+		if (pos & 1)
+			frm->dat[pos >> 1] |= nibble << 4;
+		else
+			frm->dat[pos >> 1] = nibble;
+
+		if (++state < RF_FEC_EOF) {
+			rx.state = state;
+			return;
+		}
+
+		rx_frm_publish();
+		return;
+	}
+#endif
+
+#if (RFLINK_RX_CHECK_ISR)
+	if (nibble > 0x0f) {
+		/* not a data symbol, abort the frame */
+		rx.sym++;
 		rx.state = RF_IDLE;
 		return;
 	}
+#endif
+
+	/* nibble index, low nibble first */
+	pos = state - RF_SOF;
+
+	if (pos == 0) {
+		if ((frm = rx_frm_open(RF_TYP_PKT)) != NULL) {
+			frm->dat[0] = nibble;
+			rx.state = state + 1;
+		}
+		return;
+	} 
 
-	rx.state = state;
+	frm = rx.frm;
+
+	if ((pos & 1) == 0) {
+		frm->dat[pos >> 1] = nibble;
+		rx.state = state + 1;
+		return;
+	}
+
+	c = frm->dat[pos >> 1] | (nibble << 4);
+	frm->dat[pos >> 1] = c;
+
+#if (RFLINK_RX_CHECK_ISR)
+	{
+		uint8_t crc;
+
+		if (pos == 1) {
+			/* the low 5 bits of the first byte are the FCS itself */
+			crc = crc5lut[0x1f ^ (c & 0xe0)];
+		} else {
+			crc = crc5lut[rx.crc ^ c];
+		}
+		rx.crc = crc;
+
+		if (++state < RF_EOF) {
+			rx.state = state;
+			return;
+		}
+
+		if (((crc ^ frm->dat[0]) & 0x1f) != 0x1f) {
+			rx.err++;
+			rx.state = RF_IDLE;
+			return;
+		}
+	}
+
+#if (RFLINK_RX_ACK)
+	/* the copies of a packet already delivered are acknowledged too,
+	   the previous ACK may have been lost */
+	if (rx.ack)
+		rflink_ack_send(frm->dat[0]);
+#endif
+#else
+	if (++state < RF_EOF) {
+		rx.state = state;
+		return;
+	}
+#endif
+
+	rx_frm_publish();
 }
 
-uint8_t rc433_pkt_recv(uint8_t dat[])
+/* Take the next frame off the ring, skipping the ones that fail the
+   checks left to the main loop. Variable length frames are skipped
+   unless 'var' is set. Returns the payload length. */
+static int8_t rflink_recv(uint8_t dat[], uint8_t var)
 {
-	uint8_t head = rx.head;
-	uint8_t tail = rx.tail;
+	uint8_t tail;
+	struct pkt * frm;
+	uint8_t typ;
 	uint8_t d[4];
-	uint8_t fsc;
-	
-	if (head == tail) {
-		return 0;
-	}
+#if (RFLINK_TSTAMP)
+	uint16_t ts;
+#endif
 
-	d[0] = rx.pkt.dat[0];
-	d[1] = rx.pkt.dat[1];
-	d[2] = rx.pkt.dat[2];
-	d[3] = rx.pkt.dat[3];
+	for (;;) {
+		tail = rx.tail;
+		if (rx.head == tail) {
+			return 0;
+		}
+		/* and read after 'head' */
+		barrier();
 
-	rx.tail++;
+		frm = &rx.pkt[tail & RX_FIFO_MSK];
+		typ = frm->typ;
+#if (RFLINK_TSTAMP)
+		ts = frm->ts;
+#endif
+#if (RFLINK_RX_TIME)
+		rx.ms = frm->ms;
+#endif
 
-	fsc = d[0] & 0x1f;
-	
-	if (rflink_crc5(d) != fsc) { 
-		return 0;
+#if (RFLINK_FRM_MAX)
+		if (frm->typ == RF_TYP_VAR) {
+			uint8_t len = frm->len;
+			uint8_t i;
+
+			if (var) {
+				for (i = 0; i < len; ++i)
+					dat[i] = frm->dat[i];
+			}
+
+			/* release the slot */
+			barrier();
+			rx.tail = tail + 1;
+
+			if (var) {
+#if (RFLINK_TSTAMP)
+				prof_lat_add(&rx.deliver, rc433_tstamp() - ts);
+#endif
+				rx.typ = RF_TYP_VAR;
+				return len;
+			}
+			continue;
+		}
+#endif
+
+#if (RFLINK_FEC)
+		if (frm->typ == RF_TYP_FEC) {
+			uint8_t c[RS_N];
+			uint16_t era = frm->era;
+			uint8_t i;
+			int8_t n;
+
+			for (i = 0; i < PKT_LEN + FEC_LEN; ++i) {
+				c[2 * i] = frm->dat[i] & 0x0f;
+				c[2 * i + 1] = frm->dat[i] >> 4;
+			}
+
+			/* release the slot */
+			barrier();
+			rx.tail = tail + 1;
+
+			n = rflink_fec_decode(c, era);
+			for (i = 0; i < PKT_LEN; ++i)
+				d[i] = c[2 * i] | (c[2 * i + 1] << 4);
+
+			/* the CRC5 catches most miscorrections */
+			if ((n < 0) || (rflink_crc5(d) != (d[0] & 0x1f))) {
+				rx.unc++;
+				continue;
+			}
+			rx.fec += n;
+		} else
+#endif
+		{
+			d[0] = frm->dat[0];
+			d[1] = frm->dat[1];
+			d[2] = frm->dat[2];
+			d[3] = frm->dat[3];
+
+			/* release the slot */
+			barrier();
+			rx.tail = tail + 1;
+
+#if !(RFLINK_RX_CHECK_ISR)
+			if (rflink_crc5(d) != (d[0] & 0x1f)) { 
+				rx.err++;
+				continue;
+			}
+#endif
+		}
+
+		d[0] &= 0xe0;
+
+#if (RFLINK_RX_DEDUP)
+		/* Frames arrive in order, so the repeats of a command are
+		   back-to-back and comparing with the last packet delivered is
+		   enough. The sequence number makes a new command differ even
+		   when the payload is the same. */
+		if ((rx.copies != 0) && (d[0] == rx.last[0]) &&
+			(d[1] == rx.last[1]) && (d[2] == rx.last[2]) &&
+			(d[3] == rx.last[3])) {
+			if (rx.copies != 0xff)
+				rx.copies++;
+			rx.dup++;
+			continue;
+		}
+
+		rx.last[0] = d[0];
+		rx.last[1] = d[1];
+		rx.last[2] = d[2];
+		rx.last[3] = d[3];
+		rx.copies = 1;
+#endif
+
+		dat[0] = d[0];
+		dat[1] = d[1];
+		dat[2] = d[2];
+		dat[3] = d[3];
+
+#if (RFLINK_TSTAMP)
+		prof_lat_add(&rx.deliver, rc433_tstamp() - ts);
+#endif
+		rx.typ = typ;
+		return PKT_LEN;
 	}
+}
 
-	dat[0] = d[0] & 0xe0;
-	dat[1] = d[1];
-	dat[2] = d[2];
-	dat[3] = d[3];
+int8_t rc433_pkt_recv(uint8_t dat[])
+{
+	return (rflink_recv(dat, 0) != 0) ? 1 : 0;
+}
 
+#if (RFLINK_FRM_MAX)
+int8_t rc433_frm_recv(uint8_t dat[])
+{
+	return rflink_recv(dat, 1);
+}
+#endif
+
+uint8_t rc433_rx_idle(void)
+{
+	uint8_t act = rx.act;
+
+	rx.act = 0;
+	/* frames still in the ring are not delivered yet either */
+	if (act || (rx.state != RF_IDLE) || (UCSR0A & (1 << RXC0)) ||
+		(rx.head != rx.tail))
+		return 0;
+#if (RFLINK_RX_ACK)
+	if (ack.busy)
+		return 0;
+#endif
 	return 1;
 }
 
+uint8_t rc433_frm_type(void)
+{
+	return rx.typ;
+}
+
+#if (RFLINK_RX_TIME)
+uint16_t rc433_rx_time(void)
+{
+	return rx.ms;
+}
+#endif
+
+#if (RFLINK_RX_DEDUP)
+uint8_t rc433_pkt_copies(void)
+{
+	return rx.copies;
+}
+#endif
+
+void rc433_rx_stat_get(struct rc433_rx_stat * stat)
+{
+	uint8_t i;
+
+	ATOMIC_BLOCK(ATOMIC_FORCEON)
+	{
+		stat->ovr = rx.ovr;
+		stat->err = rx.err;
+		stat->sym = rx.sym;
+		stat->fix = rx.fix;
+#if (RFLINK_FEC)
+		stat->fec = rx.fec;
+		stat->unc = rx.unc;
+#else
+		stat->fec = 0;
+		stat->unc = 0;
+#endif
+#if (RFLINK_RX_CAL)
+		stat->cal = cal.adj;
+		stat->clk_ppm = cal.err;
+#else
+		stat->cal = 0;
+		stat->clk_ppm = 0;
+#endif
+#if (RFLINK_RX_DEDUP)
+		stat->dup = rx.dup;
+#else
+		stat->dup = 0;
+#endif
+		for (i = 0; i < RC433_ACQ_LEN; ++i)
+			stat->acq[i] = rx.acq[i];
+	}
+#if (RFLINK_RX_CAL)
+	/* 1e6 = 15625 * 64, keeps the product in 32 bits */
+	stat->clk_ppm = (stat->clk_ppm * 15625) / (((int32_t)CAL_NOM * CAL_AVG) / 64);
+#endif
+}
+
+#if (RFLINK_TSTAMP)
+void rc433_rx_lat_get(struct rc433_rx_lat * lat)
+{
+	lat->tick_ns = TS_TICK_NS;
+	lat->deliver = rx.deliver;
+	ATOMIC_BLOCK(ATOMIC_FORCEON)
+	{
+		lat->air = rx.air;
+	}
+}
+#endif
+
 void rc433_init(void)
 {
 	usart_init();
@@ -7,13 +7,29 @@
 
 #include "io.h"
 #include "rc433.h"
+#if (SNIF_MON)
+#include "mon.h"
+#endif
 #include <util/delay.h>
 #include <avr/interrupt.h> 
 #include <avr/sleep.h> 
 
+/* Timers keep the MCU up, so a low power build has none running for
+   long: the clock stops while powered down anyway. */
+#if !(IO_LOWPWR)
+/* LED flash once 'busy' runs out with no packet received */
+static struct tmr busy_tmr;
+#if (SNIF_MON)
+/* status record */
+static struct tmr stat_tmr;
+#endif
+#endif
+
 int main(void)
 {
+#if !(IO_LOWPWR)
 	uint8_t busy;
+#endif
 
 	io_init();
 	rc433_init();
@@ -34,16 +50,36 @@ int main(void)
 	uart_drain();
 #endif
 
+#if !(IO_LOWPWR)
 	busy = 255;
-	io_tmr0_set(255);
+	tmr_setup(&busy_tmr, NULL, EV_TMR0);
+	tmr_start(&busy_tmr, IO_MS2TICKS(2040), IO_MS2TICKS(2040));
+#endif
+
+#if (SNIF_MON)
+	mon_init();
+#if !(IO_LOWPWR)
+	/* status record every second */
+	tmr_setup(&stat_tmr, NULL, EV_TMR1);
+	tmr_start(&stat_tmr, IO_MS2TICKS(1000), IO_MS2TICKS(1000));
+#endif
+#endif
 
 	while (1) {
+#if (SNIF_MON)
+		uint8_t dat[RFLINK_FRM_MAX > 4 ? RFLINK_FRM_MAX : 4];
+#else
 		uint8_t dat[4];
+#endif
 		uint8_t ev;
 
-		sleep_mode();
+		io_sleep();
 
+#if (SNIF_MON)
+		if ((mon_recv(dat) == 4) && (rc433_frm_type() != RC433_TYP_VAR)) {
+#else
 		if (rc433_pkt_recv(dat)) {
+#endif
 			uint8_t op;
 			uint8_t val1;
 			uint8_t val2;
@@ -55,9 +91,11 @@ int main(void)
 			(void)val1;
 			(void)val2;
 
-			led_flash(50);
-			io_tmr0_set(255);
+			led_flash(IO_MS2TICKS(400));
+#if !(IO_LOWPWR)
+			tmr_start(&busy_tmr, IO_MS2TICKS(2040), IO_MS2TICKS(2040));
 			busy = 255;
+#endif
 
 			if (((op + 1) == val1) && ((val1 + 1) == val2))
 				continue;
@@ -65,13 +103,18 @@ int main(void)
 		} 
 
 		if ((ev = io_events_get()) != 0) {
+#if !(IO_LOWPWR)
 			if (ev & EV_TMR0) { 
 				if (--busy == 0) {
-					led_flash(250);
-				} else {
-					io_tmr0_set(255);
+					tmr_stop(&busy_tmr);
+					led_flash(IO_MS2TICKS(2000));
 				}
 			}
+#if (SNIF_MON)
+			if (ev & EV_TMR1)
+				mon_status();
+#endif
+#endif
 		}
 	}
 }
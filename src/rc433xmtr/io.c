@@ -6,102 +6,159 @@
  */
 
 #include "io.h"
+#include "isrprof.h"
 #include <avr/interrupt.h> 
+#include <avr/sleep.h> 
 #include <util/atomic.h>
 
 struct {
-	volatile uint8_t din[2];
+	/* debounced inputs, vertical counters of the samples that differ */
+	volatile uint8_t din;
+	uint8_t deb[IO_DEB_BITS];
 
 	struct {
 		volatile uint8_t set;
 		volatile uint8_t msk;
 	} ev;
 
-	struct {
+	struct io_enc {
+		/* pins, quarter steps since the last detent */
 		uint8_t code;
+		int8_t q;
+		/* last quarter step, last detent */
+		int8_t dir;
+		int8_t step;
+#if (IO_ENC_ACCEL_MS)
+		/* tick of the last detent */
+		uint16_t t;
+#endif
 		int8_t val;
 	} enc[2];
 
-	volatile uint8_t tmr[2];
+	struct tmr led;
 	volatile uint8_t sw2;
 	volatile uint8_t sw1;
+#if (RFLINK_TSTAMP)
+	uint16_t enc_ts;
+#endif
+#if (IO_LOWPWR) || (IO_TICKLESS)
+	/* samples left before powering down or stopping the sampling */
+	volatile uint8_t hold;
+#endif
+#if (IO_TICKLESS)
+	/* counter at the last update of tmr_now */
+	uint8_t cnt;
+	/* sampling the inputs */
+	volatile uint8_t smp;
+#endif
+	struct io_duty duty;
 } io;
 
+/* encoders and switches, as the filter sees them */
+static inline uint8_t io_din_read(void)
+{
+	return (PINC & 0xf) | ((PIND << 2) & 0xf0);
+}
 
-/* TIMER0 compare interrupt service routine */
-ISR(TIMER0_COMPA_vect) 
+/* Debounce a sample of the inputs, all 8 at once: bit n of deb[i] is
+   bit i of the count of input n, counting the samples in a row that
+   differ from its debounced level. An input changes when its count
+   wraps, after IO_DEB_DEPTH samples. Returns the inputs that changed. */
+static inline uint8_t io_deb(uint8_t d)
 {
-	uint8_t dc;
-	uint8_t dd;
-	uint8_t d2;
-	uint8_t d1;
-	uint8_t d0;
-	uint8_t t;
-	uint8_t ev;
-	uint8_t tmr;
+	uint8_t delta = d ^ io.din;
+	uint8_t carry = delta;
+	uint8_t c;
+	uint8_t i;
 
-	/* read PORTC pins */
-	dc = PINC;
-	dd = PIND;
-	/* combine all inputs */
-	d0 = (dc & 0xf) | ((dd << 2) & 0xf0);        
-	/* filter */
-	d1 = io.din[0];
-	d2 = io.din[1];
-	io.din[0] = d0;
-	io.din[1] = d1;
-	/* Compute transitions */
-	t = ~(d0 ^ d1) & (d1 ^ d2);
+	for (i = 0; i < IO_DEB_BITS; i++) {
+		c = io.deb[i];
+		io.deb[i] = (c ^ carry) & delta;
+		carry &= c;
+	}
+	io.din ^= carry;
 
-	ev = 0;
+	return carry;
+}
 
-	if (d0 & (1 << 4)) 
-		dbg0_on();
-	else
-		dbg0_off();
+/* some input differs from its debounced level */
+static inline uint8_t io_deb_busy(void)
+{
+	uint8_t c = 0;
+	uint8_t i;
 
-	if (d0 & (1 << 5)) 
-		dbg1_on();
-	else
-		dbg1_off();
+	for (i = 0; i < IO_DEB_BITS; i++)
+		c |= io.deb[i];
 
-	if (t) {
-		/* process transition */ 
-		uint8_t code;
-		int8_t val;
+	return c;
+}
 
-		val = io.enc[0].val;
-		code = io.enc[0].code;
+/* Quarter steps of an encoder from the previous and the current state of
+   its pins, (prev << 2) | cur, along 00 01 11 10. ENC_SKIP: both pins
+   changed between two interrupts, the direction is taken as the last
+   one. A contact bouncing goes back and forth and counts nothing. */
+#define ENC_SKIP 2
 
-		code = ((code << 2) & 0x0c) | ((d0 >> 4) & 0x03);
-		if ((code == 0x03) && (val > ENCODER0_MIN)) {
-			val--;
-			ev |= EV_ENC0; 
-		} else if ((code == 0x0c) && (val < ENCODER0_MAX)) {
-			val++;
-			ev |= EV_ENC0; 
-		}
+static const int8_t enc_tab[16] = {
+	0, 1, -1, ENC_SKIP,
+	-1, 0, ENC_SKIP, 1,
+	1, ENC_SKIP, 0, -1,
+	ENC_SKIP, -1, 1, 0
+};
 
-		io.enc[0].code = code;
-		io.enc[0].val = val;
 
-		val = io.enc[1].val;
-		code = io.enc[1].code;
+#if (IO_TICKLESS)
+#define IO_TMR_LAT PROF_LAT_FREE(TCNT0, OCR0A, IO_TMR_DIV)
+#define IO_TMR_CS ((1 << CS02) | (1 << CS00))
 
-		code = ((code << 2) & 0x0c) | ((d0 >> 6) & 0x03);
-		if ((code == 0x03) && (val > ENCODER1_MIN)) {
-			val--;
-			ev |= EV_ENC1; 
-		} else if ((code == 0x0c) && (val < ENCODER1_MAX)) {
-			val++;
-			ev |= EV_ENC1; 
-		}
+/* Move tmr_now up to the counter, at least once per turn. Interrupts
+   disabled. Returns the count. */
+static inline uint8_t io_tmr_update(void)
+{
+	uint8_t c = TCNT0;
+	uint8_t n = c - io.cnt;
 
-		io.enc[1].code = code;
-		io.enc[1].val = val;
+	io.cnt = c;
+	tmr_advance(n);
+	io.duty.awake += n;
+
+	return c;
+}
+#else
+#define IO_TMR_LAT PROF_LAT(TCNT0, IO_TMR_TOP, IO_TMR_DIV)
+#define IO_TMR_CS (1 << CS01)
+#endif
+
+/* TIMER0 compare interrupt service routine */
+PROF_ISR(TIMER0_COMPA_vect, RC433_ISR_TMR0, IO_TMR_LAT) 
+{
+	uint8_t d0;
+	uint8_t t;
+	uint8_t ev;
 
+#if (IO_TICKLESS)
+	uint8_t c = io_tmr_update();
 
+	if (!io.smp) {
+		/* the longest period, unless io_sleep() has a nearer deadline */
+		OCR0A = c + IO_TMR_MAX;
+		return;
+	}
+	/* next sample */
+	OCR0A = c + IO_SMP_CNT;
+#else
+	tmr_tick();
+	io.duty.awake++;
+#endif
 
+	/* the inputs that changed, stable */
+	t = io_deb(io_din_read());
+	d0 = io.din;
+
+	ev = 0;
+
+	if (t) {
+		/* process transition, the encoders are decoded on PCINT2 */ 
 		if (t & (1 << 2)) {
 			if (d0 & (1 << 2)) {
 				io.sw1 = 0;
@@ -128,22 +185,149 @@ ISR(TIMER0_COMPA_vect)
 
 	}
 
-	if ((tmr = io.tmr[0]) != 0) {
-		if (--tmr == 0)
-			ev |= EV_TMR0; 
-		io.tmr[0] = tmr;
+#if (IO_LOWPWR) || (IO_TICKLESS)
+	/* the inputs are moving, the next edge is close */
+	if (t)
+		io.hold = IO_PWR_HOLD;
+	else if (io.hold)
+		io.hold--;
+#endif
+
+	/* set event bits */
+	io.ev.set |= ev;
+}
+
+/* tick now, in an ISR */
+static inline uint16_t io_now(void)
+{
+#if (IO_TICKLESS)
+	io_tmr_update();
+#endif
+	return tmr_now;
+}
+
+/* Detents of encoder 'enc' since the last call, its pins now at 'cur'.
+   They fall on 00 and 11, where the quarter steps start over. */
+static inline int8_t io_enc_decode(struct io_enc * enc, uint8_t cur)
+{
+	int8_t q = enc_tab[(enc->code << 2) | cur];
+
+	enc->code = cur;
+	if (q == ENC_SKIP)
+		q = 2 * enc->dir;
+	else if (q)
+		enc->dir = q;
+
+	q += enc->q;
+	if ((cur == 0x00) || (cur == 0x03)) {
+		enc->q = 0;
+		return q / 2;
 	}
+	enc->q = q;
+
+	return 0;
+}
 
-	if ((tmr = io.tmr[1]) != 0) {
-		if (--tmr == 0)
-			ev |= EV_TMR1; 
-		io.tmr[1] = tmr;
+/* Move encoder 'enc' by 'n' detents within [min, max]. Accelerated, the
+   detents following each other in the same direction less than
+   IO_ENC_ACCEL_MS apart count twice, less than a quarter of it four
+   times. Returns 1 if the value changed. */
+static inline uint8_t io_enc_move(struct io_enc * enc, int8_t n, int8_t min,
+								  int8_t max, uint8_t accel)
+{
+	int8_t val = enc->val;
+	int8_t step = (n > 0) ? 1 : -1;
+
+#if (IO_ENC_ACCEL_MS)
+	uint16_t now = io_now();
+	uint16_t dt = now - enc->t;
+
+	enc->t = now;
+	if (accel && (step == enc->step)) {
+		if (dt < (IO_MS2TICKS(IO_ENC_ACCEL_MS) / 4))
+			n *= 4;
+		else if (dt < IO_MS2TICKS(IO_ENC_ACCEL_MS))
+			n *= 2;
 	}
+#endif
+	enc->step = step;
+
+	val += n;
+	if (val < min)
+		val = min;
+	else if (val > max)
+		val = max;
+
+	if (val == enc->val)
+		return 0;
+	enc->val = val;
+
+	return 1;
+}
+
+/* Encoder pins change: PD2 PD3 encoder 0, PD4 PD5 encoder 1 */
+PROF_ISR(PCINT2_vect, RC433_ISR_PCINT, 0)
+{
+	uint8_t d = PIND;
+	uint8_t ev = 0;
+	int8_t n;
+
+	d >>= 2;
+
+	if (d & (1 << 0)) 
+		dbg0_on();
+	else
+		dbg0_off();
+
+	if (d & (1 << 1)) 
+		dbg1_on();
+	else
+		dbg1_off();
+
+	n = io_enc_decode(&io.enc[0], d & 0x03);
+	if (n && io_enc_move(&io.enc[0], n, ENCODER0_MIN, ENCODER0_MAX,
+						 IO_ENC_ACCEL & (1 << 0)))
+		ev |= EV_ENC0;
+
+	n = io_enc_decode(&io.enc[1], (d >> 2) & 0x03);
+	if (n && io_enc_move(&io.enc[1], n, ENCODER1_MIN, ENCODER1_MAX,
+						 IO_ENC_ACCEL & (1 << 1)))
+		ev |= EV_ENC1;
+
+#if (RFLINK_TSTAMP)
+	/* the oldest step the main loop has not seen yet */
+	if (ev && ((io.ev.set & (EV_ENC0 | EV_ENC1)) == 0))
+		io.enc_ts = rc433_tstamp();
+#endif
 
-	/* set event bits */
 	io.ev.set |= ev;
 }
 
+#if (IO_LOWPWR) || (IO_TICKLESS)
+/* Pin change wake-up. The oscillator is back and the tick not running
+   yet: feed the filter the level right after the edge, so that it counts
+   as the first sample. The counters were clear, nothing changes yet.
+   Tickless, the sampling starts over, the next sample two counts
+   later. */
+static inline void io_wake(void)
+{
+#if (IO_TICKLESS)
+	OCR0A = TCNT0 + IO_SMP_CNT;
+	io.hold = IO_PWR_HOLD;
+	io.smp = 1;
+#endif
+	io_deb(io_din_read());
+	/* until the next power down */
+	PCICR &= ~(1 << PCIE1);
+}
+
+/* PORTC inputs, the switches */
+PROF_ISR(PCINT1_vect, RC433_ISR_PCINT, 0)
+{
+	io_wake();
+}
+#endif
+
 uint8_t io_sw1_get(void)
 {
 	return io.sw1;
@@ -164,6 +348,20 @@ int8_t io_encoder1_get(void)
 	return io.enc[1].val;
 }
 
+#if (RFLINK_TSTAMP)
+uint16_t io_encoder_tstamp(void)
+{
+	uint16_t t;
+
+	ATOMIC_BLOCK(ATOMIC_FORCEON)
+	{
+		t = io.enc_ts;
+	}
+
+	return t;
+}
+#endif
+
 void io_encoder0_set(int8_t val)
 {
 	ATOMIC_BLOCK(ATOMIC_FORCEON)
@@ -180,6 +378,11 @@ void io_encoder1_set(int8_t val)
 	}
 }
 
+static void io_led_off(struct tmr * t)
+{
+	led_off();
+}
+
 void io_init(void) 
 {
 	uint8_t c;
@@ -203,20 +406,46 @@ void io_init(void)
 	/* combine all inputs */
 	d = (c & 0xf) | ((d << 2) & 0xf0);        
 	/* initializer debouncing filter state */
-	io.din[0] = d;
-	io.din[1] = d;
+	io.din = d;
+	for (c = 0; c < IO_DEB_BITS; c++)
+		io.deb[c] = 0;
 
 	io.ev.set = 0;
 	io.ev.msk = 0;
-	io.tmr[0] = 0;
-	io.tmr[1] = 0;
+	tmr_init();
+	tmr_setup(&io.led, io_led_off, 0);
 
 	io.enc[0].val = (ENCODER0_MAX - ENCODER0_MIN) / 2;
-	io.enc[0].code = 0;
+	io.enc[0].code = (d >> 4) & 0x03;
 
 	io.enc[1].val = (ENCODER1_MAX - ENCODER1_MIN) / 2;
-	io.enc[1].code = 0;
-
+	io.enc[1].code = (d >> 6) & 0x03;
+
+	io.duty.awake = 0;
+	io.duty.down = 0;
+	io.duty.tick_us = IO_TICK_US;
+	/* encoder edges */
+	PCMSK2 = (1 << PCINT18) | (1 << PCINT19) | (1 << PCINT20) |
+		(1 << PCINT21);
+	PCIFR = (1 << PCIF2);
+	PCICR = (1 << PCIE2);
+#if (IO_LOWPWR) || (IO_TICKLESS)
+	io.hold = IO_PWR_HOLD;
+	/* switch wake-up, enabled by io_sleep() */
+	PCMSK1 = (1 << PCINT8) | (1 << PCINT9) | (1 << PCINT10) | (1 << PCINT11);
+#endif
+
+#if (IO_TICKLESS)
+	/* normal mode, the counter runs free, sampling */
+	TCCR0A = 0;
+	TIMSK0 = (1 << OCIE0A);
+	TCNT0 = 0;
+	io.cnt = 0;
+	io.smp = 1;
+	OCR0A = IO_SMP_CNT;
+    /* enable timer clock with prescaler = 1024 */ 
+	TCCR0B = IO_TMR_CS;
+#else
 	/* Set timer CTC mode */
 	TCCR0A = (1 << WGM01);// | (1 << WGM00);    
 	/* enable Timer Match A Interrupts */
@@ -229,16 +458,13 @@ void io_init(void)
 	//TCCR0B = (1 << FOC0A) | (1 << CS02) | (1 << CS00);
     /* enable timer clock with prescaler = 256 */ 
 	TCCR0B = (1 << FOC0A) | (1 << CS01);
+#endif
 }
 
-void io_tmr0_set(uint8_t itv)
-{
-	io.tmr[0] = itv;
-}
-
-void io_tmr1_set(uint8_t itv)
+void led_flash(uint16_t itv)
 {
-	io.tmr[1] = itv;
+	tmr_start(&io.led, itv, 0);
+	led_on();
 }
 
 uint8_t io_events_get(void)
@@ -249,12 +475,122 @@ uint8_t io_events_get(void)
 	ATOMIC_BLOCK(ATOMIC_FORCEON)
 	{
    //cli();
+#if (IO_TICKLESS)
+		io_tmr_update();
+#endif
 		set = io.ev.set;
 		io.ev.set = 0;
    //sei();
 	}
 
-	/* return events bitmap */
-	return set;
+	/* return events bitmap, the timers that fired included */
+	return set | tmr_run();
+}
+
+void io_duty_get(struct io_duty * duty)
+{
+	ATOMIC_BLOCK(ATOMIC_FORCEON)
+	{
+		*duty = io.duty;
+	}
+}
+
+#if (IO_LOWPWR) || (IO_TICKLESS)
+/* Nothing to sample: no event pending, the inputs stable and the hold
+   over. Leaves the pin change interrupts armed if so. Interrupts
+   disabled. */
+static uint8_t io_quiet(void)
+{
+	if ((io.ev.set != 0) || (io.hold != 0))
+		return 0;
+
+	/* armed before the last look at the pins: an edge from now on
+	   wakes the MCU up at once */
+	PCIFR = (1 << PCIF1);
+	PCICR |= (1 << PCIE1);
+	if ((io_din_read() == io.din) && !io_deb_busy())
+		return 1;
+
+	PCICR &= ~(1 << PCIE1);
+	return 0;
+}
+#endif
+
+#if (IO_TICKLESS)
+/* Program the compare match for the nearest deadline, two counts away at
+   least so that the counter cannot get past it before the write.
+   Interrupts disabled, tmr_now up to date. Returns 0 if a deadline is
+   due already. */
+static uint8_t io_tmr_sched(void)
+{
+	uint16_t d = tmr_next();
+
+	if (d == 0)
+		return 0;
+
+	if (d > IO_TMR_MAX)
+		d = IO_TMR_MAX;
+	else if (d < 2)
+		d = 2;
+	OCR0A = io.cnt + d;
+
+	return 1;
 }
+#endif
 
+void io_sleep(void)
+{
+	cli();
+#if (IO_TICKLESS)
+	io_tmr_update();
+	/* the pin change interrupt starts the sampling again */
+	if (io.smp && io_quiet())
+		io.smp = 0;
+
+	if (!io.smp) {
+#if (IO_LOWPWR)
+		if ((tmr_pending() == 0) && rc433_tx_idle()) {
+			/* stop the counter, a switch restarts the sampling, the
+			   encoders need none */
+			TCCR0B = 0;
+			set_sleep_mode(SLEEP_MODE_PWR_DOWN);
+			sleep_enable();
+			sei();
+			sleep_cpu();
+			sleep_disable();
+			set_sleep_mode(SLEEP_MODE_IDLE);
+			TCCR0B = IO_TMR_CS;
+			io.duty.down++;
+			return;
+		}
+#endif
+		if (!io_tmr_sched()) {
+			sei();
+			return;
+		}
+	}
+#elif (IO_LOWPWR)
+	if ((tmr_pending() == 0) && rc433_tx_idle() && io_quiet()) {
+		/* stop the tick */
+		TCCR0B = 0;
+		set_sleep_mode(SLEEP_MODE_PWR_DOWN);
+		sleep_enable();
+		sei();
+		sleep_cpu();
+		sleep_disable();
+		set_sleep_mode(SLEEP_MODE_IDLE);
+		/* restart it at clk/8, one period after the wake-up sample */
+		TCNT0 = 0;
+		TCCR0B = IO_TMR_CS;
+		PCICR &= ~(1 << PCIE1);
+		io.hold = IO_PWR_HOLD;
+		io.duty.down++;
+		return;
+	}
+#endif
+	/* the interrupts are enabled with the sleep instruction next */
+	sleep_enable();
+	sei();
+	sleep_cpu();
+	sleep_disable();
+}
@@ -9,12 +9,79 @@
 #define __IO_H__
 
 #include <avr/io.h>
-
+#include "rc433.h"
+#include "tmr.h"
+
+/* Tickless: Timer0 runs free at clk/1024 and interrupts at the nearest
+   deadline only, programmed by io_sleep(), or at the latest once per
+   turn of the counter. The switches are sampled every IO_SMP_CNT counts,
+   128 us at 16 MHz, only while they move and until IO_PWR_HOLD samples
+   later: a pin change starts the sampling again. A tick is one count,
+   64 us, instead of the 125 us of the periodic tick. Needs TMR_SORTED
+   (tmr.h). */
+#ifndef IO_TICKLESS
+#define IO_TICKLESS 0
+#endif
+
+#if (IO_TICKLESS)
+#if !(TMR_SORTED)
+#error "IO_TICKLESS needs TMR_SORTED"
+#endif
+#define IO_TMR_DIV 1024
+/* counts to the next interrupt at most, a turn less the ISR latency */
+#define IO_TMR_MAX 254
+#define IO_SMP_CNT 2
+#define IO_TICK_US (((IO_TMR_DIV) * 1000000l) / (F_CPU))
+#else
+/* Timer0 runs at clk/8 */
 #define IO_TMR_TOP 249
-#define IO_TICKS_MS ((((IO_TMR_TOP) + 1l) * 256 * 1000l) / (F_CPU))
-
-#define IO_MS2TICKS(__MS__) ((__MS__) / IO_TICKS_MS)
-
+#define IO_TMR_DIV 8
+#define IO_TICK_US ((((IO_TMR_TOP) + 1l) * (IO_TMR_DIV) * 1000000l) / (F_CPU))
+#endif
+
+#define IO_MS2TICKS(__MS__) (((__MS__) * 1000l) / IO_TICK_US)
+
+/* Power down in io_sleep() while nothing is going on: no timer running,
+   the inputs stable and the link idle. The tick stops and a pin change
+   on the encoders or the switches wakes the MCU up. */
+#ifndef IO_LOWPWR
+#define IO_LOWPWR 0
+#endif
+
+/* samples to stay up after a wake-up or an input change */
+#ifndef IO_PWR_HOLD
+#define IO_PWR_HOLD 255
+#endif
+
+/* Samples in a row an input has to differ from its debounced level to
+   change it: 2, 4 or 8. */
+#ifndef IO_DEB_DEPTH
+#define IO_DEB_DEPTH 2
+#endif
+
+#if (IO_DEB_DEPTH == 2)
+#define IO_DEB_BITS 1
+#elif (IO_DEB_DEPTH == 4)
+#define IO_DEB_BITS 2
+#elif (IO_DEB_DEPTH == 8)
+#define IO_DEB_BITS 3
+#else
+#error "IO_DEB_DEPTH must be 2, 4 or 8"
+#endif
+
+/* Velocity acceleration of the encoders in the IO_ENC_ACCEL mask, bit 0
+   encoder 0: detents less than IO_ENC_ACCEL_MS apart count twice, less
+   than a quarter of it four times. 0 turns it off. The timer stops while
+   powered down, keep it under the hold time. */
+#ifndef IO_ENC_ACCEL_MS
+#define IO_ENC_ACCEL_MS 0
+#endif
+
+#ifndef IO_ENC_ACCEL
+#define IO_ENC_ACCEL (1 << 1)
+#endif
+
+/* EV_TMR0 and EV_TMR1 are left to the application timers (tmr.h) */
 #define EV_TMR0  (1 << 0)
 #define EV_ENC0 (1 << 1)
 #define EV_ENC1 (1 << 2)
@@ -22,6 +89,7 @@
 #define EV_SW2  (1 << 4)
 #define EV_TMR1  (1 << 5)
 
+/* The encoders are decoded on their pin changes (PCINT2), not sampled */
 #define ENCODER0_MIN -12
 #define ENCODER0_MAX 12
 
@@ -67,9 +135,11 @@ static inline void dbg1_toggle(void) {
 
 void io_init(void);
 
-void  io_tmr0_set(uint8_t itv);
-void  io_tmr1_set(uint8_t itv);
+/* LED on for 'itv' ticks */
+void led_flash(uint16_t itv);
 
+/* Event bits of the inputs and of the timers that fired, tmr_run().
+   The timer callbacks run from here. */
 uint8_t io_events_get(void);
 
 uint8_t io_sw1_get(void);
@@ -84,5 +154,25 @@ void io_encoder0_set(int8_t val);
 
 void io_encoder1_set(int8_t val);
 
+/* Duty cycle. The timer runs whenever the MCU is not powered down, so the
+   time awake is 'awake' ticks of 'tick_us' and the time powered down the
+   rest of the time since io_init(). */
+struct io_duty {
+	uint32_t awake;
+	uint16_t down;
+	uint16_t tick_us;
+};
+
+void io_duty_get(struct io_duty * duty);
+
+/* Sleep until the next interrupt, powered down when possible. Call with
+   no event pending. */
+void io_sleep(void);
+
+#if (RFLINK_TSTAMP)
+/* rc433_tstamp() at the first encoder step since io_events_get() */
+uint16_t io_encoder_tstamp(void);
+#endif
+
 #endif /* __IO_H__ */
 
@@ -0,0 +1,80 @@
+/*
+ * Copyright(C) 2021 Robinson (Bob) Mittman. All Rights Reserved.
+ * Licensed under the MIT license.
+ * See LICENSE file in the project root for details.
+ *
+ */
+
+#include <stdint.h>
+#include "io.h"
+#include "mix.h"
+
+/* the table rows and columns below are written out for these ranges */
+#if (ENCODER0_MIN != -12) || (ENCODER0_MAX != 12) || \
+	(ENCODER1_MIN != 0) || (ENCODER1_MAX != 15)
+#error "mix.c expects steer -12 to 12 and speed 0 to 15"
+#endif
+
+/* speed curve, 16 times the speed with expo 0 */
+#define MIX_CURVE(_V_, _E_) \
+	((((16 - (_E_)) * 16 * (_V_)) + \
+	  (((_E_) * 16 * (_V_) * (_V_) * (_V_)) / (15 * 15))) / 16)
+
+/* level of a wheel at speed 'v', slowed down by 'a' sixteenths */
+#define MIX_LVL(_A_, _V_, _E_, _MAX_) \
+	(((_V_) == 0) ? 0 : \
+	 ((((MIX_CURVE(_V_, _E_) * (16 - (_A_))) / 16) / 4 + 63) > (_MAX_)) ? \
+	 (_MAX_) : (((MIX_CURVE(_V_, _E_) * (16 - (_A_))) / 16) / 4 + 63))
+
+#define MIX_ROW(_A_, _E_, _MAX_) { \
+	MIX_LVL(_A_, 0, _E_, _MAX_), MIX_LVL(_A_, 1, _E_, _MAX_), \
+	MIX_LVL(_A_, 2, _E_, _MAX_), MIX_LVL(_A_, 3, _E_, _MAX_), \
+	MIX_LVL(_A_, 4, _E_, _MAX_), MIX_LVL(_A_, 5, _E_, _MAX_), \
+	MIX_LVL(_A_, 6, _E_, _MAX_), MIX_LVL(_A_, 7, _E_, _MAX_), \
+	MIX_LVL(_A_, 8, _E_, _MAX_), MIX_LVL(_A_, 9, _E_, _MAX_), \
+	MIX_LVL(_A_, 10, _E_, _MAX_), MIX_LVL(_A_, 11, _E_, _MAX_), \
+	MIX_LVL(_A_, 12, _E_, _MAX_), MIX_LVL(_A_, 13, _E_, _MAX_), \
+	MIX_LVL(_A_, 14, _E_, _MAX_), MIX_LVL(_A_, 15, _E_, _MAX_) }
+
+#define MIX_TAB(_E_, _MAX_) { \
+	MIX_ROW(0, _E_, _MAX_), MIX_ROW(1, _E_, _MAX_), \
+	MIX_ROW(2, _E_, _MAX_), MIX_ROW(3, _E_, _MAX_), \
+	MIX_ROW(4, _E_, _MAX_), MIX_ROW(5, _E_, _MAX_), \
+	MIX_ROW(6, _E_, _MAX_), MIX_ROW(7, _E_, _MAX_), \
+	MIX_ROW(8, _E_, _MAX_), MIX_ROW(9, _E_, _MAX_), \
+	MIX_ROW(10, _E_, _MAX_), MIX_ROW(11, _E_, _MAX_), \
+	MIX_ROW(12, _E_, _MAX_) }
+
+/* Levels by direction, steps of steer and speed. Row 0 is the wheel on
+   the outside of the turn. */
+static const uint8_t mix_tab[2][ENCODER0_MAX + 1][ENCODER1_MAX + 1] = {
+	MIX_TAB(MIX_FWD_EXPO, MIX_FWD_MAX),
+	MIX_TAB(MIX_REV_EXPO, MIX_REV_MAX)
+};
+
+void mix_get(uint8_t dir, int8_t steer, int8_t speed, uint8_t * left,
+			 uint8_t * right)
+{
+	const uint8_t (* tab)[ENCODER1_MAX + 1] = mix_tab[dir & 1];
+	uint8_t a;
+
+	if (speed <= 0) {
+		*left = 0;
+		*right = 0;
+		return;
+	}
+
+	if (speed > ENCODER1_MAX)
+		speed = ENCODER1_MAX;
+	a = (steer < 0) ? (uint8_t)-steer : (uint8_t)steer;
+	if (a > ENCODER0_MAX)
+		a = ENCODER0_MAX;
+
+	if (steer < 0) {
+		*left = tab[a][speed];
+		*right = tab[0][speed];
+	} else {
+		*left = tab[0][speed];
+		*right = tab[a][speed];
+	}
+}
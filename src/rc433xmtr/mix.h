@@ -0,0 +1,60 @@
+/*
+ * Copyright(C) 2021 Robinson (Bob) Mittman. All Rights Reserved.
+ * Licensed under the MIT license.
+ * See LICENSE file in the project root for details.
+ *
+ */
+
+/* Differential drive mixing of the transmitter (mix.c).
+ *
+ * Steer (encoder 0) and speed (encoder 1) give the motor levels of both
+ * wheels, looked up in a table per direction built by the compiler: the
+ * wheel on the outside of the turn runs at the speed, the inside one is
+ * slowed down by 1/16 for every step of steer. A level is 0 when
+ * stopped, otherwise 63 plus a quarter of the speed curve, at most the
+ * limit of the direction. */
+
+#ifndef __MIX_H__
+#define __MIX_H__
+
+#include <stdint.h>
+
+#define MIX_FWD 0
+#define MIX_REV 1
+
+/* Speed curves, 0 linear to 16 full expo: the speed curve blends the
+   speed and its cube in that proportion, both 240 at full speed, so an
+   expo curve is gentler at low speed. 0 keeps the levels the main loop
+   used to compute. */
+#ifndef MIX_FWD_EXPO
+#define MIX_FWD_EXPO 0
+#endif
+
+#ifndef MIX_REV_EXPO
+#define MIX_REV_EXPO 0
+#endif
+
+/* highest motor level */
+#ifndef MIX_FWD_MAX
+#define MIX_FWD_MAX 124
+#endif
+
+#ifndef MIX_REV_MAX
+#define MIX_REV_MAX 100
+#endif
+
+#if (MIX_FWD_EXPO < 0) || (MIX_FWD_EXPO > 16) || \
+	(MIX_REV_EXPO < 0) || (MIX_REV_EXPO > 16)
+#error "MIX_FWD_EXPO and MIX_REV_EXPO must be 0 to 16"
+#endif
+
+#if (MIX_FWD_MAX > 127) || (MIX_REV_MAX > 127)
+#error "MIX_FWD_MAX and MIX_REV_MAX must not be greater than 127"
+#endif
+
+/* Motor levels of the left and right wheels for direction 'dir', MIX_FWD
+   or MIX_REV. Steer is negative to the left, speed 0 or less stops. */
+void mix_get(uint8_t dir, int8_t steer, int8_t speed, uint8_t * left,
+			 uint8_t * right);
+
+#endif /* __MIX_H__ */
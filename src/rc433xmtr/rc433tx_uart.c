@@ -9,12 +9,29 @@
 #include <util/delay.h>
 #include <avr/interrupt.h> 
 #include <avr/sleep.h> 
+#include <util/atomic.h>
+#include <stddef.h>
 #include "rc433.h"
+#include "isrprof.h"
 
 #ifndef RFLINK_JOIN_FRAMES
 #define RFLINK_JOIN_FRAMES 1
 #endif
 
+#ifndef RFLINK_TX_FIFO_LEN
+#define RFLINK_TX_FIFO_LEN 4
+#endif
+
+#if (RFLINK_TX_FIFO_LEN & (RFLINK_TX_FIFO_LEN - 1)) || (RFLINK_TX_FIFO_LEN > 128)
+#error "RFLINK_TX_FIFO_LEN must be a power of two not greater than 128"
+#endif
+
+#define TX_FIFO_MSK (RFLINK_TX_FIFO_LEN - 1)
+
+#if (RFLINK_ISR_PROF) && (RFLINK_TSTAMP)
+#error "RFLINK_ISR_PROF and RFLINK_TSTAMP both need Timer1"
+#endif
+
 #define USART_BAUDRATE 4800
 
 #define ASYNCHRONOUS (0 << UMSEL00)
@@ -78,27 +95,209 @@ static const uint8_t encode_lut[] = {
 	0x66, 0x56, 0xa6, 0x6a, 0x96, 0x36, 0x5a, 0xaa, 0x9a, 0xb2, 0x4d, 
     0x65, 0x4b, 0x55, 0xa5, 0x2d };
 
+#if (RFLINK_FEC)
+/* GF(16), x^4 + x + 1. The exp table is doubled so the sum of two logs
+   needs no reduction. */
+static const uint8_t gf16_exp[30] = {
+	0x01, 0x02, 0x04, 0x08, 0x03, 0x06, 0x0c, 0x0b, 
+	0x05, 0x0a, 0x07, 0x0e, 0x0f, 0x0d, 0x09, 0x01, 
+	0x02, 0x04, 0x08, 0x03, 0x06, 0x0c, 0x0b, 0x05, 
+	0x0a, 0x07, 0x0e, 0x0f, 0x0d, 0x09
+};
+
+static const uint8_t gf16_log[16] = {
+	0x00, 0x00, 0x01, 0x04, 0x02, 0x08, 0x05, 0x0a, 
+	0x03, 0x0e, 0x09, 0x07, 0x06, 0x0d, 0x0b, 0x0c
+};
+
+/* log of the RS generator (x + a)(x + a^2)(x + a^3)(x + a^4) 
+   coefficients, x^3 down to x^0 */
+static const uint8_t rs_gen_log[4] = { 13, 6, 3, 10 };
+#endif
 
 #define PKT_LEN 4
 
-struct pkt {
-	uint8_t dat[4];
+/* RS parity bytes of a FEC frame */
+#define FEC_LEN 2
+
+#define RF_SYNC_SYM 0xf0
+/* replace the last sync of a FEC or a variable length frame */
+#define RF_FEC_SYM 0xfc
+#define RF_VAR_SYM 0xc0
+/* replace the last sync of a packet that must be acknowledged */
+#define RF_ARQ_SYM 0x1f
+/* follows the syncs of an ACK frame */
+#define RF_ACK_SYM 0x07
+
+/* line symbols of a frame: 4 sync + 2 per data byte */
+#define RF_FRM_SYM_LEN (4 + (2 * PKT_LEN))
+
+/* variable length frame: 4 sync, length byte, payload, CRC-16 */
+#define RF_VAR_SYM_LEN(_LEN_) (4 + (2 * (1 + (_LEN_))) + 4)
+
+#if (RFLINK_FEC)
+#define RF_FEC_SYM_MAX (RF_FRM_SYM_LEN + (2 * FEC_LEN))
+#else
+#define RF_FEC_SYM_MAX 0
+#endif
+
+#if (RFLINK_FRM_MAX)
+#define RF_VAR_SYM_MAX RF_VAR_SYM_LEN(RFLINK_FRM_MAX)
+#else
+#define RF_VAR_SYM_MAX 0
+#endif
+
+#define RF_MAX(_A_, _B_) (((_A_) > (_B_)) ? (_A_) : (_B_))
+
+/* queue slot size, the longest frame type compiled in */
+#define RF_FRM_SYM_MAX RF_MAX(RF_FRM_SYM_LEN, \
+							  RF_MAX(RF_FEC_SYM_MAX, RF_VAR_SYM_MAX))
+
+#if (RFLINK_FRM_MAX > 64)
+#error "RFLINK_FRM_MAX must not be greater than 64"
+#endif
+
+/* A queued frame, already CRC'd and expanded to line symbols by
+   rc433_pkt_send(), so the UDRE ISR only has to copy bytes out. The
+   symbols take the room of the slot it sits in. */
+struct frm {
+	uint8_t len;
+#if (RFLINK_TSTAMP)
+	/* Timer1 when queued, then when the first symbol went out */
+	uint16_t ts;
+#endif
+	uint8_t sym[];
 };
 
+/* queue slot, the longest frame type compiled in */
+struct frm_slot {
+	struct frm frm;
+	uint8_t sym[RF_FRM_SYM_MAX];
+};
+
+/* slot of the ARQ packet and of the mailbox, plain packets only */
+struct pkt_slot {
+	struct frm frm;
+	uint8_t sym[RF_FRM_SYM_LEN];
+};
+
+/* Transmit queue. rc433_pkt_send() owns 'head' and fills the free slots,
+   the USART ISR chain owns 'tail' and only releases a slot after the last
+   symbol of its frame has been written to UDR0. */
 struct {
 	volatile uint8_t head;
 	volatile uint8_t tail;
 	volatile uint16_t err;
+	/* index of the next symbol to send */
 	volatile uint8_t state;
-	struct pkt pkt;
+	/* index of the first symbol sent, after the idle line and after
+	   another frame, see rc433_preamble_set() */
+	uint8_t pre;
+	uint8_t pre_join;
+	/* frame being sent, NULL between frames. ISR only. */
+	struct frm * cur;
+	struct frm_slot slot[RFLINK_TX_FIFO_LEN];
 } tx;
 
+/* Acknowledged mode. An ARQ packet is a plain packet with the last sync
+   replaced by RF_ARQ_SYM. It has a slot of its own, which is sent ahead
+   of the queue, and the queue is held while the ACK is due, since the
+   radio is half duplex. The receiver answers with an ACK frame: syncs,
+   RF_ACK_SYM and the first byte of the packet (sequence number and
+   CRC5). Without an ACK the packet goes out again after a backoff, up to
+   RFLINK_ARQ_TRIES times in all. */
+#if (RFLINK_ARQ)
+#ifndef RFLINK_ARQ_TRIES
+#define RFLINK_ARQ_TRIES 4
+#endif
+
+/* line symbols of the ACK frame: 2 lead-in, 3 sync, marker, 2 data */
+#define RF_ACK_SYM_LEN 8
+
+/* Timer 2 period while the ACK is due or during a backoff: 4 ms */
+#define ARQ_TICK_US 4000ul
+#define ARQ_TICK_ITV USART_US2TMR(ARQ_TICK_US)
+/* ACK timeout in ticks: the ACK frame on the air plus 4 ms for the
+   receiver to turn around */
+#define ARQ_TMO ((((RF_ACK_SYM_LEN * 10ul * 1000000ul) / (USART_BAUDRATE)) + \
+				  4000ul + ARQ_TICK_US - 1) / ARQ_TICK_US)
+/* backoff before the n-th retransmission: ARQ_BACKOFF << (n - 1) ticks */
+#define ARQ_BACKOFF 1
+
+#define ARQ_IDLE  0
+/* waiting for the transmitter */
+#define ARQ_DUE   1
+/* on the air */
+#define ARQ_TX    2
+/* last symbol written, waiting for the end of the stop bit */
+#define ARQ_SENT  3
+/* listening for the ACK */
+#define ARQ_WAIT  4
+/* backoff before the next try */
+#define ARQ_DELAY 5
+
+/* ACK decoder states */
+#define ACK_IDLE 0
+#define ACK_SYNC 1
+#define ACK_LO   2
+#define ACK_HI   3
+
+struct {
+	volatile uint8_t state;
+	/* RC433_ARQ_... */
+	volatile int8_t res;
+	volatile uint8_t tries;
+	/* Timer 2 ticks left in ARQ_WAIT and ARQ_DELAY */
+	uint8_t tmo;
+	/* first byte of the packet, echoed by the ACK */
+	uint8_t id;
+	uint8_t ack_state;
+	uint8_t ack_lo;
+	struct pkt_slot slot;
+} arq;
+#endif
+
+/* Mailbox, rc433_mbox_post(). Two slots: the latest setpoint and the
+   frame on the air, which a post does not touch. 'cnt' copies of the
+   latest go out ahead of the queue, each one read from 'lst' as it
+   starts, so a post replaces the copies not started yet. */
+#if (RFLINK_MBOX)
+struct {
+	volatile uint8_t cnt;
+	volatile uint8_t lst;
+	struct pkt_slot slot[2];
+} mbox;
+#endif
+
+/* otherwise the index of the next symbol */
 #define RF_TX_IDLE 0
-#define RF_TX_SYNC1 1
-#define RF_TX_SYNC2 2
-#define RF_TX_SYNC3 3
-#define RF_TX_SYNC4 4
-#define RF_TX_EOF 12
+/* past the last symbol of the frame, which has been released */
+#define RF_TX_EOF 0xff
+
+#if (RFLINK_TSTAMP)
+/* Timer1 free running at clk/64 */
+#define TS_TICK_NS ((uint16_t)(64000000000ull / (F_CPU)))
+
+struct {
+	uint16_t mark;
+	uint8_t marked;
+	struct rc433_lat app;
+	struct rc433_lat queue;
+	struct rc433_lat air;
+} lat;
+
+/* A frame is handed over to the link. */
+static void rflink_stamp(struct frm * frm)
+{
+	uint16_t t = rc433_tstamp();
+
+	frm->ts = t;
+	if (lat.marked) {
+		prof_lat_add(&lat.app, t - lat.mark);
+		lat.marked = 0;
+	}
+}
+#endif
 
 static inline void uart_tx_set(void) 
 {
@@ -132,23 +331,141 @@ static inline void usart_tmr_set(uint8_t val)
 	TCCR2B = (1 << FOC2A) | (1 << CS22) | (1 << CS21) | (1 << CS20);
 }
 
-ISR(TIMER2_COMPA_vect) 
+/* Something to send at a frame boundary. The queued frames are held
+   while an ARQ packet waits for its ACK. */
+static inline uint8_t rflink_tx_ready(void)
+{
+#if (RFLINK_ARQ)
+	uint8_t st = arq.state;
+
+	if (st == ARQ_DUE)
+		return 1;
+	if (st >= ARQ_SENT)
+		return 0;
+#endif
+#if (RFLINK_MBOX)
+	if (mbox.cnt != 0)
+		return 1;
+#endif
+	return tx.tail != tx.head;
+}
+
+#if (RFLINK_ARQ)
+/* The ARQ packet is done with, acknowledged or given up. Release the
+   queue. */
+static void arq_end(int8_t res)
+{
+	arq.res = res;
+	arq.state = ARQ_IDLE;
+	/* disable timer */
+	TCCR2B = (1 << FOC2A);
+	if (rflink_tx_ready() && (tx.state == RF_TX_IDLE)) {
+		/* enable the Data Register Empty Interrupt */
+		UCSR0B |= (1 << UDRIE0);
+	}
+}
+
+/* nibble of a data symbol, 0xff if it is not one */
+static uint8_t arq_sym_decode(uint8_t c)
+{
+	uint8_t i;
+
+	for (i = 0; i < 16; ++i) {
+		if (encode_lut[i] == c)
+			return i;
+	}
+
+	return 0xff;
+}
+
+/* ACK decoder */
+PROF_ISR(USART_RX_vect, RC433_ISR_RX, 0)
+{
+	uint8_t st = arq.ack_state;
+	uint8_t c = UDR0;
+	uint8_t nib;
+
+	if (c == RF_SYNC_SYM) {
+		arq.ack_state = ACK_SYNC;
+		return;
+	}
+
+	if (c == RF_ACK_SYM) {
+		arq.ack_state = (st == ACK_SYNC) ? ACK_LO : ACK_IDLE;
+		return;
+	}
+
+	if ((st < ACK_LO) || ((nib = arq_sym_decode(c)) > 0x0f)) {
+		arq.ack_state = ACK_IDLE;
+		return;
+	}
+
+	if (st == ACK_LO) {
+		arq.ack_lo = nib;
+		arq.ack_state = ACK_HI;
+		return;
+	}
+
+	arq.ack_state = ACK_IDLE;
+
+	/* a late ACK, during the backoff, is as good */
+	if (((arq.ack_lo | (nib << 4)) == arq.id) && (arq.state >= ARQ_SENT))
+		arq_end(RC433_ARQ_ACK);
+}
+#endif
+
+PROF_ISR(TIMER2_COMPA_vect, RC433_ISR_TMR2, PROF_LAT(TCNT2, OCR2A, 1024))
 {
+#if (RFLINK_ARQ)
+	uint8_t st = arq.state;
+
+	if (st >= ARQ_WAIT) {
+		/* the timer keeps running in CTC mode */
+		if (--arq.tmo != 0)
+			return;
+
+		if (st == ARQ_WAIT) {
+			if (arq.tries >= RFLINK_ARQ_TRIES) {
+				arq_end(RC433_ARQ_FAIL);
+				return;
+			}
+			arq.tmo = ARQ_BACKOFF << (arq.tries - 1);
+			arq.state = ARQ_DELAY;
+			return;
+		}
+
+		/* backoff over, send it again */
+		arq.state = ARQ_DUE;
+		TCCR2B = (1 << FOC2A);
+		UCSR0B |= (1 << UDRIE0);
+		return;
+	}
+#endif
+
     /* disable timer */
 	TCCR2B = (1 << FOC2A);
 	/* enable transmitter enable data register empty interrupt */
 	UCSR0B |= ((1 << TXEN0) | (1 << UDRIE0));
 }
 
-ISR(USART_TX_vect)
+PROF_ISR(USART_TX_vect, RC433_ISR_TXC, 0)
 {
-	if (tx.tail == tx.head) {
+	if (!rflink_tx_ready()) {
 		/* no packet pending */ 
 		uart_tx_clr();
 		/* disable transmitter and TX Complete Interrupt */
 		UCSR0B &= ~((1 << TXEN0) | (1 << TXCIE0));
 //		led_off();
 		tx.state = RF_TX_IDLE;
+#if (RFLINK_ARQ)
+		if (arq.state == ARQ_SENT) {
+			/* carrier off, listen for the ACK */
+			arq.state = ARQ_WAIT;
+			arq.tmo = ARQ_TMO;
+			arq.ack_state = ACK_IDLE;
+			usart_tmr_set(ARQ_TICK_ITV);
+		}
+#endif
 	} else {
 		/* disable data register empty interrupt and TX Complete Interrupt */
 		UCSR0B &= ~((1 << UDRIE0) | (1 << TXCIE0));
@@ -156,18 +473,17 @@ ISR(USART_TX_vect)
 		uart_tx_set();
 //		led_on();
 		usart_tmr_set(USART_IDLE_ITV);
-		tx.state = RF_TX_SYNC2;
+		tx.state = tx.pre_join;
 	}
 }
 
-ISR(USART_UDRE_vect)
+PROF_ISR(USART_UDRE_vect, RC433_ISR_UDRE, 0)
 {
+	struct frm * frm;
 	uint8_t tail = tx.tail;
-	uint8_t cnt = tx.state;
-	uint8_t d;
+	uint8_t pos = tx.state;
 
-	switch (cnt) {
-	case RF_TX_IDLE:
+	if (pos == RF_TX_IDLE) {
 		if ((UCSR0B & (1 << TXEN0)) == 0) {
 			/* disable data register empty interrupt */
 			UCSR0B &= ~(1 << UDRIE0);
@@ -177,79 +493,12 @@ ISR(USART_UDRE_vect)
 			usart_tmr_set(USART_IDLE_ITV);
 			return;
 		}
-		UDR0 = 0xf0; /* Sync 1 */
-		tx.state = RF_TX_SYNC1;
-		break;
-
-	case RF_TX_SYNC1:
-		UDR0 = 0xf0; /* Sync 2 */
-		tx.state = RF_TX_SYNC2;
-		break;
-
-	case RF_TX_SYNC2:
-		UDR0 = 0xf0; /* Sync 3 */
-		tx.state = RF_TX_SYNC3;
-		break;
-
-	case RF_TX_SYNC3:
-		UDR0 = 0xf0; /* Sync 4 */
-		tx.state = RF_TX_SYNC4;
-		break;
-
-	case RF_TX_SYNC4:
-		d = tx.pkt.dat[0];
-		UDR0 = encode_lut[d & 0x0f];
-		tx.state = 5;
-		break;
-
-	case 5:
-		d = tx.pkt.dat[0];
-		UDR0 = encode_lut[(d >> 4) & 0x0f];
-		tx.state = 6;
-		break;
-
-	case 6:
-		d = tx.pkt.dat[1];
-		UDR0 = encode_lut[d & 0x0f];
-		tx.state = 7;
-		break;
-
-	case 7:
-		d = tx.pkt.dat[1];
-		UDR0 = encode_lut[(d >> 4) & 0x0f];
-		tx.state = 8;
-		break;
-
-	case 8:
-		d = tx.pkt.dat[2];
-		UDR0 = encode_lut[d & 0x0f];
-		tx.state = 9;
-		break;
-
-	case 9:
-		d = tx.pkt.dat[2];
-		UDR0 = encode_lut[(d >> 4) & 0x0f];
-		tx.state = 10;
-		break;
-
-	case 10:
-		d = tx.pkt.dat[3];
-		UDR0 = encode_lut[d & 0x0f];
-		tx.state = 11;
-		break;
-
-	case 11:
-		d = tx.pkt.dat[3];
-		UDR0 = encode_lut[(d >> 4) & 0x0f];
-		tail++;
-		tx.tail = tail;
-		tx.state = RF_TX_EOF;
-		break;
-
-	case RF_TX_EOF:
+		/* carrier keyed up, full preamble */
+		pos = tx.pre;
+	} else if (pos == RF_TX_EOF) {
 #if (RFLINK_JOIN_FRAMES)
-		if (tx.tail != tx.head) {
-			tx.state = RF_TX_SYNC2;
+		if (rflink_tx_ready()) {
+			tx.state = tx.pre_join;
 		} else
 #endif
 		{
@@ -258,26 +507,116 @@ ISR(USART_UDRE_vect)
 			/* enable the Tx Complete Interrupt */
 			UCSR0B |= (1 << TXCIE0);
 		}
-		break;
+		return;
+	}
+
+	if ((frm = tx.cur) == NULL) {
+		/* first symbol of a frame, the ARQ packet goes first, then the
+		   mailbox */
+#if (RFLINK_ARQ)
+		if (arq.state == ARQ_DUE) {
+			arq.state = ARQ_TX;
+			arq.tries++;
+			frm = &arq.slot.frm;
+		} else
+#endif
+#if (RFLINK_MBOX)
+		if (mbox.cnt != 0) {
+			mbox.cnt--;
+			frm = &mbox.slot[mbox.lst].frm;
+		} else
+#endif
+		frm = &tx.slot[tail & TX_FIFO_MSK].frm;
+		tx.cur = frm;
+#if (RFLINK_TSTAMP)
+		{
+			uint16_t t = TCNT1;
+
+			prof_lat_add(&lat.queue, t - frm->ts);
+			frm->ts = t;
+		}
+#endif
 	}
+
+	UDR0 = frm->sym[pos];
+
+	if (++pos == frm->len) {
+#if (RFLINK_TSTAMP)
+		prof_lat_add(&lat.air, TCNT1 - frm->ts);
+#endif
+#if (RFLINK_ARQ)
+		if (frm == &arq.slot.frm)
+			arq.state = ARQ_SENT;
+		else
+#endif
+#if (RFLINK_MBOX)
+		if ((frm != &mbox.slot[0].frm) && (frm != &mbox.slot[1].frm))
+#endif
+		/* last symbol is out, release the queue slot */
+		tx.tail = tail + 1;
+		tx.cur = NULL;
+		pos = RF_TX_EOF;
+	}
+
+	tx.state = pos;
 }
 
-/* */
-int8_t rc433_pkt_send(uint8_t dat[])
+#if (RFLINK_FEC)
+static inline uint8_t gf16_mul(uint8_t a, uint8_t log_b)
 {
-	uint8_t head = tx.head;
-	uint8_t crc;
-	uint8_t idx;
-	uint8_t d[4];
-	
-	d[0] = dat[0];
-	d[1] = dat[1];
-	d[2] = dat[2];
-	d[3] = dat[3];
+	return (a == 0) ? 0 : gf16_exp[gf16_log[a] + log_b];
+}
 
-	if (head != tx.tail) {
-		return 0;
+/* Append the 4 parity symbols of the shortened RS(12,8) code over the 8
+   nibbles of 'd', sent low nibble first. */
+static void rflink_fec_encode(uint8_t * sym, uint8_t d[])
+{
+	uint8_t p[4] = { 0, 0, 0, 0 };
+	uint8_t i;
+
+	for (i = 0; i < 2 * PKT_LEN; ++i) {
+		uint8_t m = (i & 1) ? d[i >> 1] >> 4 : d[i >> 1] & 0x0f;
+		uint8_t fb = m ^ p[0];
+
+		p[0] = p[1] ^ gf16_mul(fb, rs_gen_log[0]);
+		p[1] = p[2] ^ gf16_mul(fb, rs_gen_log[1]);
+		p[2] = p[3] ^ gf16_mul(fb, rs_gen_log[2]);
+		p[3] = gf16_mul(fb, rs_gen_log[3]);
+	}
+
+	sym[0] = encode_lut[p[0]];
+	sym[1] = encode_lut[p[1]];
+	sym[2] = encode_lut[p[2]];
+	sym[3] = encode_lut[p[3]];
+}
+#endif
+
+/* Publish the slot at 'head', filled by the caller. */
+static void rflink_commit(uint8_t head)
+{
+	ATOMIC_BLOCK(ATOMIC_FORCEON)
+	{
+		/* signal pending */
+		tx.head = head + 1;
+	
+		/* Kick the transmitter only if it is idle and nothing was queued.
+		   Otherwise the ISR chain picks the frame up, either joined at
+		   RF_TX_EOF or after the inter frame gap from USART_TX_vect, or
+		   the end of an ARQ exchange releases it. */
+		if ((tx.state == RF_TX_IDLE) && (head == tx.tail) &&
+			rflink_tx_ready()) {
+			/* enable the Data Register Empty Interrupt */
+			UCSR0B |= (1 << UDRIE0);
+		}
 	}
+}
+
+/* Add the CRC5 to 'd' and expand it to line symbols into 'frm'. */
+static void rflink_encode(struct frm * frm, uint8_t d[])
+{
+	uint8_t * sym;
+	uint8_t crc;
+	uint8_t idx;
 
 	d[0] &= 0xe0;
 	idx = 0x1f ^ d[0];
@@ -289,16 +628,298 @@ int8_t rc433_pkt_send(uint8_t dat[])
 	idx = crc ^ d[3];
 	crc = crc5lut[idx];
 	crc ^= 0x1f;
-	tx.pkt.dat[0] = d[0] | (crc & 0x1f);
-	tx.pkt.dat[1] = d[1];
-	tx.pkt.dat[2] = d[2];
-	tx.pkt.dat[3] = d[3];
+	d[0] |= crc & 0x1f;
+
+	/* expand to line symbols */
+	sym = frm->sym;
+	sym[0] = RF_SYNC_SYM;
+	sym[1] = RF_SYNC_SYM;
+	sym[2] = RF_SYNC_SYM;
+	sym[3] = RF_SYNC_SYM;
+	sym[4] = encode_lut[d[0] & 0x0f];
+	sym[5] = encode_lut[d[0] >> 4];
+	sym[6] = encode_lut[d[1] & 0x0f];
+	sym[7] = encode_lut[d[1] >> 4];
+	sym[8] = encode_lut[d[2] & 0x0f];
+	sym[9] = encode_lut[d[2] >> 4];
+	sym[10] = encode_lut[d[3] & 0x0f];
+	sym[11] = encode_lut[d[3] >> 4];
+	frm->len = RF_FRM_SYM_LEN;
+}
 
-	/* signal pending */
-	tx.head = head + 1;
+static int8_t rflink_send(uint8_t dat[], uint8_t fec)
+{
+	uint8_t head = tx.head;
+	struct frm * frm;
+	uint8_t d[4];
 	
-	/* enable the Data Register Empty Interrupt */
-	UCSR0B |= (1 << UDRIE0);
+	d[0] = dat[0];
+	d[1] = dat[1];
+	d[2] = dat[2];
+	d[3] = dat[3];
+
+	if ((uint8_t)(head - tx.tail) == RFLINK_TX_FIFO_LEN) {
+		/* queue full */
+		return 0;
+	}
+
+	frm = &tx.slot[head & TX_FIFO_MSK].frm;
+	rflink_encode(frm, d);
+#if (RFLINK_TSTAMP)
+	rflink_stamp(frm);
+#endif
+
+#if (RFLINK_FEC)
+	if (fec) {
+		frm->sym[3] = RF_FEC_SYM;
+		rflink_fec_encode(&frm->sym[RF_FRM_SYM_LEN], d);
+		frm->len = RF_FRM_SYM_LEN + (2 * FEC_LEN);
+	}
+#endif
+
+	rflink_commit(head);
+
+	return 1;
+}
+
+/* */
+int8_t rc433_pkt_send(uint8_t dat[])
+{
+	return rflink_send(dat, 0);
+}
+
+#if (RFLINK_FEC)
+/* */
+int8_t rc433_fec_send(uint8_t dat[])
+{
+	return rflink_send(dat, 1);
+}
+#endif
+
+#if (RFLINK_ARQ)
+/* */
+int8_t rc433_arq_send(uint8_t dat[])
+{
+	uint8_t d[4];
+	int8_t ret = 0;
+
+	d[0] = dat[0];
+	d[1] = dat[1];
+	d[2] = dat[2];
+	d[3] = dat[3];
+
+	ATOMIC_BLOCK(ATOMIC_FORCEON)
+	{
+		uint8_t st = arq.state;
+
+		/* the slot is read by the ISR while on the air */
+		if (st != ARQ_TX) {
+			rflink_encode(&arq.slot.frm, d);
+			arq.slot.frm.sym[3] = RF_ARQ_SYM;
+#if (RFLINK_TSTAMP)
+			rflink_stamp(&arq.slot.frm);
+#endif
+			arq.id = d[0];
+			arq.tries = 0;
+			arq.res = RC433_ARQ_BUSY;
+			arq.state = ARQ_DUE;
+			if (st >= ARQ_WAIT) {
+				/* replaces a packet waiting for its ACK */
+				TCCR2B = (1 << FOC2A);
+			}
+			if (tx.state == RF_TX_IDLE) {
+				/* enable the Data Register Empty Interrupt */
+				UCSR0B |= (1 << UDRIE0);
+			}
+			ret = 1;
+		}
+	}
+
+	return ret;
+}
+
+/* */
+int8_t rc433_arq_status(void)
+{
+	return arq.res;
+}
+
+/* */
+uint8_t rc433_arq_tries(void)
+{
+	return arq.tries;
+}
+#endif
+
+#if (RFLINK_MBOX)
+/* */
+void rc433_mbox_post(uint8_t dat[], uint8_t copies)
+{
+	uint8_t d[4];
+
+	d[0] = dat[0];
+	d[1] = dat[1];
+	d[2] = dat[2];
+	d[3] = dat[3];
+
+	ATOMIC_BLOCK(ATOMIC_FORCEON)
+	{
+		uint8_t i = mbox.lst;
+		uint8_t ready = rflink_tx_ready();
+
+		/* the slot on the air is read by the ISR, take the other one */
+		if (tx.cur == &mbox.slot[i].frm)
+			i ^= 1;
+		rflink_encode(&mbox.slot[i].frm, d);
+#if (RFLINK_TSTAMP)
+		rflink_stamp(&mbox.slot[i].frm);
+#endif
+		mbox.lst = i;
+		mbox.cnt = copies;
+
+		/* Kick the transmitter only if nothing was ready: otherwise the
+		   ISR chain picks the post up at the next frame, or the end of
+		   an ARQ exchange does. */
+		if (!ready && (tx.state == RF_TX_IDLE) && rflink_tx_ready()) {
+			/* enable the Data Register Empty Interrupt */
+			UCSR0B |= (1 << UDRIE0);
+		}
+	}
+}
+#endif
+
+#if (RFLINK_FRM_MAX)
+static const uint16_t crc16lut[16] = {
+	0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7, 
+	0x8108, 0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef
+};
+
+/* CRC-16-CCITT, one nibble at a time, in line order */
+static inline uint16_t crc16_nib(uint16_t crc, uint8_t nib)
+{
+	return (crc << 4) ^ crc16lut[(crc >> 12) ^ nib];
+}
+
+/* */
+int8_t rc433_frm_send(const uint8_t dat[], uint8_t len)
+{
+	uint8_t head = tx.head;
+	struct frm * frm;
+	uint8_t * sym;
+	uint16_t crc;
+	uint8_t i;
+
+	if ((len == 0) || (len > RFLINK_FRM_MAX)) {
+		return -1;
+	}
+
+	if ((uint8_t)(head - tx.tail) == RFLINK_TX_FIFO_LEN) {
+		/* queue full */
+		return 0;
+	}
+
+	frm = &tx.slot[head & TX_FIFO_MSK].frm;
+	sym = frm->sym;
+	sym[0] = RF_SYNC_SYM;
+	sym[1] = RF_SYNC_SYM;
+	sym[2] = RF_SYNC_SYM;
+	sym[3] = RF_VAR_SYM;
+	sym += 4;
+
+	/* the length byte is covered by the CRC as well */
+	crc = 0xffff;
+	*sym++ = encode_lut[len & 0x0f];
+	*sym++ = encode_lut[len >> 4];
+	crc = crc16_nib(crc, len & 0x0f);
+	crc = crc16_nib(crc, len >> 4);
+
+	for (i = 0; i < len; ++i) {
+		uint8_t c = dat[i];
+
+		*sym++ = encode_lut[c & 0x0f];
+		*sym++ = encode_lut[c >> 4];
+		crc = crc16_nib(crc, c & 0x0f);
+		crc = crc16_nib(crc, c >> 4);
+	}
+
+	/* most significant nibble first, the receiver ends up with 0 */
+	*sym++ = encode_lut[crc >> 12];
+	*sym++ = encode_lut[(crc >> 8) & 0x0f];
+	*sym++ = encode_lut[(crc >> 4) & 0x0f];
+	*sym++ = encode_lut[crc & 0x0f];
+
+	frm->len = RF_VAR_SYM_LEN(len);
+#if (RFLINK_TSTAMP)
+	rflink_stamp(frm);
+#endif
+
+	rflink_commit(head);
+
+	return 1;
+}
+#endif
+
+/* */
+uint8_t rc433_tx_pending(void)
+{
+	return tx.head - tx.tail;
+}
+
+/* The transmitter is disabled once the stop bit of the last symbol is
+   out, see USART_TX_vect. */
+uint8_t rc433_tx_idle(void)
+{
+#if (RFLINK_ARQ)
+	if (arq.state != ARQ_IDLE)
+		return 0;
+#endif
+#if (RFLINK_MBOX)
+	if (mbox.cnt != 0)
+		return 0;
+#endif
+	return (tx.head == tx.tail) && (tx.state == RF_TX_IDLE) &&
+		((UCSR0B & (1 << TXEN0)) == 0);
+}
+
+#if (RFLINK_TSTAMP)
+/* */
+void rc433_tx_mark(uint16_t t)
+{
+	lat.mark = t;
+	lat.marked = 1;
+}
+
+/* */
+void rc433_tx_lat_get(struct rc433_tx_lat * l)
+{
+	l->tick_ns = TS_TICK_NS;
+	l->app = lat.app;
+	ATOMIC_BLOCK(ATOMIC_FORCEON)
+	{
+		l->queue = lat.queue;
+		l->air = lat.air;
+	}
+}
+#endif
+
+/* The frames keep the RC433_PRE_MAX preamble symbols, a shorter one
+   starts further in. */
+int8_t rc433_preamble_set(uint8_t len)
+{
+	uint8_t join = len - 2;
+
+	if ((len < RC433_PRE_MIN) || (len > RC433_PRE_MAX)) {
+		return -1;
+	}
+
+	if (join < RC433_PRE_MIN)
+		join = RC433_PRE_MIN;
+
+	ATOMIC_BLOCK(ATOMIC_FORCEON)
+	{
+		tx.pre = RC433_PRE_MAX - len;
+		tx.pre_join = RC433_PRE_MAX - join;
+	}
 
 	return 1;
 }
@@ -328,5 +949,22 @@ void rc433_init(void)
 	UCSR0B = (1 << RXEN0);
 	/* Enable rx complete interrupt */
 	UCSR0B |= (1 << RXCIE0);
+
+	rc433_preamble_set(RC433_PRE_MAX);
+
+#if (RFLINK_TSTAMP)
+	/* Timer1 free running at clk/64 */
+	TCCR1A = 0;
+	TCCR1B = (1 << CS11) | (1 << CS10);
+#elif (RFLINK_ISR_PROF)
+	/* Timer1 free running at clk/1, the cycle counter */
+	TCCR1A = 0;
+	TCCR1B = (1 << CS10);
+#endif
+
+#if (RFLINK_ARQ)
+	/* nothing outstanding */
+	arq.res = RC433_ARQ_ACK;
+#endif
 }
 
@@ -12,13 +12,15 @@
 #include <stdbool.h>
 
 #include "io.h"
+#include "mix.h"
 #include "rc433.h"
 
-void led_flash(uint8_t itv)
-{
-	io_tmr0_set(itv);
-	led_on();
-}
+/* keepalive while driving, repeats the command when 'idle' runs out */
+static struct tmr idle_tmr;
+
+/* timer ticks, whatever the tick (IO_TICKLESS) */
+#define IDLE_TICKS IO_MS2TICKS(32)
+#define LED_TICKS IO_MS2TICKS(12)
 
 #define FORWARD 1
 #define REVERSE 2
@@ -36,6 +38,8 @@ int main(void)
 	io_init();
 	rc433_init();
 
+	tmr_setup(&idle_tmr, NULL, EV_TMR1);
+
 	dat[0] = 0;
 	dat[1] = 1;
 	dat[2] = 0;
@@ -48,21 +52,45 @@ int main(void)
 	xmt = 1;
 
 	while(1) {
+		uint8_t rem;
 		uint8_t ev;
 
 		while ((ev = io_events_get()) == 0) {
+#if (RFLINK_ARQ)
+			/* One acknowledged packet stands for all the copies: the
+			   link retransmits it until the receiver answers, and a
+			   newer command replaces it. Refused only while a frame
+			   is being shifted out, try again on the next wake-up. */
+			if (xmt && rc433_arq_send(dat)) {
+				led_flash(LED_TICKS);
+				xmt = 0;
+			}
+#elif (RFLINK_MBOX)
+			/* The copies of a command replace the ones left of the
+			   previous command, and every frame takes the latest as it
+			   starts: the frame on the air is the only stale one. */
 			if (xmt) {
-				if (rc433_pkt_send(dat)) {
-					led_flash(100);
-					xmt--;
-				}
+				rc433_mbox_post(dat, xmt);
+				led_flash(LED_TICKS);
+				xmt = 0;
+			}
+#else
+			/* Keep one frame on the air and one queued behind it, so the
+			   ISR chain joins them back-to-back, but never queue deeper
+			   than that with repeats: a new setpoint must not wait
+			   behind stale copies. */
+			while (xmt && (rc433_tx_pending() < 2)) {
+				if (!rc433_pkt_send(dat))
+					break;
+				led_flash(LED_TICKS);
+				xmt--;
 			}
-			sleep_mode();
+#endif
+			io_sleep();
 		}	
 
-		if (ev & EV_TMR0) {
-			led_off();
-		}
+		/* copies left of the current command */
+		rem = xmt;
 
 		if (ev & EV_SW2) {
 			sw2 = io_sw2_get();
@@ -80,42 +108,17 @@ int main(void)
 		switch (mode) {
 		case FORWARD:
 			if ((ev & EV_SW2) || (ev & EV_ENC0) || (ev & EV_ENC1)) {
-				int8_t steer = io_encoder0_get();
-				int8_t speed = io_encoder1_get();
 				uint8_t m_left;
 				uint8_t m_right;
 
-				if (speed > 0) {
-					if (steer < 0) { 
-						uint8_t rate = 16 - ((uint8_t)-steer);
-
-						m_left = (uint8_t)(speed * (rate)) / 4;
-						m_right = (uint8_t)(speed * 16) / 4;
-					} else {
-						uint8_t rate = 16 - ((uint8_t)steer);
-
-						m_left = (uint8_t)(speed * 16) / 4;
-						m_right = (uint8_t)(speed * (rate)) / 4;
-					}
-
-					m_left += 63;
-					m_right += 63;
-
-					if (m_left > 124)
-						m_left = 124;
-
-					if (m_right > 124)
-						m_right = 124;
-				} else {
-					m_left = 0;
-					m_right = 0;
-				}
+				mix_get(MIX_FWD, io_encoder0_get(), io_encoder1_get(),
+						&m_left, &m_right);
 
 				dat[1] = 1;
 				dat[2] = (int8_t)(m_left);
 				dat[3] = (int8_t)(m_right);
 
-				io_tmr1_set(255);
+				tmr_start(&idle_tmr, IDLE_TICKS, 0);
 				xmt = 10;
 				idle = 80;
 			} else if (ev & EV_SW1) {
@@ -126,7 +129,7 @@ int main(void)
 					dat[3] = 0;
 
 					idle = 0;
-					io_tmr1_set(0);
+					tmr_stop(&idle_tmr);
 					io_encoder0_set(0);
 					io_encoder1_set(0);
 					xmt = 10;
@@ -134,7 +137,7 @@ int main(void)
 			} 
 
 			if (ev & EV_TMR1) {
-				io_tmr1_set(255);
+				tmr_start(&idle_tmr, IDLE_TICKS, 0);
 				if (idle) {
 					if (--idle == 0) {
 						xmt = 10;
@@ -147,45 +150,17 @@ int main(void)
 
 		case REVERSE:
 			if ((ev & EV_SW2) || (ev & EV_ENC0) || (ev & EV_ENC1)) {
-				int8_t steer = io_encoder0_get();
-				int8_t speed = io_encoder1_get();
 				uint8_t m_left;
 				uint8_t m_right;
 
-				if (speed > 0) {
-					if (steer < 0) { 
-						uint8_t rate = 16 - ((uint8_t)-steer);
-
-						m_left = (uint8_t)(speed * rate) / 4;
-						m_right = (uint8_t)(speed * 16) / 4;
-
-					} else {
-						uint8_t rate = 16 - ((uint8_t)steer);
-
-						m_left = (uint8_t)(speed * 16) / 4;
-						m_right = (uint8_t)(speed * rate) / 4;
-					}
-
-					m_left += 63;
-					m_right += 63;
-
-					if (m_left > 100)
-						m_left = 100;
-
-					if (m_right > 100)
-						m_right = 100;
-
-				} else {
-					m_left = 0;
-					m_right = 0;
-				}
+				mix_get(MIX_REV, io_encoder0_get(), io_encoder1_get(),
+						&m_left, &m_right);
 
 				dat[1] = 1;
 				dat[2] = (int8_t)(-1 * (int8_t)(m_left));
 				dat[3] = (int8_t)(-1 * (int8_t)(m_right));
 
-
-				io_tmr1_set(255);
+				tmr_start(&idle_tmr, IDLE_TICKS, 0);
 				xmt = 10;
 				idle = 80;
 			} else if (ev & EV_SW1) {
@@ -196,7 +171,7 @@ int main(void)
 					dat[3] = 0;
 
 					idle = 0;
-					io_tmr1_set(0);
+					tmr_stop(&idle_tmr);
 					io_encoder0_set(0);
 					io_encoder1_set(0);
 					xmt = 10;
@@ -204,7 +179,7 @@ int main(void)
 			} 
 
 			if (ev & EV_TMR1) {
-				io_tmr1_set(255);
+				tmr_start(&idle_tmr, IDLE_TICKS, 0);
 				if (idle) {
 					if (--idle == 0) {
 						xmt = 10;
@@ -252,16 +227,28 @@ int main(void)
 
 		case 5:
 			if ((ev & EV_SW2) || (ev & EV_TMR1)) {
-				dat[0] = 0;
 				dat[1] = seq++;
 				dat[2] = seq++;
 				dat[3] = seq++;
 
-				io_tmr1_set(255);
+				tmr_start(&idle_tmr, IDLE_TICKS, 0);
 				xmt = 1;
 			}
 			break;
 		}
+
+		/* A new burst gets the next sequence number, its repeats keep
+		   it. When 'xmt' did not change the previous burst is still
+		   going out: a new payload differs from it anyway, and the
+		   same payload is the same command. */
+		if (xmt != rem) {
+			dat[0] = RC433_SEQ_NEXT(dat[0]);
+#if (RFLINK_TSTAMP)
+			/* latency from the encoder step to the send */
+			if (ev & (EV_ENC0 | EV_ENC1))
+				rc433_tx_mark(io_encoder_tstamp());
+#endif
+		}
 	}
 }
 